@@ -0,0 +1,332 @@
+#include "rite.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* selection, copy and paste. copying takes no bytes: the clipboard is a
+ * span of text per line, pointing into the lines' own storage, and a line
+ * pasted whole shares the storage of the one it came from.
+ *
+ * a line whose text is held anywhere else is marked shared, and the table
+ * of shares counts the holders of its text, the line itself included. a
+ * shared line is made to own its text again before it is changed in place
+ * or grown, which copies it if it is still held elsewhere, and its text is
+ * only freed by the last holder to let go. so a copy costs a table entry
+ * per line, and bytes are copied only when a line they came from changes */
+
+unsigned long
+share_hash (char *text)
+{
+    return ((unsigned long)text >> 4) * 2654435761UL;
+}
+
+/* the hash of a share, for the table */
+unsigned long
+share_item (void *item)
+{
+    return share_hash (((share_t *)item)->text);
+}
+
+/* whether a share is that of text key */
+bool
+share_same (void *item, void *key)
+{
+    return ((share_t *)item)->text == key;
+}
+
+/* one more holder of a line's text */
+void
+share_ref (line_t *l)
+{
+    share_t *s;
+
+    if (LINE_TEXT (l) == NULL)
+        return;
+
+    table_room (&rite.clip.shares);
+    s = table_slot (&rite.clip.shares, share_hash (LINE_TEXT (l)),
+                    LINE_TEXT (l));
+    if (s->text == NULL)
+        {
+            s->text = LINE_TEXT (l);
+            s->refs = (l->shared ? 1 : 2);
+            rite.clip.shares.n++;
+        }
+    else
+        s->refs++;
+    l->shared = true;
+}
+
+/* one holder of text less. returns true if that was the last */
+bool
+share_unref (char *text)
+{
+    share_t *s;
+
+    if (text == NULL
+        || (s = table_slot (&rite.clip.shares, share_hash (text), text))
+               == NULL
+        || s->text == NULL)
+        return true;
+
+    if (--s->refs > 0)
+        return false;
+    table_remove (&rite.clip.shares, s);
+    return true;
+}
+
+/* gives a line text of its own, to be changed in place */
+void
+share_own (line_t *l)
+{
+    vector_t text;
+
+    if (!l->shared)
+        return;
+
+    l->shared = false;
+    if (share_unref (LINE_TEXT (l)))
+        {
+            /* it was the last holder: the text is its own again. a table
+             * entry of one is dropped as well */
+            return;
+        }
+
+    text = l->text;
+    vector_init (&l->text, sizeof (char), text.pad);
+    l->text.len = text.len;
+    vector_resize (&l->text);
+    memcpy (l->text.data, text.data, text.len);
+}
+
+/* lets go of a line's text before it is freed, keeping it for the other
+ * holders if there are any */
+void
+share_drop (line_t *l)
+{
+    if (l->shared && !share_unref (LINE_TEXT (l)))
+        vector_init (&l->text, sizeof (char), l->text.pad);
+    l->shared = false;
+}
+
+void
+clip_clear ()
+{
+    span_t *sp;
+    int i;
+
+    for (i = 0; i < rite.clip.spans.len; ++i)
+        if ((sp = vector_get (&rite.clip.spans, i))->text != NULL
+            && share_unref (sp->text))
+            free (sp->text);
+    vector_deinit (&rite.clip.spans);
+    vector_init (&rite.clip.spans, sizeof (span_t), 0x100);
+}
+
+void
+clip_free ()
+{
+    clip_clear ();
+    vector_deinit (&rite.clip.spans);
+    table_deinit (&rite.clip.shares);
+}
+
+/* puts text [(r0, c0), (r1, c1)) of a page on the clipboard, a span a line */
+void
+clip_take (page_t *page, int r0, int c0, int r1, int c1)
+{
+    span_t *sp;
+    line_t *l;
+    int row;
+
+    clip_clear ();
+    for (row = r0; row <= r1; ++row)
+        {
+            l = vector_get (&page->lines, row);
+            sp = vector_append (&rite.clip.spans);
+            sp->from = (row == r0 ? c0 : 0);
+            sp->len = (row == r1 ? c1 : LINE_LEN (l)) - sp->from;
+            sp->text = NULL;
+            if (sp->len > 0)
+                {
+                    share_ref (l);
+                    sp->text = LINE_TEXT (l);
+                }
+        }
+}
+
+/* replaces text [(r0, c0), (r1, c1)) of the page with nothing */
+void
+clip_delete (int r0, int c0, int r1, int c1)
+{
+    line_t *first = vector_get (&rite.page->lines, r0);
+    line_t *last = vector_get (&rite.page->lines, r1), l;
+
+    line_init (&l);
+    line_extend (&l, LINE_TEXT (first), c0);
+    line_extend (&l, LINE_TEXT (last) + c1, LINE_LEN (last) - c1);
+    page_splice (rite.page, r0, r1 - r0 + 1, &l, 1);
+
+    rite.row = r0, rite.col = c0;
+    rite.want = -1;
+}
+
+void
+clip_copy ()
+{
+    int r0, c0, r1, c1;
+
+    if (!select_range (&r0, &c0, &r1, &c1))
+        {
+            status ("no selection");
+            return;
+        }
+
+    clip_take (rite.page, r0, c0, r1, c1);
+    rite.selecting = false;
+    sprintf (rite.status, "copied %i lines", rite.clip.spans.len);
+}
+
+void
+clip_cut ()
+{
+    int r0, c0, r1, c1;
+
+    if (!select_range (&r0, &c0, &r1, &c1))
+        {
+            status ("no selection");
+            return;
+        }
+
+    clip_take (rite.page, r0, c0, r1, c1);
+    clip_delete (r0, c0, r1, c1);
+    rite.selecting = false;
+}
+
+/* puts the clipboard in front of the cursor. the lines between the first
+ * and the last are whole, and share their text with where they came from */
+void
+clip_paste ()
+{
+    int n = rite.clip.spans.len, i;
+    line_t *l = vector_get (&rite.page->lines, rite.row), *lines;
+    span_t *sp = vector_head (&rite.clip.spans);
+
+    if (n == 0 || l == NULL)
+        {
+            status ("nothing to paste");
+            return;
+        }
+
+    if (n == 1)
+        {
+            insert (sp->text + sp->from, sp->len);
+            return;
+        }
+
+    multi_clear ();
+    if ((lines = malloc (n * sizeof (line_t))) == NULL)
+        return;
+
+    line_init (&lines[0]);
+    line_extend (&lines[0], LINE_TEXT (l), rite.col);
+    line_extend (&lines[0], sp[0].text + sp[0].from, sp[0].len);
+    for (i = 1; i < n - 1; ++i)
+        {
+            line_init (&lines[i]);
+            if (sp[i].text == NULL)
+                continue;
+            lines[i].text.data = sp[i].text;
+            lines[i].text.len = lines[i].text.size = sp[i].len + 1;
+            share_ref (&lines[i]);
+        }
+    line_init (&lines[n - 1]);
+    line_extend (&lines[n - 1], sp[n - 1].text, sp[n - 1].len);
+    line_extend (&lines[n - 1], LINE_TEXT (l) + rite.col,
+                 LINE_LEN (l) - rite.col);
+
+    page_splice (rite.page, rite.row, 1, lines, n);
+    free (lines);
+
+    rite.row += n - 1, rite.col = sp[n - 1].len;
+    rite.want = -1;
+}
+
+/* the selection, from the anchor to the cursor in either order */
+bool
+select_range (int *r0, int *c0, int *r1, int *c1)
+{
+    cursor_t a = rite.anchor, b;
+
+    if (!rite.selecting)
+        return false;
+
+    b.row = rite.row, b.col = rite.col;
+    if (multi_cmp (&a, &b) > 0)
+        b = rite.anchor, a.row = rite.row, a.col = rite.col;
+    *r0 = a.row, *c0 = a.col, *r1 = b.row, *c1 = b.col;
+    return multi_cmp (&a, &b) != 0;
+}
+
+/* the selected bytes [*from, *to) of a row */
+bool
+select_row (int row, int *from, int *to)
+{
+    int r0, c0, r1, c1;
+    line_t *l = vector_get (&rite.page->lines, row);
+
+    if (l == NULL || !select_range (&r0, &c0, &r1, &c1) || row < r0
+        || row > r1)
+        return false;
+
+    *from = (row == r0 ? c0 : 0);
+    *to = (row == r1 ? c1 : LINE_LEN (l));
+    return *to > *from;
+}
+
+/* a motion key extends the selection with shift held, and ends it without */
+void
+select_key (int key, bool shift)
+{
+    if (key != RITE_KEY_UP && key != RITE_KEY_DOWN && key != RITE_KEY_LEFT
+        && key != RITE_KEY_RIGHT && key != RITE_KEY_HOME
+        && key != RITE_KEY_END)
+        return;
+
+    if (shift && !rite.selecting)
+        {
+            rite.selecting = true;
+            rite.anchor.row = rite.row, rite.anchor.col = rite.col;
+        }
+    else if (!shift)
+        rite.selecting = false;
+}
+
+/* erases the selection, if there is one */
+bool
+select_erase ()
+{
+    int r0, c0, r1, c1;
+
+    if (!select_range (&r0, &c0, &r1, &c1))
+        return false;
+
+    clip_delete (r0, c0, r1, c1);
+    rite.selecting = false;
+    return true;
+}
+
+/* an edit in the page being edited moves the anchor with its line, and
+ * ends the selection if it reaches the anchor's line */
+void
+select_edit (int row, int nold, int nnew)
+{
+    if (!rite.selecting || rite.anchor.row < row)
+        return;
+
+    if (rite.anchor.row >= row + nold)
+        rite.anchor.row += nnew - nold;
+    else
+        rite.selecting = false;
+}
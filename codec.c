@@ -0,0 +1,307 @@
+#define _DEFAULT_SOURCE
+
+#include "rite.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define CODEC_MAGIC 8
+#define CODEC_CHUNK 0x100000
+
+/* compressed files, read and written through the programs of their
+ * format. a file is told by the bytes it starts with, or one not there
+ * yet by its name, and the page remembers its format to be saved in it.
+ *
+ * reading runs the decompressor into a pipe that is streamed in like
+ * stdin: every burst of output goes straight to page_ingest, so the
+ * first screen shows while the rest is still coming and the file never
+ * sits whole in memory, compressed or not.
+ *
+ * saving copies the text once, which takes a fraction of what
+ * compressing it does, and a worker thread writes the copy through the
+ * compressor. edits go on meanwhile, and when it is done the event loop
+ * hears of it on a pipe. only one save runs at a time. the compressor
+ * writes a new file next to the old one, which takes the old one's place
+ * only once all of it is written, so a save that fails halfway leaves the
+ * file as it was */
+
+codec_t codecs[] = {
+    { "gzip", ".gz", "\x1f\x8b", 2, { "gzip", "-dc", NULL },
+      { "gzip", "-c", NULL } },
+    { "zstd", ".zst", "\x28\xb5\x2f\xfd", 4, { "zstd", "-dcq", NULL },
+      { "zstd", "-cq", "-T0", NULL } },
+    { "xz", ".xz", "\xfd" "7zXZ\0", 6, { "xz", "-dc", NULL },
+      { "xz", "-c", "-T0", NULL } },
+    { NULL },
+};
+
+/* the format of file f, or if it is NULL, the one name ends in */
+codec_t *
+codec_detect (void *f, char *name)
+{
+    char magic[CODEC_MAGIC], *dot = strrchr (name, '.');
+    codec_t *c;
+    int len;
+
+    if (f == NULL)
+        {
+            for (c = codecs; c->name != NULL && dot != NULL; ++c)
+                if (strcmp (dot, c->suffix) == 0)
+                    return c;
+            return NULL;
+        }
+
+    len = fread (magic, 1, CODEC_MAGIC, f);
+    fseek (f, 0, SEEK_SET);
+    for (c = codecs; c->name != NULL; ++c)
+        if (len >= c->len && memcmp (magic, c->magic, c->len) == 0)
+            return c;
+    return NULL;
+}
+
+/* runs argv with in and out as its stdin and stdout. returns its pid, or
+ * -1 if it could not be started */
+int
+codec_spawn (char **argv, int in, int out)
+{
+    int pid, fd;
+
+    if ((pid = fork ()) != 0)
+        return pid;
+
+    signal (SIGPIPE, SIG_DFL);
+    dup2 (in, STDIN_FILENO);
+    dup2 (out, STDOUT_FILENO);
+    if ((fd = open ("/dev/null", O_WRONLY)) >= 0)
+        dup2 (fd, STDERR_FILENO);
+    execvp (argv[0], argv);
+    _exit (127);
+}
+
+/* streams the decompressed file into the page */
+int
+codec_open (page_t *page)
+{
+    codec_t *codec = page->codec;
+    int fd, out[2], pid;
+
+    if ((fd = open (page->name, O_RDONLY)) < 0)
+        return -1;
+    if (pipe (out))
+        {
+            close (fd);
+            return -1;
+        }
+
+    fcntl (fd, F_SETFD, FD_CLOEXEC);
+    fcntl (out[0], F_SETFD, FD_CLOEXEC);
+    fcntl (out[1], F_SETFD, FD_CLOEXEC);
+    pid = codec_spawn (codec->unpack, fd, out[1]);
+    close (fd), close (out[1]);
+
+    if (pid < 0 || page_stream (page, out[0]))
+        {
+            close (out[0]);
+            if (pid > 0)
+                waitpid (pid, NULL, 0);
+            return -1;
+        }
+    page->pid = pid;
+    page->codec = codec;
+    return 0;
+}
+
+/* waits for the decompressor of a page once its output is closed, which
+ * ends it if it was not done */
+void
+codec_reap (page_t *page)
+{
+    int st;
+
+    if (page->pid <= 0)
+        return;
+    if (waitpid (page->pid, &st, 0) == page->pid && WIFEXITED (st)
+        && WEXITSTATUS (st) != 0)
+        status ("could not decompress all of it");
+    page->pid = 0;
+}
+
+/* writes the copy through the compressor, and tells the event loop */
+void *
+codec_worker (void *data)
+{
+    codecsave_t *s = data;
+    long at = 0, n;
+    int st;
+
+    while (at < s->len)
+        if ((n = write (s->in, s->text + at, MIN (s->len - at, CODEC_CHUNK)))
+            > 0)
+            at += n;
+        else if (n < 0 && errno == EINTR)
+            continue;
+        else
+            {
+                s->failed = true;
+                break;
+            }
+
+    close (s->in);
+    if (s->pid < 0 || waitpid (s->pid, &st, 0) != s->pid || !WIFEXITED (st)
+        || WEXITSTATUS (st) != 0)
+        s->failed = true;
+    while (write (s->done[1], "", 1) < 0 && errno == EINTR)
+        ;
+    return NULL;
+}
+
+/* opens a new file beside name for a save to go to, with the mode name
+ * has, or would get, into *tmp. returns its fd, or -1 */
+int
+codec_temp (char *name, char **tmp)
+{
+    struct stat st;
+    mode_t mask;
+    int fd;
+
+    if ((*tmp = malloc (strlen (name) + 8)) == NULL)
+        return -1;
+    sprintf (*tmp, "%s.XXXXXX", name);
+    if ((fd = mkstemp (*tmp)) < 0)
+        {
+            free (*tmp);
+            return -1;
+        }
+
+    if (stat (name, &st) == 0)
+        fchmod (fd, st.st_mode & 07777);
+    else
+        {
+            umask (mask = umask (0));
+            fchmod (fd, 0666 & ~mask);
+        }
+    return fd;
+}
+
+/* lets go of the copy and the new file of a save that did not make it */
+void
+codec_drop (codecsave_t *s)
+{
+    free (s->text);
+    unlink (s->tmp);
+    free (s->tmp);
+}
+
+/* saves the page in its format, in the background */
+int
+codec_save (page_t *page)
+{
+    codecsave_t *s = &rite.save;
+    int i, out, in[2];
+    pthread_t thread;
+    line_t *l;
+    char *at;
+
+    if (s->page != NULL)
+        {
+            status ("still saving");
+            return -1;
+        }
+
+    for (s->len = 0, i = 0; i < page->lines.len; ++i)
+        s->len += LINE_LEN ((line_t *)vector_get (&page->lines, i)) + 1;
+    if ((s->text = malloc (MAX (s->len, 1))) == NULL)
+        return -1;
+    for (at = s->text, i = 0; i < page->lines.len; ++i)
+        {
+            l = vector_get (&page->lines, i);
+            memcpy (at, LINE_TEXT (l), LINE_LEN (l));
+            at += LINE_LEN (l);
+            *at++ = '\n';
+        }
+
+    if ((out = codec_temp (page->name, &s->tmp)) < 0)
+        {
+            free (s->text);
+            return -1;
+        }
+    if (pipe (in))
+        {
+            codec_drop (s);
+            close (out);
+            return -1;
+        }
+    if (pipe (s->done))
+        {
+            codec_drop (s);
+            close (out), close (in[0]), close (in[1]);
+            return -1;
+        }
+
+    fcntl (out, F_SETFD, FD_CLOEXEC);
+    fcntl (in[0], F_SETFD, FD_CLOEXEC);
+    fcntl (in[1], F_SETFD, FD_CLOEXEC);
+    fcntl (s->done[0], F_SETFD, FD_CLOEXEC);
+    fcntl (s->done[1], F_SETFD, FD_CLOEXEC);
+    s->pid = codec_spawn (page->codec->pack, in[0], out);
+    close (in[0]), close (out);
+    s->in = in[1];
+    s->failed = (s->pid < 0);
+
+    s->page = page;
+    watch (s->done[0], codec_saved, NULL);
+    if (pthread_create (&thread, NULL, codec_worker, s) == 0)
+        pthread_detach (thread);
+    else
+        codec_worker (s);
+
+    page->dirty = false;
+    status ("saving");
+    return 0;
+}
+
+/* the worker is done with a save */
+bool
+codec_saved (int fd, void *data)
+{
+    codecsave_t *s = &rite.save;
+    char c;
+
+    if (read (fd, &c, 1) < 0 && errno == EINTR)
+        return false;
+
+    unwatch (fd);
+    close (s->done[0]), close (s->done[1]);
+    if (!s->failed && rename (s->tmp, s->page->name) < 0)
+        s->failed = true;
+    if (s->failed)
+        {
+            codec_drop (s);
+            s->page->dirty = true;
+            status ("could not save");
+        }
+    else
+        {
+            free (s->text);
+            free (s->tmp);
+            status ("saved");
+        }
+    s->page = NULL;
+    return true;
+}
+
+/* waits for a save under way to finish */
+void
+codec_wait ()
+{
+    while (rite.save.page != NULL)
+        codec_saved (rite.save.done[0], NULL);
+}
@@ -0,0 +1,463 @@
+#define _DEFAULT_SOURCE
+
+#include "rite.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define CTL_CHUNK 0x10000
+#define CTL_BURST 0x10
+#define CTL_MAX 0x4000000
+#define CTL_WAIT 1000
+
+#define CLIENT(i) (*(ctlclient_t **)vector_get (&rite.ctl.clients, (i)))
+
+/* the control socket, for other programs to drive rite with. "rite -s
+ * path" listens on a unix socket at path, and every client connected to
+ * it is watched by the event loop like any other fd.
+ *
+ * a message is a 4 byte length, then that many bytes: an op and its
+ * arguments, numbers being 4 bytes and big endian. every message gets a
+ * reply in the same framing, a status byte then what the op gives back,
+ * or why it failed:
+ *
+ *   'o' name                       open the file, giving its page number
+ *   'j' row col                    move the cursor
+ *   'e' n, n * (row nold len text) replace lines, giving the line count
+ *   'r' row n                      give the text of n lines from row
+ *   's'                            give the page, lines, row and col
+ *
+ * the new lines of an edit are its text cut at newlines. the edits of
+ * one message are checked against the line counts the ones before leave
+ * first, and then all made as one undo record, or none of them is.
+ * whatever a read brings in is acted on before the screen is drawn once,
+ * so a client sending ahead of the replies costs one frame per read */
+
+/* whether path is free to bind, taking away a socket that no one is
+ * listening on any more. anything else there, a file or a socket in use,
+ * is left alone */
+bool
+ctl_free (char *path)
+{
+    struct sockaddr_un addr;
+    struct stat st;
+    int fd, taken;
+
+    if (lstat (path, &st) < 0)
+        return errno == ENOENT;
+    if (!S_ISSOCK (st.st_mode)
+        || (fd = socket (AF_UNIX, SOCK_STREAM, 0)) < 0)
+        return false;
+
+    memset (&addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+    strcpy (addr.sun_path, path);
+    taken = connect (fd, (struct sockaddr *)&addr, sizeof (addr)) == 0
+            || errno != ECONNREFUSED;
+    close (fd);
+    return !taken && unlink (path) == 0;
+}
+
+void
+ctl_listen (char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    vector_init (&rite.ctl.clients, sizeof (ctlclient_t *), 0x4);
+    rite.ctl.fd = -1;
+    if (strlen (path) >= sizeof (addr.sun_path))
+        {
+            status ("socket path too long");
+            return;
+        }
+
+    memset (&addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+    strcpy (addr.sun_path, path);
+    if (!ctl_free (path))
+        {
+            status ("socket path in use");
+            return;
+        }
+    if ((fd = socket (AF_UNIX, SOCK_STREAM, 0)) < 0)
+        return;
+    if (bind (fd, (struct sockaddr *)&addr, sizeof (addr)) < 0
+        || listen (fd, 8) < 0
+        || fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK) < 0
+        || watch (fd, ctl_accept, NULL))
+        {
+            close (fd);
+            status ("no control socket");
+            return;
+        }
+
+    rite.ctl.fd = fd;
+    rite.ctl.path = malloc (strlen (path) + 1);
+    strcpy (rite.ctl.path, path);
+}
+
+void
+ctl_close ()
+{
+    while (rite.ctl.clients.len > 0)
+        ctl_drop (CLIENT (0));
+    vector_deinit (&rite.ctl.clients);
+
+    if (rite.ctl.fd < 0)
+        return;
+    unwatch (rite.ctl.fd);
+    close (rite.ctl.fd);
+    unlink (rite.ctl.path);
+    free (rite.ctl.path);
+    rite.ctl.fd = -1;
+}
+
+bool
+ctl_accept (int fd, void *data)
+{
+    ctlclient_t *c;
+    int cfd;
+
+    while ((cfd = accept (fd, NULL, NULL)) >= 0)
+        {
+            if ((c = malloc (sizeof (ctlclient_t))) == NULL
+                || fcntl (cfd, F_SETFL, fcntl (cfd, F_GETFL) | O_NONBLOCK) < 0
+                || watch (cfd, ctl_pull, c))
+                {
+                    free (c);
+                    close (cfd);
+                    continue;
+                }
+            c->fd = cfd;
+            vector_init (&c->in, sizeof (char), CTL_CHUNK);
+            vector_init (&c->out, sizeof (char), CTL_CHUNK);
+            *(ctlclient_t **)vector_append (&rite.ctl.clients) = c;
+        }
+    return false;
+}
+
+void
+ctl_drop (ctlclient_t *c)
+{
+    int i;
+
+    for (i = 0; i < rite.ctl.clients.len; ++i)
+        if (CLIENT (i) == c)
+            vector_remove (&rite.ctl.clients, i);
+    unwatch (c->fd);
+    close (c->fd);
+    vector_deinit (&c->in);
+    vector_deinit (&c->out);
+    free (c);
+}
+
+uint32_t
+ctl_u32 (uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8
+           | p[3];
+}
+
+void
+ctl_put (vector_t *out, uint32_t n)
+{
+    uint8_t *p;
+
+    out->len += 4;
+    vector_resize (out);
+    p = (uint8_t *)out->data + out->len - 4;
+    p[0] = n >> 24, p[1] = n >> 16, p[2] = n >> 8, p[3] = n;
+}
+
+/* starts a reply, to be finished by ctl_end once its payload is in */
+int
+ctl_begin (ctlclient_t *c, bool failed)
+{
+    int at = c->out.len;
+
+    ctl_put (&c->out, 0);
+    *(char *)vector_append (&c->out) = failed;
+    return at;
+}
+
+void
+ctl_end (ctlclient_t *c, int at)
+{
+    uint8_t *p = vector_get (&c->out, at);
+    uint32_t n = c->out.len - at - 4;
+
+    p[0] = n >> 24, p[1] = n >> 16, p[2] = n >> 8, p[3] = n;
+}
+
+void
+ctl_text (ctlclient_t *c, char *s, int len)
+{
+    if (len <= 0)
+        return;
+    c->out.len += len;
+    vector_resize (&c->out);
+    memcpy ((char *)c->out.data + c->out.len - len, s, len);
+}
+
+int
+ctl_fail (ctlclient_t *c, char *why)
+{
+    int at = ctl_begin (c, true);
+
+    ctl_text (c, why, strlen (why));
+    ctl_end (c, at);
+    return -1;
+}
+
+/* switches to the page of a file, opening it if it is not open yet */
+int
+ctl_open (ctlclient_t *c, char *name, int len)
+{
+    page_t *page;
+    char *copy;
+    int i, at;
+
+    for (i = 0; i < rite.pages.len; ++i)
+        if ((page = *(page_t **)vector_get (&rite.pages, i))->name != NULL
+            && strlen (page->name) == len
+            && memcmp (page->name, name, len) == 0)
+            break;
+
+    if (i == rite.pages.len)
+        {
+            if (len == 0 || memchr (name, '\0', len) != NULL)
+                return ctl_fail (c, "bad name");
+            copy = malloc (len + 1);
+            memcpy (copy, name, len);
+            copy[len] = '\0';
+            pages_add (copy);
+            free (copy);
+        }
+
+    view_save ();
+    multi_clear ();
+    pages_switch (i);
+    at = ctl_begin (c, false);
+    ctl_put (&c->out, i);
+    ctl_end (c, at);
+    return 0;
+}
+
+/* checks that every edit of a batch fits the lines the edits before it
+ * leave, returning how many lines the page will then have or -1 */
+int
+ctl_check (uint8_t *p, uint8_t *end, int n, int lines)
+{
+    uint32_t row, nold, len, k;
+
+    for (; n > 0; --n)
+        {
+            if (end - p < 12)
+                return -1;
+            row = ctl_u32 (p), nold = ctl_u32 (p + 4), len = ctl_u32 (p + 8);
+            p += 12;
+            if (row > lines || nold > lines - row || len > end - p)
+                return -1;
+            for (k = 0; k < len; ++k)
+                if (p[k] == '\n')
+                    lines++;
+            if (len > 0 && p[len - 1] != '\n')
+                lines++;
+            lines -= nold;
+            p += len;
+        }
+    return p == end ? lines : -1;
+}
+
+/* makes one edit of a batch, returning past it */
+uint8_t *
+ctl_edit (page_t *page, uint8_t *p)
+{
+    uint32_t row = ctl_u32 (p), nold = ctl_u32 (p + 4), len = ctl_u32 (p + 8);
+    char *s = (char *)p + 12, *end = s + len, *nl;
+    vector_t lines;
+    line_t *l;
+
+    vector_init (&lines, sizeof (line_t), 0x10);
+    for (; s < end; s = nl + 1)
+        {
+            if ((nl = memchr (s, '\n', end - s)) == NULL)
+                nl = end;
+            line_init (l = vector_append (&lines));
+            line_extend (l, s, nl - s);
+        }
+    page_splice (page, row, nold, lines.data, lines.len);
+
+    /* the cursor stays with the lines it was on */
+    if (page == rite.page && rite.row >= row + nold)
+        rite.row += lines.len - nold;
+    vector_deinit (&lines);
+    return (uint8_t *)end;
+}
+
+int
+ctl_edits (ctlclient_t *c, uint8_t *p, uint8_t *end)
+{
+    page_t *page = rite.page;
+    int n, lines, at;
+
+    if (end - p < 4 || multi_active ())
+        return ctl_fail (c, multi_active () ? "busy" : "bad edits");
+    n = ctl_u32 (p);
+    if ((lines = ctl_check (p + 4, end, n, page->lines.len)) < 0)
+        return ctl_fail (c, "bad edits");
+
+    undo_begin (page);
+    for (p += 4; n > 0; --n)
+        p = ctl_edit (page, p);
+    undo_end (page);
+    move_row (rite.row);
+
+    at = ctl_begin (c, false);
+    ctl_put (&c->out, lines);
+    ctl_end (c, at);
+    return 0;
+}
+
+int
+ctl_read (ctlclient_t *c, int row, int n)
+{
+    int at = ctl_begin (c, false), i;
+    line_t *l;
+
+    for (i = MAX (row, 0); i < rite.page->lines.len && i - row < n; ++i)
+        {
+            l = vector_get (&rite.page->lines, i);
+            ctl_text (c, LINE_TEXT (l), LINE_LEN (l));
+            *(char *)vector_append (&c->out) = '\n';
+        }
+    ctl_end (c, at);
+    return 0;
+}
+
+/* acts on one message, a reply going out for it */
+int
+ctl_do (ctlclient_t *c, uint8_t *p, int len)
+{
+    uint8_t *end = p + len;
+    int at;
+
+    if (len == 0)
+        return ctl_fail (c, "empty");
+
+    switch (*p++)
+        {
+        case 'o':
+            return ctl_open (c, (char *)p, end - p);
+
+        case 'j':
+            if (end - p != 8)
+                break;
+            multi_clear ();
+            rite.row = ctl_u32 (p), rite.col = ctl_u32 (p + 4);
+            rite.want = -1;
+            move_row (rite.row), move_col (rite.col);
+            ctl_end (c, ctl_begin (c, false));
+            return 0;
+
+        case 'e':
+            return ctl_edits (c, p, end);
+
+        case 'r':
+            if (end - p != 8)
+                break;
+            return ctl_read (c, ctl_u32 (p), ctl_u32 (p + 4));
+
+        case 's':
+            at = ctl_begin (c, false);
+            ctl_put (&c->out, rite.current);
+            ctl_put (&c->out, rite.page->lines.len);
+            ctl_put (&c->out, rite.row);
+            ctl_put (&c->out, rite.col);
+            ctl_end (c, at);
+            return 0;
+        }
+    return ctl_fail (c, "bad message");
+}
+
+/* sends the replies waiting, waiting a little for a client slow to take
+ * them before giving up on it. a client gone away is an error here, not
+ * a signal */
+int
+ctl_flush (ctlclient_t *c)
+{
+    struct pollfd pfd;
+    int done = 0, n;
+
+    pfd.fd = c->fd, pfd.events = POLLOUT;
+    while (done < c->out.len)
+        if ((n = send (c->fd, (char *)c->out.data + done, c->out.len - done,
+                       MSG_NOSIGNAL))
+            > 0)
+            done += n;
+        else if (n < 0 && errno == EINTR)
+            continue;
+        else if (n < 0 && errno == EAGAIN && poll (&pfd, 1, CTL_WAIT) > 0)
+            continue;
+        else
+            return -1;
+
+    c->out.len = 0;
+    vector_resize (&c->out);
+    return 0;
+}
+
+/* reads what a client sent, a bounded burst at a time, and acts on every
+ * whole message in it */
+bool
+ctl_pull (int fd, void *data)
+{
+    ctlclient_t *c = data;
+    int i, n = 0, at = 0;
+    uint32_t len;
+    uint8_t *p;
+
+    for (i = 0; i < CTL_BURST; ++i)
+        {
+            c->in.len += CTL_CHUNK;
+            vector_resize (&c->in);
+            c->in.len -= CTL_CHUNK;
+            n = read (fd, (char *)c->in.data + c->in.len, CTL_CHUNK);
+            if (n <= 0)
+                break;
+            c->in.len += n;
+        }
+    if (i == 0 && (n == 0 || errno != EAGAIN))
+        {
+            ctl_drop (c);
+            return false;
+        }
+
+    while (c->in.len - at >= 4)
+        {
+            p = (uint8_t *)c->in.data + at;
+            if ((len = ctl_u32 (p)) > CTL_MAX)
+                {
+                    ctl_drop (c);
+                    return true;
+                }
+            if (c->in.len - at - 4 < len)
+                break;
+            ctl_do (c, p + 4, len);
+            at += 4 + len;
+        }
+
+    vector_splice (&c->in, 0, at, 0);
+    if (ctl_flush (c))
+        ctl_drop (c);
+    return at > 0;
+}
@@ -0,0 +1,319 @@
+#include "rite.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DICT_FRESH 0x1000
+#define DICT_SLICE 0x40000
+
+#define SORTED(i) (((dictword_t **)rite.dict.sorted.data)[i])
+#define FRESH(i) (((dictword_t **)rite.dict.fresh.data)[i])
+
+/* word completion from the words of every open page. the index is a hash
+ * table of the words and how often each occurs, with a sorted list of
+ * them for prefix lookups. the words of the lines before page->counted
+ * are in it, and idle counts in the rest a slice at a time.
+ *
+ * an edit counts the words of the lines it replaces out, and those of the
+ * new lines back in. a word that is in both, like most of a line typed
+ * into, only has its count go down and up again, so the lists change only
+ * for words new to the table. those wait in a short unsorted list, merged
+ * into the sorted one when it grows too long to look through, and words
+ * counted down to nothing stay until that merge drops them */
+
+void
+dict_init ()
+{
+    table_init (&rite.dict.words, sizeof (dictword_t *), 0x400, dict_item,
+                dict_same);
+    vector_init (&rite.dict.sorted, sizeof (dictword_t *), 0x1000);
+    vector_init (&rite.dict.fresh, sizeof (dictword_t *), 0x1000);
+}
+
+/* the hash of a word, for the table */
+unsigned long
+dict_item (void *item)
+{
+    return (*(dictword_t **)item)->hash;
+}
+
+/* whether a word is the one key looks for */
+bool
+dict_same (void *item, void *key)
+{
+    dictword_t *w = *(dictword_t **)item;
+    dictkey_t *k = key;
+
+    return w->hash == k->hash && w->len == k->len
+           && memcmp (w->s, k->s, k->len) == 0;
+}
+
+/* the slot of a word in the table, or the empty one it would go in */
+dictword_t **
+dict_slot (char *s, int len, unsigned long hash)
+{
+    dictkey_t key;
+
+    key.s = s, key.len = len, key.hash = hash;
+    return table_slot (&rite.dict.words, hash, &key);
+}
+
+/* adds d to how often a word occurs, listing it if it is new */
+void
+dict_count (char *s, int len, int d)
+{
+    unsigned long hash = diff_hash (s, len);
+    dictword_t **slot, *w;
+
+    table_room (&rite.dict.words);
+
+    if (*(slot = dict_slot (s, len, hash)) != NULL)
+        {
+            (*slot)->count += d;
+            return;
+        }
+    if (d <= 0 || (w = malloc (sizeof (dictword_t) + len)) == NULL)
+        return;
+
+    w->hash = hash, w->count = d, w->len = len;
+    memcpy (w->s, s, len);
+    w->s[len] = '\0';
+    *slot = w;
+    rite.dict.words.n++;
+    *(dictword_t **)vector_append (&rite.dict.fresh) = w;
+}
+
+/* counts the words of a line d times, numbers aside. returns how many
+ * words it has the way wc counts them, as runs of anything but space */
+int
+dict_line (line_t *l, int d)
+{
+    char *s = LINE_TEXT (l);
+    int i, n, cls, len = LINE_LEN (l), words = 0;
+
+    for (i = 0; i < len; i += n)
+        {
+            cls = word_class[(uint8_t)s[i]];
+            n = word_run (s + i, len - i, cls);
+            if (cls != WORD_SPACE
+                && (i == 0 || word_class[(uint8_t)s[i - 1]] == WORD_SPACE))
+                words++;
+            if (cls == WORD_WORD && n > 1 && n <= DICT_LONG
+                && (s[i] < '0' || s[i] > '9'))
+                dict_count (s + i, n, d);
+        }
+    return words;
+}
+
+/* lines [row, row + n) of a page are about to go */
+void
+dict_take (page_t *page, int row, int n)
+{
+    int i;
+
+    for (i = row; i < MIN (row + n, page->counted); ++i)
+        page->stats.words -= dict_line (vector_get (&page->lines, i), -1);
+}
+
+/* lines [row, row + nold) of a page became nnew lines. an edit reaching
+ * past the lines counted leaves the new ones to idle */
+void
+dict_edit (page_t *page, int row, int nold, int nnew)
+{
+    int i;
+
+    if (row >= page->counted)
+        return;
+    if (row + nold > page->counted)
+        {
+            page->counted = row;
+            return;
+        }
+
+    for (i = row; i < row + nnew; ++i)
+        page->stats.words += dict_line (vector_get (&page->lines, i), 1);
+    page->counted += nnew - nold;
+}
+
+/* the first open page with lines not yet counted, or NULL */
+page_t *
+dict_pending ()
+{
+    page_t *page;
+    int i;
+
+    for (i = 0; i < rite.pages.len; ++i)
+        {
+            page = *(page_t **)vector_get (&rite.pages, i);
+            if (page->counted < page->lines.len)
+                return page;
+        }
+    return NULL;
+}
+
+bool
+dict_done ()
+{
+    return dict_pending () == NULL && rite.dict.fresh.len <= DICT_FRESH;
+}
+
+/* counts in the next slice of lines of a page not yet done, and once they
+ * are all done, sorts in the words new to the index if there are many */
+void
+dict_scan ()
+{
+    page_t *page = dict_pending ();
+    long budget = DICT_SLICE;
+    line_t *l;
+
+    if (page == NULL)
+        {
+            if (rite.dict.fresh.len > DICT_FRESH)
+                dict_merge ();
+            return;
+        }
+
+    while (budget > 0 && page->counted < page->lines.len)
+        {
+            l = vector_get (&page->lines, page->counted++);
+            page->stats.words += dict_line (l, 1);
+            budget -= LINE_LEN (l) + 1;
+        }
+}
+
+int
+dict_cmp (const void *a, const void *b)
+{
+    dictword_t *const *x = a, *const *y = b;
+    return strcmp ((*x)->s, (*y)->s);
+}
+
+/* sorts the fresh words into the sorted ones, dropping the words that no
+ * longer occur anywhere */
+void
+dict_merge ()
+{
+    dict_t *d = &rite.dict;
+    int i = 0, j = 0, n = 0;
+    dictword_t *w;
+    vector_t out;
+
+    qsort (d->fresh.data, d->fresh.len, sizeof (dictword_t *), dict_cmp);
+
+    vector_init (&out, sizeof (dictword_t *), 0x1000);
+    if ((out.len = d->sorted.len + d->fresh.len) > 0)
+        vector_resize (&out);
+    while (i < d->sorted.len || j < d->fresh.len)
+        {
+            if (j == d->fresh.len
+                || (i < d->sorted.len
+                    && strcmp (SORTED (i)->s, FRESH (j)->s) < 0))
+                w = SORTED (i++);
+            else
+                w = FRESH (j++);
+
+            if (w->count > 0)
+                *(dictword_t **)vector_get (&out, n++) = w;
+            else
+                {
+                    table_remove (&rite.dict.words,
+                                  dict_slot (w->s, w->len, w->hash));
+                    free (w);
+                }
+        }
+
+    out.len = n;
+    vector_resize (&out);
+    vector_deinit (&d->sorted);
+    vector_deinit (&d->fresh);
+    d->sorted = out;
+    vector_init (&d->fresh, sizeof (dictword_t *), 0x1000);
+}
+
+/* the first word after the one given that starts with prefix, or NULL */
+dictword_t *
+dict_find (char *prefix, int plen, char *after)
+{
+    dict_t *d = &rite.dict;
+    int lo = 0, hi = d->sorted.len, mid, i;
+    dictword_t *w, *best = NULL;
+
+    while (lo < hi)
+        {
+            mid = (lo + hi) / 2;
+            if (strcmp (SORTED (mid)->s, after) <= 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+    for (i = lo; i < d->sorted.len; ++i)
+        if (strncmp ((w = SORTED (i))->s, prefix, plen) != 0)
+            break;
+        else if (w->count > 0)
+            {
+                best = w;
+                break;
+            }
+
+    for (i = 0; i < d->fresh.len; ++i)
+        if ((w = FRESH (i))->count > 0 && strncmp (w->s, prefix, plen) == 0
+            && strcmp (w->s, after) > 0
+            && (best == NULL || strcmp (w->s, best->s) < 0))
+            best = w;
+    return best;
+}
+
+/* completes the word before the cursor. done again right after, it puts
+ * the next word in its place, and back to what was typed after the last */
+void
+dict_complete ()
+{
+    dict_t *d = &rite.dict;
+    line_t *l = vector_get (&rite.page->lines, rite.row), nl;
+    int wlen = strlen (d->word), tlen;
+    dictword_t *w;
+    char *s, *to;
+
+    if (l == NULL || multi_active ())
+        {
+            status ("nothing to complete");
+            return;
+        }
+
+    s = LINE_TEXT (l);
+    if (d->plen == 0 || d->row != rite.row || d->col + wlen != rite.col
+        || memcmp (s + d->col, d->word, wlen) != 0)
+        {
+            d->plen = word_run_back (s, rite.col, WORD_WORD);
+            if (d->plen == 0 || d->plen > DICT_LONG)
+                {
+                    d->plen = 0;
+                    status ("nothing to complete");
+                    return;
+                }
+            d->row = rite.row, d->col = rite.col - d->plen;
+            memcpy (d->prefix, s + d->col, d->plen);
+            d->prefix[d->plen] = '\0';
+            strcpy (d->word, d->prefix);
+            wlen = d->plen;
+        }
+
+    while (!dict_done ())
+        dict_scan ();
+    w = dict_find (d->prefix, d->plen, d->word);
+    to = (w != NULL ? w->s : d->prefix);
+    tlen = strlen (to);
+
+    line_init (&nl);
+    line_extend (&nl, s, d->col);
+    line_extend (&nl, to, tlen);
+    line_extend (&nl, s + d->col + wlen, LINE_LEN (l) - d->col - wlen);
+    strcpy (d->word, to);
+    page_splice (rite.page, rite.row, 1, &nl, 1);
+
+    rite.col = d->col + tlen;
+    rite.want = -1;
+    if (w == NULL)
+        status ("no more words");
+}
@@ -0,0 +1,441 @@
+#include "rite.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DIFF_BUDGET 0x4000000
+
+#define HUNK(df, i) ((diffhunk_t *)vector_get (&(df)->hunks, (i)))
+#define DISK(df, i) (*(unsigned long *)vector_get (&(df)->disk, (i)))
+
+/* the page against the file on disk. both sides are compared as line
+ * hashes, and the result is a sorted list of hunks with equal lines
+ * between them, which the gutter marks are looked up in.
+ *
+ * an edit does not compare anything: it shifts the hunks below it and
+ * merges itself and the hunks it touches into one dirty hunk, the lines
+ * between two that are known to match. idle compares dirty hunks one at a
+ * time, trimming the lines they start and end with in common and cutting
+ * the rest in two at the middle of a shortest edit script (myers, in
+ * linear space) until nothing is left. the hashes of edited lines are
+ * only taken when a comparison needs them, so typing into a huge page
+ * costs a small comparison around the line typed into */
+
+unsigned long
+diff_hash (char *s, int len)
+{
+    unsigned long h = 14695981039346656037UL;
+
+    while (len-- > 0)
+        h = (h ^ (uint8_t)*s++) * 1099511628211UL;
+    return h == 0 ? 1 : h;
+}
+
+/* the hash of a line of the page, taken the first time it is needed */
+unsigned long
+diff_line (page_t *page, int row)
+{
+    unsigned long *h = vector_get (&page->diff->lines, row);
+    line_t *l;
+
+    if (*h == 0)
+        {
+            l = vector_get (&page->lines, row);
+            *h = diff_hash (LINE_TEXT (l), LINE_LEN (l));
+        }
+    return *h;
+}
+
+bool
+diff_same (page_t *page, int row, int disk)
+{
+    return diff_line (page, row) == DISK (page->diff, disk);
+}
+
+void
+diff_stop (page_t *page)
+{
+    diff_t *df = page->diff;
+
+    if (df == NULL)
+        return;
+
+    vector_deinit (&df->disk);
+    vector_deinit (&df->lines);
+    vector_deinit (&df->hunks);
+    vector_deinit (&df->scratch);
+    free (df);
+    page->diff = NULL;
+}
+
+/* reads the file the page was read from, leaving the whole page to be
+ * compared with it */
+bool
+diff_start (page_t *page)
+{
+    char *text, *at, *end, *nl;
+    diffhunk_t *h;
+    diff_t *df;
+    long len;
+    FILE *f;
+
+    if (page->name == NULL || page->codec != NULL
+        || (f = fopen (page->name, "r")) == NULL)
+        return false;
+
+    fseek (f, 0, SEEK_END);
+    len = ftell (f);
+    fseek (f, 0, SEEK_SET);
+    if (len < 0 || (text = malloc (len + 1)) == NULL)
+        {
+            fclose (f);
+            return false;
+        }
+    len = fread (text, 1, len, f);
+    fclose (f);
+
+    diff_stop (page);
+    df = page->diff = malloc (sizeof (diff_t));
+    memset (df, 0, sizeof (diff_t));
+    vector_init (&df->disk, sizeof (unsigned long), 0x1000);
+    vector_init (&df->lines, sizeof (unsigned long), 0x1000);
+    vector_init (&df->hunks, sizeof (diffhunk_t), 0x10);
+    vector_init (&df->scratch, sizeof (int), 0x1000);
+
+    /* split the way page_ingest does */
+    for (at = text, end = text + len; at < end; at = nl + 1)
+        {
+            if ((nl = memchr (at, '\n', end - at)) == NULL)
+                nl = end;
+            *(unsigned long *)vector_append (&df->disk)
+                = diff_hash (at, nl - at);
+        }
+    free (text);
+
+    if ((df->lines.len = page->lines.len) > 0)
+        {
+            vector_resize (&df->lines);
+            memset (df->lines.data, 0, df->lines.len * sizeof (unsigned long));
+        }
+
+    if (page->lines.len > 0 || df->disk.len > 0)
+        {
+            h = vector_append (&df->hunks);
+            h->a = 0, h->na = page->lines.len;
+            h->b = 0, h->nb = df->disk.len;
+            h->dirty = true;
+            df->dirty = 1;
+        }
+    return true;
+}
+
+/* the page was written out, so the file now has its lines */
+void
+diff_saved (page_t *page)
+{
+    diff_t *df = page->diff;
+    int i;
+
+    if (df == NULL)
+        return;
+
+    for (i = 0; i < page->lines.len; ++i)
+        diff_line (page, i);
+    vector_deinit (&df->disk);
+    vector_init (&df->disk, sizeof (unsigned long), 0x1000);
+    if ((df->disk.len = df->lines.len) > 0)
+        {
+            vector_resize (&df->disk);
+            memcpy (df->disk.data, df->lines.data,
+                    df->lines.len * sizeof (unsigned long));
+        }
+
+    df->hunks.len = df->dirty = 0;
+    vector_resize (&df->hunks);
+    views_touch (page, 0);
+}
+
+void
+diff_toggle ()
+{
+    if (rite.page->diff != NULL)
+        {
+            diff_stop (rite.page);
+            views_touch (rite.page, 0);
+            status ("diff off");
+        }
+    else if (!diff_start (rite.page))
+        status ("no file to compare with");
+    else
+        status ("diff against the file");
+}
+
+/* the first hunk ending at row or below it */
+int
+diff_find (diff_t *df, int row)
+{
+    int lo = 0, hi = df->hunks.len, mid;
+    diffhunk_t *h;
+
+    while (lo < hi)
+        {
+            mid = (lo + hi) / 2;
+            h = HUNK (df, mid);
+            if (h->a + h->na < row)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+    return lo;
+}
+
+/* how far the file's rows are from the page's after the i'th hunk */
+int
+diff_offset (diff_t *df, int i)
+{
+    diffhunk_t *h;
+
+    if (i < 0)
+        return 0;
+    h = HUNK (df, i);
+    return h->b + h->nb - h->a - h->na;
+}
+
+/* lines [row, row + nold) of the page became nnew lines */
+void
+diff_edit (page_t *page, int row, int nold, int nnew)
+{
+    diff_t *df = page->diff;
+    int i, j, k, lo = row, hi = row + nold, off, end, d = nnew - nold;
+    unsigned long *hashes;
+    diffhunk_t *h;
+
+    if (df == NULL)
+        return;
+
+    if ((hashes = vector_splice (&df->lines, row, nold, nnew)) != NULL)
+        memset (hashes, 0, nnew * sizeof (unsigned long));
+
+    /* the hunks from i to j touch the edit, and go into its hunk */
+    i = diff_find (df, row);
+    for (j = i; j < df->hunks.len && HUNK (df, j)->a <= row + nold; ++j)
+        df->dirty -= HUNK (df, j)->dirty;
+    off = diff_offset (df, i - 1);
+    if (j > i)
+        {
+            h = HUNK (df, j - 1);
+            lo = MIN (lo, HUNK (df, i)->a);
+            hi = MAX (hi, h->a + h->na);
+        }
+    end = hi + diff_offset (df, j > i ? j - 1 : i - 1);
+
+    h = vector_splice (&df->hunks, i, j - i, 1);
+    h->a = lo, h->na = hi + d - lo;
+    h->b = lo + off, h->nb = end - h->b;
+    h->dirty = true;
+    df->dirty++;
+
+    for (k = i + 1; k < df->hunks.len; ++k)
+        HUNK (df, k)->a += d;
+}
+
+/* adds a hunk to the ones found, joining it to the last if they meet */
+void
+diff_emit (vector_t *out, int a, int na, int b, int nb)
+{
+    diffhunk_t *h = vector_tail (out);
+
+    if (h != NULL && h->a + h->na == a && h->b + h->nb == b)
+        {
+            h->na += na, h->nb += nb;
+            return;
+        }
+    h = vector_append (out);
+    h->a = a, h->na = na, h->b = b, h->nb = nb;
+    h->dirty = false;
+}
+
+/* finds where a shortest edit script of page lines [a0, a1) into file
+ * lines [b0, b1) is half done, going from both ends at once until the
+ * two meet, with a row of furthest reaches per direction. returns false
+ * if that takes more than the budget */
+bool
+diff_split (page_t *page, int a0, int a1, int b0, int b1, int *sx, int *sy)
+{
+    diff_t *df = page->diff;
+    int n = a1 - a0, m = b1 - b0, maxd = (n + m + 1) / 2, len = 2 * maxd + 2;
+    int delta = n - m, front = (delta % 2 != 0), d, k, at, x, y, x2;
+    int k1start = 0, k1end = 0, k2start = 0, k2end = 0, *v1, *v2;
+
+    df->scratch.len = 2 * len;
+    vector_resize (&df->scratch);
+    v1 = vector_head (&df->scratch), v2 = v1 + len;
+    for (k = 0; k < 2 * len; ++k)
+        v1[k] = -1;
+    v1[maxd + 1] = v2[maxd + 1] = 0;
+
+    for (d = 0; d < maxd; ++d)
+        {
+            if ((df->budget -= 2 * d + 1) < 0)
+                return false;
+
+            /* forward, from the start */
+            for (k = -d + k1start; k <= d - k1end; k += 2)
+                {
+                    at = maxd + k;
+                    if (k == -d || (k != d && v1[at - 1] < v1[at + 1]))
+                        x = v1[at + 1];
+                    else
+                        x = v1[at - 1] + 1;
+                    for (y = x - k;
+                         x < n && y < m && diff_same (page, a0 + x, b0 + y);
+                         ++x, ++y)
+                        df->budget--;
+                    v1[at] = x;
+
+                    if (x > n)
+                        k1end += 2;
+                    else if (y > m)
+                        k1start += 2;
+                    else if (front && (at = maxd + delta - k) >= 0
+                             && at < len && v2[at] != -1 && x >= n - v2[at])
+                        {
+                            *sx = a0 + x, *sy = b0 + y;
+                            return true;
+                        }
+                }
+
+            /* backward, from the end */
+            for (k = -d + k2start; k <= d - k2end; k += 2)
+                {
+                    at = maxd + k;
+                    if (k == -d || (k != d && v2[at - 1] < v2[at + 1]))
+                        x2 = v2[at + 1];
+                    else
+                        x2 = v2[at - 1] + 1;
+                    for (y = x2 - k; x2 < n && y < m
+                                     && diff_same (page, a1 - x2 - 1,
+                                                   b1 - y - 1);
+                         ++x2, ++y)
+                        df->budget--;
+                    v2[at] = x2;
+
+                    if (x2 > n)
+                        k2end += 2;
+                    else if (y > m)
+                        k2start += 2;
+                    else if (!front && (at = maxd + delta - k) >= 0
+                             && at < len && v1[at] != -1
+                             && v1[at] >= n - x2)
+                        {
+                            *sx = a0 + v1[at], *sy = b0 + v1[at] - (at - maxd);
+                            return true;
+                        }
+                }
+        }
+
+    return false;
+}
+
+/* compares page lines [a0, a1) with file lines [b0, b1), adding the hunks
+ * found to out in order */
+void
+diff_compare (page_t *page, vector_t *out, int a0, int a1, int b0, int b1)
+{
+    int x, y;
+
+    while (a0 < a1 && b0 < b1 && diff_same (page, a0, b0))
+        a0++, b0++;
+    while (a1 > a0 && b1 > b0 && diff_same (page, a1 - 1, b1 - 1))
+        a1--, b1--;
+
+    /* what is too costly to cut up is one hunk */
+    if (a0 == a1 || b0 == b1 || !diff_split (page, a0, a1, b0, b1, &x, &y)
+        || (x == a0 && y == b0) || (x == a1 && y == b1))
+        {
+            if (a0 < a1 || b0 < b1)
+                diff_emit (out, a0, a1 - a0, b0, b1 - b0);
+            return;
+        }
+
+    diff_compare (page, out, a0, x, b0, y);
+    diff_compare (page, out, x, a1, y, b1);
+}
+
+bool
+diff_done (page_t *page)
+{
+    return page->diff == NULL || page->diff->dirty == 0;
+}
+
+/* compares the next dirty hunk. returns true if a view of the page may
+ * show lines whose marks changed */
+bool
+diff_scan (page_t *page)
+{
+    diff_t *df = page->diff;
+    diffhunk_t h;
+    vector_t out;
+    int i;
+
+    if (diff_done (page))
+        return false;
+
+    for (i = 0; !HUNK (df, i)->dirty; ++i)
+        ;
+    h = *HUNK (df, i);
+
+    vector_init (&out, sizeof (diffhunk_t), 0x10);
+    df->budget = DIFF_BUDGET;
+    diff_compare (page, &out, h.a, h.a + h.na, h.b, h.b + h.nb);
+
+    vector_splice (&df->hunks, i, 1, out.len);
+    if (out.len > 0)
+        memcpy (vector_get (&df->hunks, i), out.data,
+                out.len * sizeof (diffhunk_t));
+    vector_deinit (&out);
+    df->dirty--;
+
+    /* the scratch rows can be as long as the page */
+    df->scratch.len = 0;
+    vector_resize (&df->scratch);
+    return views_touch (page, h.a);
+}
+
+/* the mark of a row: + for a line the file does not have, ~ for one that
+ * replaced some of the file's, - for one after lines the page lost */
+char
+diff_mark (page_t *page, int row)
+{
+    diff_t *df = page->diff;
+    int lo = 0, hi, mid;
+    diffhunk_t *h;
+
+    if (df == NULL)
+        return 0;
+
+    /* the first hunk ending after row, a lost run taking the row after */
+    for (hi = df->hunks.len; lo < hi;)
+        {
+            mid = (lo + hi) / 2;
+            h = HUNK (df, mid);
+            if (h->a + MAX (h->na, 1) <= row)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+    if (lo == df->hunks.len)
+        return 0;
+
+    /* lines lost from the end show on the last line */
+    h = HUNK (df, lo);
+    if (h->a > row)
+        return h->na == 0 && h->a == page->lines.len && row == h->a - 1
+                   ? '-'
+                   : 0;
+    if (h->na == 0)
+        return '-';
+    return h->nb == 0 && !h->dirty ? '+' : '~';
+}
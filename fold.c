@@ -0,0 +1,406 @@
+#include "rite.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define FOLD(page, i) ((fold_t *)vector_get (&(page)->folds, (i)))
+
+/* code folding. a fold hides the lines after its first one, which stays
+ * shown with a count of them. the folds of a page are disjoint and sorted,
+ * each knowing how many lines the ones above it hide, so the place of a
+ * line among the shown ones, and the line at a place, are binary searches:
+ * moving and scrolling past a fold of any size costs the same.
+ *
+ * an edit shifts the folds below it, and opens any fold it reaches into,
+ * except for a change to a fold's first line that leaves it one line */
+
+/* the last fold starting above row, which may hide it, or -1 */
+int
+fold_find (page_t *page, int row)
+{
+    int lo = 0, hi = page->folds.len;
+
+    while (lo < hi)
+        {
+            int mid = (lo + hi) / 2;
+            if (FOLD (page, mid)->row < row)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+    return lo - 1;
+}
+
+/* the fold hiding row, or NULL if it is shown */
+fold_t *
+fold_at (page_t *page, int row)
+{
+    int i = fold_find (page, row);
+    fold_t *f;
+
+    if (i < 0)
+        return NULL;
+    f = FOLD (page, i);
+    return row <= f->row + f->n ? f : NULL;
+}
+
+/* the fold starting at row, or NULL */
+fold_t *
+fold_head (page_t *page, int row)
+{
+    int i = fold_find (page, row + 1);
+    fold_t *f;
+
+    if (i < 0)
+        return NULL;
+    f = FOLD (page, i);
+    return f->row == row ? f : NULL;
+}
+
+/* the place of row among the lines shown. a hidden row gives the place of
+ * the next line shown */
+int
+fold_visible (page_t *page, int row)
+{
+    int i = fold_find (page, row);
+    fold_t *f;
+
+    if (i < 0)
+        return row;
+    f = FOLD (page, i);
+    return row - f->before - MIN (row - f->row - 1, f->n);
+}
+
+/* the row of the n'th line shown */
+int
+fold_row (page_t *page, int n)
+{
+    int lo = 0, hi = page->folds.len;
+    fold_t *f;
+
+    while (lo < hi)
+        {
+            int mid = (lo + hi) / 2;
+            f = FOLD (page, mid);
+            if (f->row - f->before < n)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+    if (lo == 0)
+        return n;
+    f = FOLD (page, lo - 1);
+    return n + f->before + f->n;
+}
+
+/* the row shown n lines below row, or above it for a negative n */
+int
+fold_down (page_t *page, int row, int n)
+{
+    return fold_row (page, MAX (fold_visible (page, row) + n, 0));
+}
+
+/* row, or the first line of the fold hiding it */
+int
+fold_top (page_t *page, int row)
+{
+    fold_t *f = fold_at (page, row);
+    return f == NULL ? row : f->row;
+}
+
+/* the line shown after row */
+int
+fold_next (page_t *page, int row)
+{
+    fold_t *f = fold_head (page, row);
+    return f == NULL ? row + 1 : row + f->n + 1;
+}
+
+/* where a move from one row to another ends: a step onto a fold goes over
+ * it, and a jump into one opens it */
+int
+fold_reach (page_t *page, int from, int to)
+{
+    fold_t *f = fold_at (page, to);
+
+    if (f == NULL)
+        return to;
+    if (to == from + 1)
+        return f->row + f->n + 1 < page->lines.len ? f->row + f->n + 1
+                                                   : f->row;
+    if (to == from || to == from - 1)
+        return f->row;
+
+    fold_remove (page, f - FOLD (page, 0));
+    return to;
+}
+
+/* puts back how many lines the folds from the i'th on have above them */
+void
+fold_count (page_t *page, int i)
+{
+    fold_t *f;
+    int before = 0;
+
+    if (i > 0)
+        {
+            f = FOLD (page, i - 1);
+            before = f->before + f->n;
+        }
+    for (; i < page->folds.len; ++i)
+        {
+            f = FOLD (page, i);
+            f->before = before;
+            before += f->n;
+        }
+}
+
+/* lines [row, row + n) of a page were hidden or shown: the views of the
+ * page measure them again, and cursors move off the lines hidden */
+void
+fold_show (page_t *page, int row, int n, bool hide)
+{
+    view_t *v;
+    int i;
+
+    for (i = 0; i < rite.views.len; ++i)
+        {
+            if ((v = *(view_t **)vector_get (&rite.views, i))->page != page)
+                continue;
+            wrap_fold (v, row, n, hide);
+            v->dirty = true;
+            if (hide)
+                {
+                    v->at.row = fold_top (page, v->at.row);
+                    v->at.scroll = fold_top (page, v->at.scroll);
+                }
+        }
+
+    if (hide && page == rite.page)
+        {
+            rite.row = fold_top (page, rite.row);
+            rite.scroll = fold_top (page, rite.scroll);
+            move_col (rite.col);
+        }
+}
+
+void
+fold_remove (page_t *page, int i)
+{
+    fold_t f = *FOLD (page, i);
+
+    vector_remove (&page->folds, i);
+    fold_count (page, i);
+    fold_show (page, f.row + 1, f.n, false);
+}
+
+/* hides the n lines after row, taking in the folds they reach, whole */
+void
+fold_add (page_t *page, int row, int n)
+{
+    fold_t *f;
+    int i;
+
+    n = MIN (n, page->lines.len - row - 1);
+    if (n <= 0 || fold_at (page, row) != NULL)
+        return;
+
+    i = fold_find (page, row + 1) + 1;
+    while (i > 0 && FOLD (page, i - 1)->row == row)
+        i--;
+    while (i < page->folds.len && FOLD (page, i)->row <= row + n)
+        {
+            /* a fold taken in keeps its lines hidden, end and all */
+            n = MAX (n, FOLD (page, i)->row + FOLD (page, i)->n - row);
+            vector_remove (&page->folds, i);
+        }
+
+    f = vector_insert (&page->folds, i);
+    f->row = row, f->n = n;
+    fold_count (page, i);
+    fold_show (page, row + 1, n, true);
+}
+
+void
+fold_clear (page_t *page)
+{
+    if (page->folds.len > 0)
+        fold_show (page, 0, page->lines.len, false);
+    page->folds.len = 0;
+    vector_resize (&page->folds);
+}
+
+/* lines [row, row + nold) became nnew lines */
+void
+fold_edit (page_t *page, int row, int nold, int nnew)
+{
+    int i = MAX (fold_find (page, row), 0), j, d = nnew - nold, from;
+    bool opened = false;
+    fold_t *f;
+
+    for (from = j = i; i < page->folds.len; ++i)
+        {
+            f = FOLD (page, i);
+            if (f->row + f->n < row)
+                ;
+            else if (f->row >= row + nold)
+                f->row += d;
+            else if (f->row != row || nold != 1 || nnew != 1)
+                {
+                    opened = true;
+                    continue;
+                }
+            *FOLD (page, j++) = *f;
+        }
+
+    if (j == page->folds.len)
+        return;
+    page->folds.len = j;
+    vector_resize (&page->folds);
+    fold_count (page, from);
+    if (opened)
+        fold_show (page, row, page->lines.len - row, false);
+}
+
+/* the width of a line's indentation, or -1 if it is blank */
+int
+fold_indent (line_t *l)
+{
+    int i, w = 0;
+    char *s = LINE_TEXT (l);
+
+    for (i = 0; i < LINE_LEN (l); ++i)
+        if (s[i] == ' ')
+            w++;
+        else if (s[i] == '\t')
+            w = (w / 8 + 1) * 8;
+        else
+            return w;
+    return -1;
+}
+
+/* the net change in brace depth over a line, and in *low the lowest it
+ * gets to on the way */
+int
+fold_braces (line_t *l, int *low)
+{
+    int i, d = 0;
+    char *s = LINE_TEXT (l);
+
+    for (*low = i = 0; i < LINE_LEN (l); ++i)
+        if (s[i] == '{')
+            d++;
+        else if (s[i] == '}' && --d < *low)
+            *low = d;
+    return d;
+}
+
+/* how many lines after row belong to the block it opens: the ones before
+ * the line closing a brace it leaves open, or else the lines indented
+ * deeper */
+int
+fold_block (page_t *page, int row)
+{
+    line_t *l = vector_get (&page->lines, row);
+    int indent = fold_indent (l), i, d, low, w, last = row;
+
+    /* d counts the braces left open after the lowest point of the line */
+    d = fold_braces (l, &low) - low;
+    if (d > 0)
+        {
+            for (i = row + 1; i < page->lines.len; ++i)
+                {
+                    w = fold_braces (vector_get (&page->lines, i), &low);
+                    if (d + low <= 0)
+                        return i - row - 1;
+                    d += w;
+                }
+            return 0;
+        }
+
+    for (i = row + 1; i < page->lines.len; ++i)
+        {
+            if ((w = fold_indent (vector_get (&page->lines, i))) < 0)
+                continue;
+            if (w <= indent)
+                break;
+            last = i;
+        }
+    return last - row;
+}
+
+/* folds the block the cursor is in, or the selected lines, or opens the
+ * fold the cursor is on */
+void
+fold_toggle ()
+{
+    page_t *page = rite.page;
+    int r0, c0, r1, c1, row, w;
+    fold_t *f;
+
+    if ((f = fold_head (page, rite.row)) != NULL)
+        {
+            fold_remove (page, f - FOLD (page, 0));
+            return;
+        }
+
+    if (select_range (&r0, &c0, &r1, &c1))
+        {
+            rite.selecting = false;
+            fold_add (page, r0, r1 - r0);
+            return;
+        }
+
+    /* a line opening nothing folds the block around it, from the first
+     * line above it that is indented less */
+    row = rite.row;
+    if (fold_block (page, row) == 0
+        && (w = fold_indent (vector_get (&page->lines, row))) != 0)
+        while (--row >= 0)
+            {
+                int i = fold_indent (vector_get (&page->lines, row));
+                if (i >= 0 && (i < w || w < 0))
+                    break;
+            }
+
+    if (row < 0 || fold_block (page, row) == 0)
+        {
+            status ("nothing to fold");
+            return;
+        }
+    fold_add (page, row, fold_block (page, row));
+}
+
+/* folds every brace block opened at depth level - 1, in one pass */
+void
+fold_level (int level)
+{
+    page_t *page = rite.page;
+    int i, j, d = 0, n = 0, open = -1;
+    char *s;
+    line_t *l;
+
+    for (i = 0; i < page->lines.len; ++i)
+        {
+            l = vector_get (&page->lines, i);
+            for (s = LINE_TEXT (l), j = 0; j < LINE_LEN (l); ++j)
+                if (s[j] == '{' && d++ == level - 1 && open < 0)
+                    open = i;
+                else if (s[j] == '}' && d > 0 && --d == level - 1
+                         && open >= 0)
+                    {
+                        if (i - open > 1 && fold_at (page, open) == NULL)
+                            fold_add (page, open, i - open - 1), n++;
+                        open = -1;
+                    }
+        }
+
+    sprintf (rite.status, "%i folds", n);
+}
+
+void
+fold_open_all ()
+{
+    fold_clear (rite.page);
+    status ("no folds");
+}
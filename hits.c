@@ -0,0 +1,378 @@
+#include "rite.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define HITS_BLOCK 0x400
+#define HITS_SLICE 0x400000
+
+#define BLOCK(i) ((hitblock_t *)vector_get (&rite.hits.blocks, (i)))
+#define HIT(b, i) ((hit_t *)vector_get (&(b)->hits, (i)))
+
+/* every match of the find query, in page order. the page is scanned in
+ * slices from idle, so a search over a huge page never blocks typing.
+ *
+ * hits are kept in blocks, each with a row shift that applies to all of
+ * its hits, so lines added or removed above a hit only touch one block's
+ * hits and the shifts of the blocks after it. a prefix count per block
+ * makes finding the n'th hit a binary search */
+
+int
+hits_compare (hitblock_t *b, int i, int row, int col)
+{
+    hit_t *h = HIT (b, i);
+    int r = h->row + b->shift;
+    return r != row ? r - row : h->col - col;
+}
+
+void
+hits_reset ()
+{
+    int i;
+    for (i = 0; i < rite.hits.blocks.len; ++i)
+        vector_deinit (&BLOCK (i)->hits);
+    vector_deinit (&rite.hits.blocks);
+    vector_deinit (&rite.hits.prefix);
+    vector_init (&rite.hits.blocks, sizeof (hitblock_t), 0x10);
+    vector_init (&rite.hits.prefix, sizeof (int), 0x10);
+    rite.hits.count = rite.hits.scan = 0;
+    rite.hits.dirty = true;
+}
+
+bool
+hits_active ()
+{
+    return rite.find.len > 0 && rite.page != NULL;
+}
+
+bool
+hits_done ()
+{
+    return !hits_active () || rite.hits.scan >= rite.page->lines.len;
+}
+
+/* the first hit at or after (row, col), as a block and an offset in it */
+void
+hits_locate (int row, int col, int *block, int *i)
+{
+    int lo = 0, hi = rite.hits.blocks.len, mid;
+    hitblock_t *b;
+
+    while (lo < hi)
+        {
+            mid = (lo + hi) / 2;
+            b = BLOCK (mid);
+            if (hits_compare (b, b->hits.len - 1, row, col) < 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+    *block = lo;
+    if (lo == rite.hits.blocks.len)
+        {
+            *i = 0;
+            return;
+        }
+
+    b = BLOCK (lo);
+    for (lo = 0, hi = b->hits.len; lo < hi;)
+        {
+            mid = (lo + hi) / 2;
+            if (hits_compare (b, mid, row, col) < 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+    *i = lo;
+}
+
+int *
+hits_prefix ()
+{
+    int i, n = 0;
+
+    if (rite.hits.dirty)
+        {
+            rite.hits.prefix.len = rite.hits.blocks.len;
+            vector_resize (&rite.hits.prefix);
+            for (i = 0; i < rite.hits.blocks.len; ++i)
+                {
+                    *(int *)vector_get (&rite.hits.prefix, i) = n;
+                    n += BLOCK (i)->hits.len;
+                }
+            rite.hits.dirty = false;
+        }
+
+    return vector_head (&rite.hits.prefix);
+}
+
+/* index of the first hit at or after (row, col) */
+int
+hits_find (int row, int col)
+{
+    int b, i;
+    hits_locate (row, col, &b, &i);
+    return b == rite.hits.blocks.len ? rite.hits.count : hits_prefix ()[b] + i;
+}
+
+bool
+hits_get (int n, int *row, int *col)
+{
+    int *prefix, lo = 0, hi = rite.hits.blocks.len, mid;
+    hitblock_t *b;
+    hit_t *h;
+
+    if (n < 0 || n >= rite.hits.count)
+        return false;
+
+    prefix = hits_prefix ();
+    while (hi - lo > 1)
+        {
+            mid = (lo + hi) / 2;
+            if (prefix[mid] <= n)
+                lo = mid;
+            else
+                hi = mid;
+        }
+
+    b = BLOCK (lo);
+    h = HIT (b, n - prefix[lo]);
+    *row = h->row + b->shift, *col = h->col;
+    return true;
+}
+
+/* appends hits, whose rows are shift less than the page's, to a block,
+ * and to new blocks spliced in after it with its shift as each fills up.
+ * *block ends at the last one */
+void
+hits_fill (int *block, hit_t *hits, int n, int shift)
+{
+    hitblock_t *b = BLOCK (*block);
+    hit_t *at;
+    int take, j, s;
+
+    while (n > 0)
+        {
+            if (b->hits.len >= HITS_BLOCK)
+                {
+                    s = b->shift;
+                    b = vector_insert (&rite.hits.blocks, ++*block);
+                    b->shift = s;
+                    vector_init (&b->hits, sizeof (hit_t), HITS_BLOCK);
+                }
+            take = MIN (n, HITS_BLOCK - b->hits.len);
+            at = vector_splice (&b->hits, b->hits.len, 0, take);
+            for (j = 0; j < take; ++j)
+                at[j].row = hits[j].row + shift - b->shift,
+                at[j].col = hits[j].col;
+            hits += take, n -= take;
+        }
+}
+
+/* inserts hits, all on rows before any hit at or after (row, col). no
+ * block grows past HITS_BLOCK: the one they land in is cut there, filled
+ * up, and what does not fit goes on in new blocks, with the hits it had
+ * after the cut last */
+void
+hits_insert (int row, int col, hit_t *hits, int n)
+{
+    vector_t tail;
+    hitblock_t *b;
+    int block, i, shift;
+
+    if (n == 0)
+        return;
+
+    hits_locate (row, col, &block, &i);
+    if (block == rite.hits.blocks.len)
+        {
+            if (block == 0)
+                {
+                    b = vector_append (&rite.hits.blocks);
+                    b->shift = 0;
+                    vector_init (&b->hits, sizeof (hit_t), HITS_BLOCK);
+                }
+            else
+                b = BLOCK (--block);
+            i = b->hits.len;
+        }
+    else
+        b = BLOCK (block);
+
+    shift = b->shift;
+    vector_init (&tail, sizeof (hit_t), 0x10);
+    if (i < b->hits.len)
+        vector_split (&tail, &b->hits, i);
+    hits_fill (&block, hits, n, 0);
+    hits_fill (&block, vector_head (&tail), tail.len, shift);
+    vector_deinit (&tail);
+
+    rite.hits.count += n;
+    rite.hits.dirty = true;
+}
+
+/* finds the hits starting in a row, appending them to out */
+void
+hits_row (int row, vector_t *out)
+{
+    int col = 0;
+    hit_t *h;
+
+    while ((col = find_line (row, col, false)) >= 0)
+        {
+            h = vector_append (out);
+            h->row = row, h->col = col;
+            if (rite.find.segments > 1)
+                break;
+            col += rite.find.len;
+        }
+}
+
+/* scans the next slice of the page. returns true if there was any left */
+bool
+hits_scan ()
+{
+    vector_t found;
+    long budget = HITS_SLICE;
+
+    if (hits_done ())
+        return false;
+
+    vector_init (&found, sizeof (hit_t), 0x100);
+    while (budget > 0 && rite.hits.scan < rite.page->lines.len)
+        {
+            line_t *l = vector_get (&rite.page->lines, rite.hits.scan);
+            hits_row (rite.hits.scan++, &found);
+            budget -= LINE_LEN (l) + 1;
+        }
+
+    hits_insert (0x7fffffff, 0, vector_head (&found), found.len);
+    vector_deinit (&found);
+    return true;
+}
+
+/* lines [row, row + nold) became nnew lines. hits on them are dropped,
+ * later hits shifted, and the new lines rescanned if already passed */
+void
+hits_edit (int row, int nold, int nnew)
+{
+    int lo, hi, block, i, n, d = nnew - nold;
+    hitblock_t *b;
+
+    if (!hits_active ())
+        return;
+
+    /* a multi line query can match from a few rows above the change */
+    lo = MAX (row - (rite.find.segments - 1), 0);
+    hi = row + nold;
+
+    /* drop hits in [lo, hi) */
+    hits_locate (lo, 0, &block, &i);
+    n = hits_find (hi, 0) - hits_find (lo, 0);
+    rite.hits.count -= n;
+    while (n > 0)
+        {
+            int take;
+            b = BLOCK (block);
+            take = MIN (n, b->hits.len - i);
+            vector_splice (&b->hits, i, take, 0);
+            n -= take;
+            if (b->hits.len == 0)
+                {
+                    vector_deinit (&b->hits);
+                    vector_remove (&rite.hits.blocks, block);
+                }
+            else
+                block++;
+            i = 0;
+        }
+    rite.hits.dirty = true;
+
+    /* shift hits from hi onwards */
+    if (d != 0)
+        {
+            hits_locate (hi, 0, &block, &i);
+            if (block < rite.hits.blocks.len)
+                {
+                    b = BLOCK (block);
+                    for (; i < b->hits.len; ++i)
+                        HIT (b, i)->row += d;
+                    for (++block; block < rite.hits.blocks.len; ++block)
+                        BLOCK (block)->shift += d;
+                }
+        }
+
+    if (rite.hits.scan >= hi)
+        {
+            vector_t found;
+
+            rite.hits.scan += d;
+            vector_init (&found, sizeof (hit_t), 0x10);
+            for (i = lo; i < row + nnew; ++i)
+                hits_row (i, &found);
+            hits_insert (row + nnew, 0, vector_head (&found), found.len);
+            vector_deinit (&found);
+        }
+    else if (rite.hits.scan > lo)
+        rite.hits.scan = lo;
+}
+
+/* moves to the hit after (or before) the cursor, wrapping around. falls
+ * back to a plain search while the index is still being built */
+bool
+hits_step (bool back)
+{
+    int n, row, col;
+
+    if (!hits_active ())
+        return false;
+
+    n = hits_find (rite.row, rite.col + (back ? 0 : 1)) - (back ? 1 : 0);
+    if (n < 0 || n >= rite.hits.count)
+        {
+            if (!hits_done ())
+                {
+                    row = rite.row, col = rite.col + (back ? 0 : 1);
+                    if (!find_next (&row, &col, back))
+                        return false;
+                    rite.col = col;
+                    move_row (row);
+                    return true;
+                }
+            n = back ? rite.hits.count - 1 : 0;
+        }
+
+    return hits_jump (n);
+}
+
+bool
+hits_jump (int n)
+{
+    int row, col;
+
+    if (!hits_get (n, &row, &col))
+        return false;
+
+    rite.col = col;
+    move_row (row);
+    return true;
+}
+
+void
+hits_goto (char *str)
+{
+    if (!hits_jump (atoi (str) - 1))
+        status ("no such hit");
+}
+
+/* the hit the cursor is on, counting from 1, or 0 */
+int
+hits_current ()
+{
+    int n = hits_find (rite.row, rite.col), row, col;
+
+    if (hits_get (n, &row, &col) && row == rite.row && col == rite.col)
+        return n + 1;
+    return 0;
+}
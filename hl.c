@@ -0,0 +1,357 @@
+#include "rite.h"
+
+#include <string.h>
+
+#define HL_EAGER 0x100
+#define HL_SLICE 0x400000
+
+/* syntax highlighting. a language is a table of comment and string
+ * delimiters and sorted keyword lists. every line keeps the state the
+ * lexer is in at its end (inside a block comment, or a string continued
+ * with a backslash), so any line can be coloured from the one before it.
+ *
+ * states are known for the lines before page->lexed. an edit re-lexes the
+ * lines it made and then the ones after until a line ends in the state
+ * it had before, which for typing is the line itself. idle lexes past the
+ * frontier in slices, and only lines on screen are ever coloured */
+
+enum HL_STATE
+{
+    HL_NORMAL,
+    HL_BLOCK,
+    HL_QUOTE
+};
+
+char *c_keywords[] = {
+    "break",  "case",   "continue", "default", "do",      "else",
+    "enum",   "extern", "for",      "goto",    "if",      "inline",
+    "return", "sizeof", "static",   "struct",  "switch",  "typedef",
+    "union",  "while",
+};
+
+char *c_types[] = {
+    "bool",     "char",     "const",    "double",   "float",
+    "int",      "int16_t",  "int32_t",  "int64_t",  "int8_t",
+    "long",     "register", "short",    "signed",   "size_t",
+    "uint16_t", "uint32_t", "uint64_t", "uint8_t",  "unsigned",
+    "void",     "volatile",
+};
+
+char *py_keywords[] = {
+    "and",    "as",     "assert", "break",  "class",    "continue",
+    "def",    "del",    "elif",   "else",   "except",   "finally",
+    "for",    "from",   "global", "if",     "import",   "in",
+    "is",     "lambda", "not",    "or",     "pass",     "raise",
+    "return", "try",    "while",  "with",   "yield",
+};
+
+char *py_types[] = {
+    "False", "None", "True", "bytes", "dict", "float",
+    "int",   "list", "self", "set",   "str",  "tuple",
+};
+
+#define WORDS(w) w, sizeof (w) / sizeof (w[0])
+
+syntax_t syntaxes[] = {
+    { ".c .h .cc .cpp .hpp", "//", "/*", "*/", "\"'", '#', WORDS (c_keywords),
+      WORDS (c_types) },
+    { ".py", "#", NULL, NULL, "\"'", 0, WORDS (py_keywords),
+      WORDS (py_types) },
+};
+
+enum TERM_COLOR hl_colors[HL_NUM_CLASSES] = {
+    TERM_DEFAULT, TERM_MAGENTA, TERM_GREEN, TERM_RED,
+    TERM_CYAN,    TERM_BLUE,    TERM_MAGENTA,
+};
+
+/* the colour of each byte of the last line coloured */
+vector_t hl_line;
+
+syntax_t *
+hl_detect (char *name)
+{
+    char *ext, *at;
+    int i, n;
+
+    if (name == NULL || (ext = strrchr (name, '.')) == NULL)
+        return NULL;
+
+    n = strlen (ext);
+    for (i = 0; i < sizeof (syntaxes) / sizeof (syntaxes[0]); ++i)
+        for (at = syntaxes[i].exts; (at = strstr (at, ext)) != NULL; at += n)
+            if (at[n] == ' ' || at[n] == '\0')
+                return &syntaxes[i];
+
+    return NULL;
+}
+
+bool
+hl_lookup (char **words, int n, char *s, int len)
+{
+    int lo = 0, hi = n - 1, mid, cmp;
+
+    while (lo <= hi)
+        {
+            mid = (lo + hi) / 2;
+            if ((cmp = strncmp (words[mid], s, len)) == 0)
+                cmp = (words[mid][len] != '\0');
+            if (cmp < 0)
+                lo = mid + 1;
+            else if (cmp > 0)
+                hi = mid - 1;
+            else
+                return true;
+        }
+
+    return false;
+}
+
+bool
+hl_at (char *s, int n, int i, char *delim)
+{
+    int len = (delim == NULL ? 0 : strlen (delim));
+    return len > 0 && i + len <= n && memcmp (s + i, delim, len) == 0;
+}
+
+/* lexes a line starting in state, returning the state at its end. if
+ * colors is not NULL, it gets the class of every byte */
+int
+hl_lex (syntax_t *syn, char *s, int n, int state, uint8_t *colors)
+{
+    int i = 0, j, k;
+    char q = 0;
+
+#define PAINT(from, to, cls)                                                  \
+    do                                                                        \
+        if (colors != NULL)                                                   \
+            memset (colors + (from), (cls), (to) - (from));                   \
+    while (0)
+
+    PAINT (0, n, HL_NONE);
+
+    if (state == HL_BLOCK)
+        {
+            for (; i < n && !hl_at (s, n, i, syn->end); ++i)
+                ;
+            if (i == n)
+                {
+                    PAINT (0, n, HL_COMMENT);
+                    return HL_BLOCK;
+                }
+            i += strlen (syn->end);
+            PAINT (0, i, HL_COMMENT);
+        }
+    else if (state >= HL_QUOTE)
+        {
+            q = syn->quotes[state - HL_QUOTE];
+            goto quote;
+        }
+
+    while (i < n)
+        {
+            uint8_t c = s[i];
+
+            if (hl_at (s, n, i, syn->line))
+                {
+                    PAINT (i, n, HL_COMMENT);
+                    return HL_NORMAL;
+                }
+
+            if (hl_at (s, n, i, syn->start))
+                {
+                    j = i, i += strlen (syn->start);
+                    for (; i < n && !hl_at (s, n, i, syn->end); ++i)
+                        ;
+                    if (i == n)
+                        {
+                            PAINT (j, n, HL_COMMENT);
+                            return HL_BLOCK;
+                        }
+                    i += strlen (syn->end);
+                    PAINT (j, i, HL_COMMENT);
+                    continue;
+                }
+
+            if (strchr (syn->quotes, c) != NULL && c != '\0')
+                {
+                    q = c, i++;
+                quote:
+                    for (j = i; i < n && s[i] != q; ++i)
+                        if (s[i] == '\\')
+                            i++;
+                    PAINT (MAX (j - 1, 0), MIN (i + 1, n), HL_STRING);
+                    /* only a backslash at the end carries a string on */
+                    if (i > n)
+                        return HL_QUOTE + (strchr (syn->quotes, q)
+                                           - syn->quotes);
+                    if (i == n)
+                        return HL_NORMAL;
+                    i++;
+                    continue;
+                }
+
+            if (word_class[c] == WORD_WORD)
+                {
+                    j = i;
+                    i += word_run (s + i, n - i, WORD_WORD);
+                    if (c >= '0' && c <= '9')
+                        k = HL_NUMBER;
+                    else if (hl_lookup (syn->keywords, syn->nkeywords, s + j,
+                                        i - j))
+                        k = HL_KEYWORD;
+                    else if (hl_lookup (syn->types, syn->ntypes, s + j, i - j))
+                        k = HL_TYPE;
+                    else
+                        continue;
+                    PAINT (j, i, k);
+                    continue;
+                }
+
+            if (c == syn->preproc && c != '\0')
+                {
+                    /* a directive runs to the end, or to a comment */
+                    if (word_run (s, i, WORD_SPACE) == i)
+                        {
+                            for (j = i; j < n && !hl_at (s, n, j, syn->line)
+                                        && !hl_at (s, n, j, syn->start);
+                                 ++j)
+                                ;
+                            PAINT (i, j, HL_PREPROC);
+                            i = j;
+                            continue;
+                        }
+                }
+
+            i++;
+        }
+
+#undef PAINT
+
+    return HL_NORMAL;
+}
+
+int
+hl_start (page_t *page, int row)
+{
+    line_t *l = vector_get (&page->lines, row - 1);
+    return l == NULL ? HL_NORMAL : l->state;
+}
+
+/* lexes lines from the frontier up to row, if that is not far away */
+void
+hl_catchup (page_t *page, int row)
+{
+    line_t *l;
+
+    if (page->syntax == NULL || row < page->lexed
+        || row - page->lexed > HL_EAGER)
+        return;
+
+    for (; page->lexed <= row && page->lexed < page->lines.len; page->lexed++)
+        {
+            l = vector_get (&page->lines, page->lexed);
+            l->state = hl_lex (page->syntax, LINE_TEXT (l), LINE_LEN (l),
+                               hl_start (page, page->lexed), NULL);
+        }
+}
+
+/* lines [row, row + nold) became nnew lines. returns the row after the
+ * last one that may be coloured differently now */
+int
+hl_edit (page_t *page, int row, int nold, int nnew)
+{
+    int i, old, budget = HL_EAGER;
+    line_t *l;
+
+    if (page->syntax == NULL || row > page->lexed)
+        return row + nnew;
+
+    if (row + nold > page->lexed)
+        {
+            page->lexed = row;
+            return row + nnew;
+        }
+
+    page->lexed += nnew - nold;
+    for (i = row; i < page->lexed; ++i)
+        {
+            l = vector_get (&page->lines, i);
+            old = l->state;
+            l->state = hl_lex (page->syntax, LINE_TEXT (l), LINE_LEN (l),
+                               hl_start (page, i), NULL);
+
+            /* from here on nothing changes */
+            if (i >= row + nnew && l->state == old)
+                return i + 1;
+
+            if (--budget == 0)
+                {
+                    page->lexed = i + 1;
+                    return i + 1;
+                }
+        }
+
+    return i;
+}
+
+bool
+hl_done (page_t *page)
+{
+    return page == NULL || page->syntax == NULL
+           || page->lexed >= page->lines.len;
+}
+
+/* lexes the next slice of lines past the frontier. returns true if a view
+ * of the page may show lines that changed colour */
+bool
+hl_scan (page_t *page)
+{
+    long budget = HL_SLICE;
+    int from = page->lexed;
+    line_t *l;
+
+    if (hl_done (page))
+        return false;
+
+    while (budget > 0 && page->lexed < page->lines.len)
+        {
+            l = vector_get (&page->lines, page->lexed);
+            l->state = hl_lex (page->syntax, LINE_TEXT (l), LINE_LEN (l),
+                               hl_start (page, page->lexed), NULL);
+            budget -= LINE_LEN (l) + 1;
+            page->lexed++;
+        }
+
+    return views_touch (page, from);
+}
+
+/* the class of every byte of a line, or NULL if the page has no syntax.
+ * only good until the next call */
+uint8_t *
+hl_colors_of (page_t *page, int row)
+{
+    line_t *l = vector_get (&page->lines, row);
+
+    if (page->syntax == NULL || l == NULL)
+        return NULL;
+
+    hl_catchup (page, row - 1);
+    if (hl_line.itemsize == 0)
+        vector_init (&hl_line, sizeof (uint8_t), 0x100);
+    hl_line.len = MAX (LINE_LEN (l), 1);
+    vector_resize (&hl_line);
+    hl_lex (page->syntax, LINE_TEXT (l), LINE_LEN (l), hl_start (page, row),
+            vector_head (&hl_line));
+    return vector_head (&hl_line);
+}
+
+/* the end of the run of one class starting at from, before to */
+int
+hl_run (uint8_t *colors, int from, int to)
+{
+    int i = from + 1;
+
+    while (i < to && colors[i] == colors[from])
+        i++;
+    return MIN (i, to);
+}
@@ -0,0 +1,203 @@
+#include "rite.h"
+
+#include <stdlib.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define TAB_WIDTH 8
+
+/* maps byte offsets in a line to display columns and back. a line's layout
+ * is built the first time it is needed and dropped when the line is
+ * edited, so unchanged lines are never measured twice.
+ *
+ * the layout is a sorted list of cells. a cell with a len is one grapheme
+ * cluster, tab or control character; one without starts a run of
+ * printable ascii, where bytes and columns go up together until the next
+ * cell. so a mostly ascii line has a handful of cells, and either mapping
+ * is a binary search over them. lines that are all printable ascii share
+ * layout_plain, and map to themselves.
+ *
+ * tabs stretch to the next multiple of TAB_WIDTH, and other control
+ * characters are shown as ^X */
+
+layout_t layout_plain;
+
+cell_t *
+layout_cell (layout_t *lo, int at, bool col)
+{
+    int low = 0, high = lo->cells.len, mid;
+    cell_t *cells = vector_head (&lo->cells);
+
+    /* the last cell starting at or before at */
+    while (high - low > 1)
+        {
+            mid = (low + high) / 2;
+            if ((col ? cells[mid].col : cells[mid].byte) <= at)
+                low = mid;
+            else
+                high = mid;
+        }
+
+    return &cells[low];
+}
+
+/* length of the leading run of printable ascii in s */
+int
+layout_scan (char *s, int n)
+{
+    char *p = s, *end = s + n;
+
+#ifdef __SSE2__
+    __m128i space = _mm_set1_epi8 (0x1f), del = _mm_set1_epi8 (0x7f);
+
+    /* the compare is signed, so bytes past ascii fail it too */
+    for (; p + 16 <= end; p += 16)
+        {
+            __m128i v = _mm_loadu_si128 ((__m128i *)p);
+            int mask = _mm_movemask_epi8 (_mm_andnot_si128 (
+                           _mm_cmpeq_epi8 (v, del), _mm_cmpgt_epi8 (v, space)))
+                       ^ 0xffff;
+            if (mask)
+                return p + __builtin_ctz (mask) - s;
+        }
+#endif
+
+    while (p < end && (uint8_t)*p >= 0x20 && (uint8_t)*p < 0x7f)
+        p++;
+    return p - s;
+}
+
+void
+layout_push (layout_t *lo, int byte, int col, int len)
+{
+    cell_t *c = vector_tail (&lo->cells);
+
+    /* consecutive ascii merges into one run */
+    if (len == 0 && c != NULL && c->len == 0)
+        return;
+
+    c = vector_append (&lo->cells);
+    c->byte = byte, c->col = col, c->len = len;
+}
+
+layout_t *
+layout_get (line_t *l)
+{
+    char *s = LINE_TEXT (l);
+    int n = LINE_LEN (l), i, k, w, col;
+    layout_t *lo;
+
+    if (l->layout != NULL)
+        return l->layout;
+
+    if (layout_scan (s, n) == n || (lo = malloc (sizeof (layout_t))) == NULL)
+        return l->layout = &layout_plain;
+
+    vector_init (&lo->cells, sizeof (cell_t), 0x10);
+
+    for (i = col = 0; i < n; i += k, col += w)
+        {
+            if ((k = layout_scan (s + i, n - i)) > 0)
+                {
+                    w = k;
+                    layout_push (lo, i, col, 0);
+                    continue;
+                }
+
+            if (s[i] == '\t')
+                k = 1, w = TAB_WIDTH - col % TAB_WIDTH;
+            else if ((uint8_t)s[i] < 0x20 || s[i] == 0x7f)
+                k = 1, w = 2;
+            else
+                k = utf8_cluster (s + i, n - i, &w);
+            layout_push (lo, i, col, k);
+        }
+
+    lo->cols = col;
+    return l->layout = lo;
+}
+
+void
+layout_drop (line_t *l)
+{
+    if (l->layout != NULL && l->layout != &layout_plain)
+        {
+            vector_deinit (&l->layout->cells);
+            free (l->layout);
+        }
+    l->layout = NULL;
+}
+
+/* the display column byte starts at */
+int
+layout_col (line_t *l, int byte)
+{
+    layout_t *lo = layout_get (l);
+    cell_t *c;
+
+    if (lo->cells.len == 0 || byte >= LINE_LEN (l))
+        return byte >= LINE_LEN (l) ? layout_width (l) + byte - LINE_LEN (l)
+                                    : byte;
+
+    c = layout_cell (lo, byte, false);
+    return c->len == 0 ? c->col + byte - c->byte : c->col;
+}
+
+/* the start of the cluster covering column col */
+int
+layout_byte (line_t *l, int col)
+{
+    layout_t *lo = layout_get (l);
+    cell_t *c;
+
+    if (col >= layout_width (l))
+        return LINE_LEN (l);
+    if (lo->cells.len == 0)
+        return col;
+
+    c = layout_cell (lo, col, true);
+    return c->len == 0 ? c->byte + col - c->col : c->byte;
+}
+
+int
+layout_width (line_t *l)
+{
+    layout_t *lo = layout_get (l);
+    return lo->cells.len == 0 ? LINE_LEN (l) : lo->cols;
+}
+
+/* the start of the cluster byte is in */
+int
+layout_snap (line_t *l, int byte)
+{
+    layout_t *lo = layout_get (l);
+    cell_t *c;
+
+    if (lo->cells.len == 0 || byte >= LINE_LEN (l))
+        return byte;
+
+    c = layout_cell (lo, byte, false);
+    return c->len == 0 ? byte : c->byte;
+}
+
+int
+layout_next (line_t *l, int byte)
+{
+    layout_t *lo = layout_get (l);
+    cell_t *c;
+
+    if (byte >= LINE_LEN (l))
+        return LINE_LEN (l);
+    if (lo->cells.len == 0)
+        return byte + 1;
+
+    c = layout_cell (lo, byte, false);
+    return c->len == 0 ? byte + 1 : c->byte + c->len;
+}
+
+int
+layout_prev (line_t *l, int byte)
+{
+    return byte <= 0 ? 0 : layout_snap (l, MIN (byte, LINE_LEN (l)) - 1);
+}
@@ -0,0 +1,147 @@
+#include "rite.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#define MACRO_RUN 0x100
+#define MACRO_POLL 0x400
+
+/* keyboard macros. while recording, every key and text event that comes
+ * in is kept. playing hands them to handle as if they were typed, with
+ * nothing drawn until the end, and each run of typed characters put in
+ * by one insert, so a line is spliced and re-lexed once per run rather
+ * than once per key.
+ *
+ * a run of the macro fails when a step leaves a message in the status
+ * line, or an arrow goes nowhere, and playing stops there. playing until
+ * a failure also stops at a key press, checked now and then */
+
+void
+macro_toggle ()
+{
+    if (rite.macro.recording)
+        {
+            /* the key that stopped it is not part of it */
+            rite.macro.recording = false;
+            vector_remove (&rite.macro.events, rite.macro.events.len - 1);
+            sprintf (rite.status, "recorded %i events",
+                     rite.macro.events.len);
+        }
+    else
+        {
+            vector_deinit (&rite.macro.events);
+            vector_init (&rite.macro.events, sizeof (event_t), 0x40);
+            rite.macro.recording = true;
+        }
+}
+
+void
+macro_record (event_t *evt)
+{
+    if (rite.macro.recording)
+        *(event_t *)vector_append (&rite.macro.events) = *evt;
+}
+
+/* the bytes an event types into the page, or 0 if it does something else */
+int
+macro_text (event_t *evt, char *buf)
+{
+    if (evt->type == RITE_EVENT_TEXT)
+        {
+            memcpy (buf, evt->u.t.str, evt->u.t.len);
+            return evt->u.t.len;
+        }
+
+    if (evt->type != RITE_EVENT_KEY
+        || (evt->mods & ~RITE_MOD_BIT (RITE_MOD_SHIFT)) != 0)
+        return 0;
+
+    if (evt->u.k < 128 && isprint (evt->u.k))
+        *buf = evt->u.k;
+    else if (evt->u.k == 128 + RITE_KEY_TAB)
+        *buf = '\t';
+    else
+        return 0;
+    return 1;
+}
+
+bool
+macro_motion (event_t *evt)
+{
+    int k = evt->u.k - 128;
+    return evt->type == RITE_EVENT_KEY
+           && (k == RITE_KEY_UP || k == RITE_KEY_DOWN || k == RITE_KEY_LEFT
+               || k == RITE_KEY_RIGHT);
+}
+
+/* plays the macro once, returning false if it failed */
+bool
+macro_run ()
+{
+    char buf[MACRO_RUN];
+    int i = 0, n, k, row, col;
+    event_t *evt, copy;
+
+    while (i < rite.macro.events.len && !rite.macro.failed)
+        {
+            evt = vector_get (&rite.macro.events, i);
+
+            for (n = 0; !rite.prompt.on && !rite.find.on
+                        && i < rite.macro.events.len
+                        && n <= MACRO_RUN - sizeof (evt->u.t.str)
+                        && (k = macro_text (evt, buf + n)) > 0;
+                 n += k)
+                evt = vector_get (&rite.macro.events, ++i);
+
+            if (n > 0)
+                {
+                    rite.want = -1, rite.count = 0;
+                    insert (buf, n);
+                    continue;
+                }
+
+            row = rite.row, col = rite.col;
+            copy = *evt;
+            handle (&copy);
+            if (macro_motion (evt) && row == rite.row && col == rite.col)
+                rite.macro.failed = true;
+            i++;
+        }
+
+    return !rite.macro.failed;
+}
+
+/* plays the macro n times, or if n is not positive, until it fails */
+void
+macro_play (int n)
+{
+    int i;
+
+    if (rite.macro.recording)
+        {
+            vector_remove (&rite.macro.events, rite.macro.events.len - 1);
+            status ("still recording");
+            return;
+        }
+    if (rite.macro.playing)
+        return;
+    if (rite.macro.events.len == 0)
+        {
+            status ("no macro");
+            return;
+        }
+
+    rite.macro.playing = true;
+    rite.macro.failed = false;
+    for (i = 0; (n <= 0 || i < n) && macro_run (); ++i)
+        if (n <= 0 && i % MACRO_POLL == MACRO_POLL - 1 && term_pending ())
+            {
+                i++;
+                break;
+            }
+    rite.macro.playing = false;
+
+    if (rite.status[0] == '\0' || !rite.macro.failed)
+        sprintf (rite.status, "played %i times", i);
+}
@@ -0,0 +1,475 @@
+#include "rite.h"
+
+#include <string.h>
+
+#define MATCH_BLOCK 0x100
+#define MATCH_SLICE 0x100000
+
+#define BLOCK(m, i) ((vector_t *)vector_get (&(m)->blocks, (i)))
+#define NEST(b, i) ((nest_t *)vector_get ((b), (i)))
+#define NODE(m, i) ((nestnode_t *)vector_get (&(m)->tree, (i)))
+
+/* bracket matching. every line knows how far it changes the bracket depth
+ * and the lowest the depth gets to on the way, all kinds of brackets
+ * counted as one. the lines are kept in blocks, and a segment tree over
+ * the blocks sums their lines and depths, so the line holding the partner
+ * of a bracket is found going down the tree from the lines next to it,
+ * however far away it is. an edit measures the lines it touches again,
+ * fixing one path of the tree; blocks splitting or emptying build the
+ * tree again on the next lookup.
+ *
+ * lines from scan on have not been measured since the page was read: idle
+ * measures them in slices, and a jump finishes them first. brackets in
+ * strings and comments count like any other */
+
+nest_t
+match_join (nest_t a, nest_t b)
+{
+    nest_t n;
+
+    n.net = a.net + b.net;
+    n.low = MIN (a.low, a.net + b.low);
+    return n;
+}
+
+/* the nesting of bytes [0, len) of s */
+nest_t
+match_nest (char *s, int len)
+{
+    nest_t n;
+    int i;
+
+    n.net = n.low = 0;
+    for (i = 0; i < len; ++i)
+        if (s[i] == '(' || s[i] == '[' || s[i] == '{')
+            n.net++;
+        else if ((s[i] == ')' || s[i] == ']' || s[i] == '}')
+                 && --n.net < n.low)
+            n.low = n.net;
+    return n;
+}
+
+/* 1 for an opening bracket, -1 for a closing one, else 0 */
+int
+match_side (char c)
+{
+    return c == '(' || c == '[' || c == '{'   ? 1
+           : c == ')' || c == ']' || c == '}' ? -1
+                                              : 0;
+}
+
+void
+match_clear (page_t *page)
+{
+    match_t *m = &page->match;
+    int i;
+
+    for (i = 0; i < m->blocks.len; ++i)
+        vector_deinit (BLOCK (m, i));
+    vector_deinit (&m->blocks);
+    vector_deinit (&m->tree);
+    vector_init (&m->blocks, sizeof (vector_t), 0x10);
+    vector_init (&m->tree, sizeof (nestnode_t), 0x10);
+    m->size = m->scan = 0;
+    m->dirty = false;
+}
+
+/* the sums of a block, from its lines */
+nestnode_t
+match_sum (vector_t *b)
+{
+    nestnode_t node;
+    int i;
+
+    node.lines = b->len;
+    node.nest.net = node.nest.low = 0;
+    for (i = 0; i < b->len; ++i)
+        node.nest = match_join (node.nest, *NEST (b, i));
+    return node;
+}
+
+void
+match_build (match_t *m)
+{
+    nestnode_t *t;
+    int i;
+
+    if (!m->dirty)
+        return;
+
+    for (m->size = 1; m->size < m->blocks.len; m->size *= 2)
+        ;
+    m->tree.len = 2 * m->size;
+    vector_resize (&m->tree);
+    t = vector_head (&m->tree);
+    memset (t, 0, m->tree.len * sizeof (nestnode_t));
+    for (i = 0; i < m->blocks.len; ++i)
+        t[m->size + i] = match_sum (BLOCK (m, i));
+    for (i = m->size - 1; i > 0; --i)
+        {
+            t[i].lines = t[2 * i].lines + t[2 * i + 1].lines;
+            t[i].nest = match_join (t[2 * i].nest, t[2 * i + 1].nest);
+        }
+    m->dirty = false;
+}
+
+/* a block's lines changed: its sums go up the tree */
+void
+match_update (match_t *m, int block)
+{
+    nestnode_t *t;
+    int i;
+
+    if (m->dirty)
+        return;
+
+    t = vector_head (&m->tree);
+    i = m->size + block;
+    t[i] = match_sum (BLOCK (m, block));
+    for (i /= 2; i > 0; i /= 2)
+        {
+            t[i].lines = t[2 * i].lines + t[2 * i + 1].lines;
+            t[i].nest = match_join (t[2 * i].nest, t[2 * i + 1].nest);
+        }
+}
+
+/* goes down the tree by line counts to the leaf of row, into *i its
+ * index in that block's entries. a row past the last line, as an insert
+ * at the end asks for, is the slot after the last entry of the last block,
+ * and an empty page gives block 0 */
+int
+match_block (match_t *m, int row, int *i)
+{
+    int node = 1;
+
+    match_build (m);
+    if (m->blocks.len == 0)
+        {
+            *i = 0;
+            return 0;
+        }
+
+    while (node < m->size)
+        if (NODE (m, 2 * node)->lines > row)
+            node = 2 * node;
+        else
+            {
+                row -= NODE (m, 2 * node)->lines;
+                node = 2 * node + 1;
+            }
+
+    if ((node -= m->size) >= m->blocks.len)
+        {
+            node = m->blocks.len - 1;
+            row = BLOCK (m, node)->len;
+        }
+    *i = row;
+    return node;
+}
+
+/* opens n unmeasured lines at row */
+void
+match_insert (match_t *m, int row, int n)
+{
+    vector_t *b, all;
+    int block, i, k, j, take;
+
+    if (n <= 0)
+        return;
+
+    if (m->blocks.len == 0)
+        {
+            vector_init (vector_append (&m->blocks), sizeof (nest_t),
+                         MATCH_BLOCK);
+            m->dirty = true;
+        }
+
+    block = match_block (m, row, &i);
+    b = BLOCK (m, block);
+    memset (vector_splice (b, i, 0, n), 0, n * sizeof (nest_t));
+
+    if (b->len <= 2 * MATCH_BLOCK)
+        {
+            match_update (m, block);
+            return;
+        }
+
+    /* cut what grew too big into blocks of MATCH_BLOCK */
+    all = *b;
+    k = (all.len - 1) / MATCH_BLOCK + 1;
+    vector_splice (&m->blocks, block + 1, 0, k - 1);
+    for (j = 0; j < k; ++j)
+        {
+            take = MIN (MATCH_BLOCK, all.len - j * MATCH_BLOCK);
+            b = BLOCK (m, block + j);
+            vector_init (b, sizeof (nest_t), MATCH_BLOCK);
+            b->len = take;
+            vector_resize (b);
+            memcpy (b->data, NEST (&all, j * MATCH_BLOCK),
+                    take * sizeof (nest_t));
+        }
+    vector_deinit (&all);
+    m->dirty = true;
+}
+
+void
+match_remove (match_t *m, int row, int n)
+{
+    int block, i, take;
+    vector_t *b;
+
+    if (n <= 0 || m->blocks.len == 0)
+        return;
+
+    block = match_block (m, row, &i);
+    for (; n > 0 && block < m->blocks.len; i = 0)
+        {
+            b = BLOCK (m, block);
+            take = MIN (n, b->len - i);
+            vector_splice (b, i, take, 0);
+            n -= take;
+            if (b->len == 0)
+                {
+                    vector_deinit (b);
+                    vector_remove (&m->blocks, block);
+                    m->dirty = true;
+                }
+            else
+                match_update (m, block++);
+        }
+}
+
+/* measures lines [row, row + n) again, each block they are in going up
+ * the tree once */
+void
+match_measure (page_t *page, int row, int n)
+{
+    match_t *m = &page->match;
+    int block, i;
+    line_t *l;
+
+    if (n <= 0)
+        return;
+
+    block = match_block (m, row, &i);
+    for (; n > 0; --n, ++i)
+        {
+            if (i == BLOCK (m, block)->len)
+                match_update (m, block++), i = 0;
+            l = vector_get (&page->lines, row++);
+            *NEST (BLOCK (m, block), i)
+                = match_nest (LINE_TEXT (l), LINE_LEN (l));
+        }
+    match_update (m, block);
+}
+
+/* lines [row, row + nold) of a page became nnew lines */
+void
+match_edit (page_t *page, int row, int nold, int nnew)
+{
+    match_t *m = &page->match;
+
+    /* a line edited in place keeps its entry */
+    if (nold != nnew)
+        {
+            match_remove (m, row, nold);
+            match_insert (m, row, nnew);
+        }
+
+    if (row + nold <= m->scan && row < m->scan)
+        {
+            m->scan += nnew - nold;
+            match_measure (page, row, nnew);
+        }
+    else if (row < m->scan)
+        m->scan = row;
+}
+
+bool
+match_done (page_t *page)
+{
+    return page == NULL || page->match.scan >= page->lines.len;
+}
+
+/* measures the next slice of lines, walking the blocks in step. returns
+ * true when the last is done, as a partner may show now */
+bool
+match_scan (page_t *page)
+{
+    match_t *m = &page->match;
+    long budget = MATCH_SLICE;
+    int block, i;
+    line_t *l;
+
+    if (match_done (page))
+        return false;
+
+    block = match_block (m, m->scan, &i);
+    for (; budget > 0 && m->scan < page->lines.len; ++i)
+        {
+            if (i == BLOCK (m, block)->len)
+                block++, i = 0;
+            l = vector_get (&page->lines, m->scan++);
+            *NEST (BLOCK (m, block), i)
+                = match_nest (LINE_TEXT (l), LINE_LEN (l));
+            budget -= LINE_LEN (l) + 1;
+        }
+
+    m->dirty = true;
+    return match_done (page);
+}
+
+/* the first line from row on, in the block holding it, where depth d goes
+ * below zero, or -1. d is left as the depth past the lines gone over */
+int
+match_walk (match_t *m, int block, int i, int *d, bool back)
+{
+    vector_t *b = BLOCK (m, block);
+    nest_t *n;
+
+    for (; i >= 0 && i < b->len; i += (back ? -1 : 1))
+        {
+            n = NEST (b, i);
+            if (*d + (back ? n->low - n->net : n->low) < 0)
+                return i;
+            *d += (back ? -n->net : n->net);
+        }
+    return -1;
+}
+
+/* the first block after block, or before it going back, where depth d
+ * goes below zero, or -1. the tree nodes covering the blocks in between
+ * are gone over in order, and the one it happens in is gone down */
+int
+match_blocks (match_t *m, int block, int *d, bool back)
+{
+    int l, r, nodes[2][64], nl = 0, nr = 0, k, node, low;
+    nestnode_t *t;
+
+    match_build (m);
+    t = vector_head (&m->tree);
+    if (back)
+        l = m->size, r = m->size + block;
+    else
+        l = m->size + block + 1, r = 2 * m->size;
+    for (; l < r; l /= 2, r /= 2)
+        {
+            if (l & 1)
+                nodes[0][nl++] = l++;
+            if (r & 1)
+                nodes[1][nr++] = --r;
+        }
+
+    for (k = 0; k < nl + nr; ++k)
+        {
+            if (back)
+                node = k < nr ? nodes[1][k] : nodes[0][nl - 1 - (k - nr)];
+            else
+                node = k < nl ? nodes[0][k] : nodes[1][nr - 1 - (k - nl)];
+
+            low = back ? t[node].nest.low - t[node].nest.net
+                       : t[node].nest.low;
+            if (*d + low >= 0)
+                {
+                    *d += back ? -t[node].nest.net : t[node].nest.net;
+                    continue;
+                }
+
+            while (node < m->size)
+                {
+                    node = 2 * node + (back ? 1 : 0);
+                    low = back ? t[node].nest.low - t[node].nest.net
+                               : t[node].nest.low;
+                    if (*d + low < 0)
+                        continue;
+                    *d += back ? -t[node].nest.net : t[node].nest.net;
+                    node += back ? -1 : 1;
+                }
+            return node - m->size;
+        }
+    return -1;
+}
+
+/* the first row of a block */
+int
+match_row (match_t *m, int block)
+{
+    int i, row = 0;
+
+    match_build (m);
+    for (i = m->size + block; i > 1; i /= 2)
+        if (i & 1)
+            row += NODE (m, i - 1)->lines;
+    return row;
+}
+
+/* the byte of a line where depth *d goes below zero, going on from col,
+ * or -1 with *d left as the depth at the end */
+int
+match_col (line_t *l, int col, int *d, bool back)
+{
+    char *s = LINE_TEXT (l);
+    int side;
+
+    for (; col >= 0 && col < LINE_LEN (l); col += (back ? -1 : 1))
+        if ((side = match_side (s[col])) != 0
+            && (*d += (back ? -side : side)) < 0)
+            return col;
+    return -1;
+}
+
+/* the partner of the bracket at (row, col), or else just before it, into
+ * (*prow, *pcol). brackets of different kinds are no partners. the lines
+ * are measured first if need be, unless only a quick answer will do */
+bool
+match_partner (page_t *page, int row, int col, int *prow, int *pcol,
+               bool quick)
+{
+    line_t *l = vector_get (&page->lines, row);
+    match_t *m = &page->match;
+    int d = 0, block, i, at;
+    char c, *pairs = "()[]{}";
+    bool back;
+
+    if (l == NULL)
+        return false;
+
+    if (col >= LINE_LEN (l) || match_side (LINE_TEXT (l)[col]) == 0)
+        col--;
+    if (col < 0 || match_side (c = LINE_TEXT (l)[col]) == 0)
+        return false;
+    back = match_side (c) < 0;
+
+    /* the rest of the line, then the lines after it in its block, then
+     * the blocks after that */
+    if ((at = match_col (l, col + (back ? -1 : 1), &d, back)) < 0)
+        {
+            if (quick && !match_done (page))
+                return false;
+            while (!match_done (page))
+                match_scan (page);
+
+            block = match_block (m, row, &i);
+            i = match_walk (m, block, i + (back ? -1 : 1), &d, back);
+            if (i < 0)
+                {
+                    if ((block = match_blocks (m, block, &d, back)) < 0)
+                        return false;
+                    i = match_walk (m, block,
+                                    back ? BLOCK (m, block)->len - 1 : 0, &d,
+                                    back);
+                }
+            if (i < 0)
+                return false;
+
+            row = match_row (m, block) + i;
+            l = vector_get (&page->lines, row);
+            if ((at = match_col (l, back ? LINE_LEN (l) - 1 : 0, &d, back))
+                < 0)
+                return false;
+        }
+
+    *prow = row, *pcol = at;
+    return (strchr (pairs, c) - pairs) / 2
+           == (strchr (pairs, LINE_TEXT (l)[at]) - pairs) / 2;
+}
@@ -0,0 +1,400 @@
+#include "rite.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CURSOR(i) ((cursor_t *)vector_get (&rite.cursors, (i)))
+
+/* multiple cursors. while there is more than one, rite.cursors holds all
+ * of them sorted, the one in rite.row and rite.col among them.
+ *
+ * an edit goes over the cursors once, top to bottom. every touched run of
+ * rows is built anew from its old text with one copy of each byte, and the
+ * old lines go to the undo record as they are, so nothing is copied twice.
+ * when no rows come or go the new lines take the old ones' places, and
+ * otherwise the line array is rebuilt once. the runs are then reported in
+ * order, so derived state sees them as a series of ordinary edits */
+
+/* rows [row, row + nold) became the nnew pieces from first on */
+typedef struct
+{
+    int row, nold, nnew, first;
+} run_t;
+
+int
+multi_cmp (const void *a, const void *b)
+{
+    const cursor_t *x = a, *y = b;
+    return x->row != y->row ? x->row - y->row : x->col - y->col;
+}
+
+bool
+multi_active ()
+{
+    return rite.cursors.len > 0;
+}
+
+void
+multi_clear ()
+{
+    vector_deinit (&rite.cursors);
+    vector_init (&rite.cursors, sizeof (cursor_t), 0x100);
+}
+
+/* puts the cursors back in order, on characters that are there, without
+ * doubles. a single cursor left is just rite's */
+void
+multi_sort ()
+{
+    cursor_t *c = vector_head (&rite.cursors);
+    int i, n = 0, lines = rite.page->lines.len;
+    line_t *l;
+
+    if (!multi_active ())
+        return;
+
+    for (i = 0; i < rite.cursors.len; ++i)
+        {
+            c[i].row = CLAMP (c[i].row, 0, MAX (lines - 1, 0));
+            if ((l = vector_get (&rite.page->lines, c[i].row)) != NULL)
+                c[i].col = layout_snap (l, CLAMP (c[i].col, 0, LINE_LEN (l)));
+        }
+
+    qsort (c, rite.cursors.len, sizeof (cursor_t), multi_cmp);
+    for (i = 0; i < rite.cursors.len; ++i)
+        if (n == 0 || multi_cmp (&c[n - 1], &c[i]) != 0)
+            c[n++] = c[i];
+    rite.cursors.len = n;
+    vector_resize (&rite.cursors);
+
+    if (n < 2)
+        multi_clear ();
+}
+
+void
+multi_add (int row, int col)
+{
+    cursor_t *c;
+
+    if (!multi_active ())
+        {
+            c = vector_append (&rite.cursors);
+            c->row = rite.row, c->col = rite.col;
+        }
+    c = vector_append (&rite.cursors);
+    c->row = row, c->col = col;
+}
+
+void
+multi_report ()
+{
+    sprintf (rite.status, "%i cursors", MAX (rite.cursors.len, 1));
+}
+
+/* the cursors on a row, as n of them from the one returned */
+cursor_t *
+multi_row (int row, int *n)
+{
+    cursor_t *c = vector_head (&rite.cursors);
+    int lo = 0, hi = rite.cursors.len, mid;
+
+    while (lo < hi)
+        {
+            mid = (lo + hi) / 2;
+            if (c[mid].row < row)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+
+    for (hi = lo; hi < rite.cursors.len && c[hi].row == row; ++hi)
+        ;
+    *n = hi - lo;
+    return c + lo;
+}
+
+/* a cursor on each of the n lines below the lowest, at the same column */
+void
+multi_lines (int n)
+{
+    int row = rite.row, col = rite.col, want, i;
+    cursor_t *last;
+    line_t *l;
+
+    if (multi_active ())
+        {
+            last = vector_tail (&rite.cursors);
+            row = last->row, col = last->col;
+        }
+
+    if ((l = vector_get (&rite.page->lines, row)) == NULL)
+        return;
+
+    want = layout_col (l, col);
+    for (i = 1; i <= n && row + i < rite.page->lines.len; ++i)
+        {
+            l = vector_get (&rite.page->lines, row + i);
+            multi_add (row + i, layout_byte (l, want));
+        }
+
+    multi_sort ();
+    multi_report ();
+}
+
+/* a cursor at every hit of the query, finishing the index first */
+void
+multi_hits ()
+{
+    int i, row, col;
+
+    if (!hits_active ())
+        {
+            status ("no query");
+            return;
+        }
+
+    while (!hits_done ())
+        hits_scan ();
+
+    for (i = 0; hits_get (i, &row, &col); ++i)
+        multi_add (row, col);
+
+    multi_sort ();
+    multi_report ();
+}
+
+/* runs a motion for every cursor */
+void
+multi_move (int key, bool ctrl, int count)
+{
+    int i, row = rite.row, col = rite.col, main = 0;
+    cursor_t *c;
+
+    for (i = 0; i < rite.cursors.len; ++i)
+        {
+            c = CURSOR (i);
+            if (c->row == row && c->col == col)
+                main = i;
+
+            rite.row = c->row, rite.col = c->col;
+            switch (key)
+                {
+                case RITE_KEY_UP:
+                    move_visual (rite.row - 1, -1);
+                    break;
+                case RITE_KEY_DOWN:
+                    move_visual (rite.row + 1, -1);
+                    break;
+                case RITE_KEY_LEFT:
+                    if (ctrl)
+                        jump_back (count);
+                    else
+                        left ();
+                    break;
+                case RITE_KEY_RIGHT:
+                    if (ctrl)
+                        jump_forward (count);
+                    else
+                        right ();
+                    break;
+                case RITE_KEY_HOME:
+                    home ();
+                    break;
+                case RITE_KEY_END:
+                    end ();
+                    break;
+                }
+            c->row = rite.row, c->col = rite.col;
+        }
+
+    c = CURSOR (main);
+    rite.row = c->row, rite.col = c->col;
+    rite.want = -1;
+    multi_sort ();
+}
+
+/* copies text[from, to) onto the end of a piece */
+void
+multi_copy (line_t *piece, char *text, int from, int to)
+{
+    if (to > from)
+        line_extend (piece, text + from, to - from);
+}
+
+/* an erase in column 0 joins the row to the one above */
+bool
+multi_joins (int op, cursor_t *c)
+{
+    return op == MULTI_ERASE && c->col == 0 && c->row > 0;
+}
+
+/* builds the new lines of every run of touched rows into pieces. each
+ * cursor's row is left as the index of the piece it ends up in */
+void
+multi_build (int op, char *str, int len, vector_t *runs, vector_t *pieces)
+{
+    cursor_t *c = vector_head (&rite.cursors);
+    int i, j, n = rite.cursors.len, r, pos, at;
+    line_t *piece, *l;
+    run_t *run = NULL;
+
+    for (i = 0; i < n; i = j)
+        {
+            r = c[i].row;
+            for (j = i; j < n && c[j].row == r; ++j)
+                ;
+
+            /* a row right below the run carries it on, as a piece of its
+             * own unless it joins the last */
+            if (run != NULL && run->row + run->nold == r)
+                {
+                    if (!multi_joins (op, &c[i]))
+                        {
+                            line_init (vector_append (pieces));
+                            run->nnew++;
+                        }
+                }
+            else if (multi_joins (op, &c[i]))
+                {
+                    /* the row above is pulled into the run */
+                    run = vector_append (runs);
+                    run->row = r - 1, run->nold = 1, run->nnew = 1;
+                    run->first = pieces->len;
+                    line_init (piece = vector_append (pieces));
+                    l = vector_get (&rite.page->lines, r - 1);
+                    multi_copy (piece, LINE_TEXT (l), 0, LINE_LEN (l));
+                }
+            else
+                {
+                    run = vector_append (runs);
+                    run->row = r, run->nold = 0, run->nnew = 1;
+                    run->first = pieces->len;
+                    line_init (vector_append (pieces));
+                }
+
+            run->nold++;
+            piece = vector_tail (pieces);
+            l = vector_get (&rite.page->lines, r);
+            for (pos = 0; i < j; ++i)
+                {
+                    at = c[i].col;
+                    if (op == MULTI_ERASE && at > 0)
+                        at = layout_prev (l, at);
+                    multi_copy (piece, LINE_TEXT (l), pos, at);
+                    pos = c[i].col;
+
+                    if (op == MULTI_INSERT)
+                        line_extend (piece, str, len);
+                    else if (op == MULTI_ENTER)
+                        {
+                            line_init (piece = vector_append (pieces));
+                            run->nnew++;
+                        }
+
+                    c[i].row = pieces->len - 1;
+                    c[i].col = LINE_LEN (piece);
+                }
+            multi_copy (piece, LINE_TEXT (l), pos, LINE_LEN (l));
+        }
+}
+
+/* applies an edit at every cursor in one pass */
+void
+multi_edit (int op, char *str, int len)
+{
+    page_t *page = rite.page;
+    vector_t runs, pieces, lines;
+    int i, k, shift = 0, from, row, main = 0;
+    cursor_t *c;
+    run_t *run;
+    hunk_t *h;
+
+    multi_sort ();
+    if (!multi_active ())
+        return;
+
+    c = vector_head (&rite.cursors);
+    for (i = 0; i < rite.cursors.len; ++i)
+        if (c[i].row == rite.row && c[i].col == rite.col)
+            main = i;
+
+    vector_init (&runs, sizeof (run_t), 0x100);
+    vector_init (&pieces, sizeof (line_t), 0x100);
+    multi_build (op, str, len, &runs, &pieces);
+
+    for (i = 0; i < runs.len; ++i)
+        {
+            run = vector_get (&runs, i);
+            shift += run->nnew - run->nold;
+        }
+
+    /* the line array is only rebuilt if rows come or go */
+    if (shift != 0)
+        {
+            vector_init (&lines, sizeof (line_t), page->lines.pad);
+            lines.len = page->lines.len + shift;
+            vector_resize (&lines);
+        }
+    else
+        lines = page->lines;
+
+    undo_begin (page);
+    for (i = from = row = 0; i < runs.len; ++i)
+        {
+            run = vector_get (&runs, i);
+            if (shift != 0 && run->row > from)
+                memcpy (vector_get (&lines, row),
+                        vector_get (&page->lines, from),
+                        (run->row - from) * sizeof (line_t));
+            row += run->row - from;
+            from = run->row + run->nold;
+
+            page_editing (page, run->row, run->nold);
+            if ((h = undo_hunk (page, row, run->nold, run->nnew)) != NULL)
+                memcpy (vector_head (&h->old),
+                        vector_get (&page->lines, run->row),
+                        run->nold * sizeof (line_t));
+            else
+                for (k = 0; k < run->nold; ++k)
+                    line_deinit (vector_get (&page->lines, run->row + k));
+
+            memcpy (vector_get (&lines, row), vector_get (&pieces, run->first),
+                    run->nnew * sizeof (line_t));
+            run->row = row;
+            row += run->nnew;
+        }
+
+    if (shift != 0)
+        {
+            if (page->lines.len > from)
+                memcpy (vector_get (&lines, row),
+                        vector_get (&page->lines, from),
+                        (page->lines.len - from) * sizeof (line_t));
+            free (page->lines.data);
+            page->lines = lines;
+        }
+
+    /* reported in order, each run's row counts the ones above it */
+    page->dirty = true;
+    for (i = 0; i < runs.len; ++i)
+        {
+            run = vector_get (&runs, i);
+            page_edited (page, run->row, run->nold, run->nnew);
+        }
+    undo_end (page);
+
+    run = vector_head (&runs);
+    for (i = 0; i < rite.cursors.len; ++i)
+        {
+            while (run->first + run->nnew <= c[i].row)
+                run++;
+            c[i].row = run->row + c[i].row - run->first;
+        }
+
+    rite.row = c[main].row, rite.col = c[main].col;
+    rite.want = -1;
+    vector_deinit (&runs);
+    vector_deinit (&pieces);
+    multi_sort ();
+}
@@ -0,0 +1,143 @@
+#include "rite.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define PAGES_MEMORY 0x10000000
+
+#define PAGE(i) (*(page_t **)vector_get (&rite.pages, (i)))
+
+/* the list of open pages. a page named on the command line costs nothing
+ * but its name until it is first shown, when it is read in. the page being
+ * edited keeps its cursor and viewport in rite, and the others keep theirs
+ * in their view, swapped in and out on every switch.
+ *
+ * when the pages read in take more than PAGES_MEMORY, the ones shown least
+ * recently that have nothing unsaved are dropped, to be read again the
+ * next time they are shown */
+
+page_t *
+pages_add (char *name)
+{
+    page_t *page = malloc (sizeof (page_t));
+
+    if (page == NULL)
+        return NULL;
+
+    page_init (page);
+    if (name != NULL)
+        {
+            page->name = malloc (strlen (name) + 1);
+            strcpy (page->name, name);
+        }
+    *(page_t **)vector_append (&rite.pages) = page;
+    return page;
+}
+
+void
+pages_free ()
+{
+    int i;
+
+    for (i = 0; i < rite.pages.len; ++i)
+        {
+            page_deinit (PAGE (i));
+            free (PAGE (i));
+        }
+    vector_deinit (&rite.pages);
+    rite.page = NULL;
+}
+
+/* roughly what a page read in takes: its text, kept whole and in lines */
+long
+pages_memory (page_t *page)
+{
+    return page->loaded ? 2 * page->len + page->lines.len * sizeof (line_t)
+                        : 0;
+}
+
+bool
+pages_evictable (page_t *page)
+{
+    return page->loaded && !views_shows (page) && !page->dirty
+           && page->fd < 0 && page->name != NULL && rite.pipe.page != page;
+}
+
+void
+pages_evict ()
+{
+    long total = 0;
+    page_t *page, *lru;
+    int i;
+
+    for (i = 0; i < rite.pages.len; ++i)
+        total += pages_memory (PAGE (i));
+
+    while (total > PAGES_MEMORY)
+        {
+            for (lru = NULL, i = 0; i < rite.pages.len; ++i)
+                if (pages_evictable (page = PAGE (i))
+                    && (lru == NULL || page->used < lru->used))
+                    lru = page;
+            if (lru == NULL)
+                break;
+
+            total -= pages_memory (lru);
+            page_clear (lru);
+            free (lru->text);
+            lru->text = NULL;
+            lru->loaded = false;
+        }
+}
+
+/* shows the i'th page, reading it in first if it has not been */
+void
+pages_switch (int i)
+{
+    page_t *page;
+
+    if (i < 0 || i >= rite.pages.len)
+        return;
+
+    page = PAGE (i);
+    if (rite.page != NULL)
+        {
+            rite.page->spot.row = rite.row, rite.page->spot.col = rite.col;
+            rite.page->spot.scroll = rite.scroll;
+            rite.page->spot.subscroll = rite.subscroll;
+            rite.page->spot.hscroll = rite.hscroll;
+        }
+
+    rite.page = rite.view->page = page;
+    rite.current = i;
+    page->used = ++rite.tick;
+
+    if (!page->loaded && page->name != NULL)
+        page_read (page, page->name);
+
+    rite.row = page->spot.row, rite.col = page->spot.col;
+    rite.scroll = page->spot.scroll;
+    rite.subscroll = page->spot.subscroll;
+    rite.hscroll = page->spot.hscroll;
+    rite.want = -1;
+
+    hits_reset ();
+    multi_clear ();
+    wrap_reset (rite.view);
+    rite.view->dirty = true;
+    move_row (rite.row);
+    pages_evict ();
+
+    if (page->invalid)
+        status ("not valid utf-8");
+}
+
+/* moves n pages on, or back for a negative n, going round at the ends */
+void
+pages_step (int n)
+{
+    int len = rite.pages.len;
+
+    if (len > 1)
+        pages_switch (((rite.current + n) % len + len) % len);
+}
@@ -0,0 +1,322 @@
+#define _GNU_SOURCE
+
+#include "rite.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define PIPE_IOV 0x100
+#define PIPE_CHUNK 0x10000
+#define PIPE_BURST 0x10
+#define PIPE_SIZE 0x100000
+
+/* piping lines through a shell command, whose output takes their place.
+ * the command runs alongside the editor: both ends of it are watched by
+ * the event loop, which writes to it whenever there is room and reads
+ * from it whenever there is output, so neither side waits on the other
+ * however much goes through.
+ *
+ * nothing is copied on the way in: a write is gathered straight from the
+ * text of the lines, with a shared newline between them. what comes out
+ * is cut into new lines as it arrives, and once the command is done they
+ * replace the old ones in one splice, which undo takes back in one go.
+ * a command that fails leaves the lines as they were.
+ *
+ * edits above the lines move them along, but one that touches them, or
+ * the page being cleared, stops the command, as does ctrl-g */
+
+/* starts cmd on lines [first, first + n) of page. returns -1 if it could
+ * not be started */
+int
+pipe_start (page_t *page, int first, int n, char *cmd)
+{
+    pipe_t *p = &rite.pipe;
+    int to[2], from[2], fd;
+
+    if (p->page != NULL || pipe (to))
+        return -1;
+    if (pipe (from))
+        {
+            close (to[0]), close (to[1]);
+            return -1;
+        }
+
+    if ((p->pid = fork ()) == 0)
+        {
+            signal (SIGPIPE, SIG_DFL);
+            setpgid (0, 0);
+            dup2 (to[0], STDIN_FILENO);
+            dup2 (from[1], STDOUT_FILENO);
+            if ((fd = open ("/dev/null", O_WRONLY)) >= 0)
+                dup2 (fd, STDERR_FILENO), close (fd);
+            close (to[0]), close (to[1]), close (from[0]), close (from[1]);
+            execl ("/bin/sh", "sh", "-c", cmd, (char *)NULL);
+            _exit (127);
+        }
+
+    close (to[0]), close (from[1]);
+    if (p->pid > 0)
+        setpgid (p->pid, p->pid);
+    else
+        {
+            close (to[1]), close (from[0]);
+            return -1;
+        }
+
+    p->page = page, p->in = to[1], p->out = from[0];
+    p->first = p->row = first, p->n = n, p->at = 0;
+    p->partial = p->invalid = false;
+    vector_init (&p->lines, sizeof (line_t), 0x1000);
+
+    fcntl (p->in, F_SETFL, fcntl (p->in, F_GETFL) | O_NONBLOCK);
+    fcntl (p->out, F_SETFL, fcntl (p->out, F_GETFL) | O_NONBLOCK);
+    fcntl (p->in, F_SETFD, FD_CLOEXEC);
+    fcntl (p->out, F_SETFD, FD_CLOEXEC);
+#ifdef F_SETPIPE_SZ
+    /* bigger pipes, for fewer trips between the editor and the command */
+    fcntl (p->in, F_SETPIPE_SZ, PIPE_SIZE);
+    fcntl (p->out, F_SETPIPE_SZ, PIPE_SIZE);
+#endif
+    if (watch (p->out, pipe_pull, NULL) || watch_out (p->in, pipe_push, NULL))
+        {
+            pipe_stop (page);
+            return -1;
+        }
+    return 0;
+}
+
+/* closes the command's input, so it sees the end of it */
+void
+pipe_shut ()
+{
+    if (rite.pipe.in < 0)
+        return;
+    unwatch (rite.pipe.in);
+    close (rite.pipe.in);
+    rite.pipe.in = -1;
+}
+
+/* writes the command as many of the lines as it takes, each write
+ * gathered from the lines' own text */
+bool
+pipe_push (int fd, void *data)
+{
+    static struct iovec iov[2 * PIPE_IOV];
+    static char newline[] = "\n";
+    pipe_t *p = &rite.pipe;
+    int i, k, n, row, at, len, end = p->first + p->n;
+    line_t *l;
+
+    for (i = 0; i < PIPE_BURST && p->row < end; ++i)
+        {
+            for (k = 0, row = p->row, at = p->at;
+                 row < end && k + 2 <= 2 * PIPE_IOV; ++row, at = 0)
+                {
+                    l = vector_get (&p->page->lines, row);
+                    if (at < (len = LINE_LEN (l)))
+                        {
+                            iov[k].iov_base = LINE_TEXT (l) + at;
+                            iov[k++].iov_len = len - at;
+                        }
+                    iov[k].iov_base = newline;
+                    iov[k++].iov_len = 1;
+                }
+
+            if ((n = writev (fd, iov, k)) < 0)
+                {
+                    if (errno == EAGAIN || errno == EINTR)
+                        return false;
+                    break;
+                }
+
+            /* what went out may end partway into a line */
+            while (n > 0)
+                {
+                    l = vector_get (&p->page->lines, p->row);
+                    len = LINE_LEN (l) + 1 - p->at;
+                    if (n < len)
+                        {
+                            p->at += n;
+                            break;
+                        }
+                    n -= len;
+                    p->row++, p->at = 0;
+                }
+        }
+
+    if (i < PIPE_BURST)
+        pipe_shut ();
+    return false;
+}
+
+/* cuts what the command gave into lines, the last one left partial if
+ * the output did not end in a newline */
+void
+pipe_split (char *buf, int len)
+{
+    pipe_t *p = &rite.pipe;
+    char *end = buf + len, *nl;
+    line_t *l;
+
+    while (buf < end)
+        {
+            if (p->partial)
+                l = vector_tail (&p->lines);
+            else if ((l = vector_append (&p->lines)) != NULL)
+                line_init (l);
+            else
+                return;
+
+            nl = memchr (buf, '\n', end - buf);
+            line_extend (l, buf, (nl == NULL ? end : nl) - buf);
+            p->partial = (nl == NULL);
+            buf = (nl == NULL ? end : nl + 1);
+
+            if (!p->partial && !p->invalid
+                && utf8_check (LINE_TEXT (l), LINE_LEN (l)) >= 0)
+                p->invalid = true;
+        }
+}
+
+/* reads what the command gave, a bounded burst at a time */
+bool
+pipe_pull (int fd, void *data)
+{
+    static char buf[PIPE_CHUNK];
+    int i, n = 0;
+
+    for (i = 0; i < PIPE_BURST; ++i)
+        if ((n = read (fd, buf, PIPE_CHUNK)) > 0)
+            pipe_split (buf, n);
+        else
+            break;
+
+    if (n > 0 || (n < 0 && (errno == EAGAIN || errno == EINTR)))
+        return false;
+    pipe_finish ();
+    return true;
+}
+
+/* the command is done: its output replaces the lines if it succeeded */
+void
+pipe_finish ()
+{
+    pipe_t *p = &rite.pipe;
+    page_t *page = p->page;
+    line_t *l;
+    int status = 0, m = p->lines.len;
+
+    pipe_shut ();
+    unwatch (p->out);
+    close (p->out);
+    waitpid (p->pid, &status, 0);
+    p->page = NULL;
+
+    if (!WIFEXITED (status) || WEXITSTATUS (status) != 0)
+        {
+            pipe_free ();
+            sprintf (rite.status, "command failed (%i), lines kept",
+                     WIFEXITED (status) ? WEXITSTATUS (status) : -1);
+            return;
+        }
+
+    if (p->partial && !p->invalid && (l = vector_tail (&p->lines)) != NULL
+        && utf8_check (LINE_TEXT (l), LINE_LEN (l)) >= 0)
+        p->invalid = true;
+    if (p->invalid)
+        page->invalid = true;
+
+    if (page == rite.page)
+        {
+            multi_clear ();
+            rite.selecting = false;
+        }
+    page_splice (page, p->first, p->n, p->lines.data, m);
+    vector_deinit (&p->lines);
+
+    if (page == rite.page)
+        {
+            rite.row = p->first, rite.col = 0, rite.want = -1;
+            move_row (rite.row);
+        }
+    sprintf (rite.status, "%i lines in, %i out", p->n, m);
+}
+
+/* drops the lines a command gave */
+void
+pipe_free ()
+{
+    int i;
+
+    for (i = 0; i < rite.pipe.lines.len; ++i)
+        line_deinit (vector_get (&rite.pipe.lines, i));
+    vector_deinit (&rite.pipe.lines);
+}
+
+/* stops a command running on page, or on any page if page is NULL, and
+ * drops what it gave */
+void
+pipe_stop (page_t *page)
+{
+    pipe_t *p = &rite.pipe;
+
+    if (p->page == NULL || (page != NULL && page != p->page))
+        return;
+
+    p->page = NULL;
+    kill (-p->pid, SIGKILL);
+    pipe_shut ();
+    unwatch (p->out);
+    close (p->out);
+    waitpid (p->pid, NULL, 0);
+    pipe_free ();
+    status ("command stopped");
+}
+
+/* lines [row, row + nold) of a page became nnew lines: the lines being
+ * piped move along, or if the edit touched them, the command stops */
+void
+pipe_edit (page_t *page, int row, int nold, int nnew)
+{
+    pipe_t *p = &rite.pipe;
+
+    if (page != p->page || row >= p->first + p->n)
+        return;
+
+    if (row + nold <= p->first)
+        {
+            p->first += nnew - nold;
+            p->row += nnew - nold;
+        }
+    else
+        pipe_stop (page);
+}
+
+/* pipes the selected lines, or the whole page, through cmd */
+void
+pipe_command (char *cmd)
+{
+    int first, n;
+
+    if (*cmd == '\0')
+        return;
+
+    if (rite.pipe.page != NULL)
+        {
+            status ("a command is running");
+            return;
+        }
+
+    sort_range (&first, &n);
+    if (pipe_start (rite.page, first, n, cmd))
+        status ("could not run the command");
+    else
+        status ("piping, ctrl-g stops it");
+}
@@ -0,0 +1,98 @@
+#define _DEFAULT_SOURCE
+
+#include "rite.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define POOL_MAX_THREADS 64
+
+/* a fixed set of workers, started on first use. a job is split into shards
+ * which the workers (and the calling thread) take in turn until none are
+ * left, so uneven shards still balance out */
+
+pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t pool_wake = PTHREAD_COND_INITIALIZER;
+pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;
+
+int pool_nthreads = -1;
+int pool_gen, pool_next, pool_finished, pool_shards;
+void (*pool_func) (void *data, int shard);
+void *pool_data;
+
+/* takes shards until the current job runs dry. called with the lock held */
+void
+pool_work ()
+{
+    while (pool_next < pool_shards)
+        {
+            int shard = pool_next++;
+
+            pthread_mutex_unlock (&pool_lock);
+            pool_func (pool_data, shard);
+            pthread_mutex_lock (&pool_lock);
+
+            if (++pool_finished == pool_shards)
+                pthread_cond_broadcast (&pool_done);
+        }
+}
+
+void *
+pool_worker (void *arg)
+{
+    int gen = 0;
+
+    pthread_mutex_lock (&pool_lock);
+    for (;;)
+        {
+            while (gen == pool_gen)
+                pthread_cond_wait (&pool_wake, &pool_lock);
+            gen = pool_gen;
+            pool_work ();
+        }
+
+    return NULL;
+}
+
+int
+pool_size ()
+{
+    if (pool_nthreads < 0)
+        {
+            int i;
+            pthread_t thread;
+
+            pool_nthreads = CLAMP (sysconf (_SC_NPROCESSORS_ONLN) - 1, 0,
+                                   POOL_MAX_THREADS);
+            for (i = 0; i < pool_nthreads; ++i)
+                if (pthread_create (&thread, NULL, pool_worker, NULL) == 0)
+                    pthread_detach (thread);
+                else
+                    break;
+            pool_nthreads = i;
+        }
+
+    return pool_nthreads + 1;
+}
+
+/* runs func over shards [0, shards) and returns once all have finished */
+void
+pool_run (void (*func) (void *data, int shard), void *data, int shards)
+{
+    pool_size ();
+
+    pthread_mutex_lock (&pool_lock);
+
+    pool_func = func, pool_data = data;
+    pool_next = pool_finished = 0;
+    pool_shards = shards;
+    pool_gen++;
+    pthread_cond_broadcast (&pool_wake);
+
+    pool_work ();
+    while (pool_finished < pool_shards)
+        pthread_cond_wait (&pool_done, &pool_lock);
+
+    pthread_mutex_unlock (&pool_lock);
+}
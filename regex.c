@@ -0,0 +1,818 @@
+#include "rite.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DFA_MAX_STATES 0x400
+#define DFA_TABLE_SIZE (DFA_MAX_STATES * 2)
+#define DFA_UNKNOWN -2
+#define DFA_DEAD -1
+
+#define RE_SHARD_LINES 0x400
+#define RE_GAP 0x10
+
+#define SET_ADD(s, c) ((s)[(uint8_t)(c) >> 3] |= 1 << ((uint8_t)(c)&7))
+#define SET_HAS(s, c) ((s)[(uint8_t)(c) >> 3] & (1 << ((uint8_t)(c)&7)))
+#define RE_NODE(re, i) ((re_node_t *)vector_get (&(re)->nodes, (i)))
+#define DFA_STATE(d, s) ((dfa_state_t *)(d)->states.data + (s))
+
+/* patterns are compiled to a thompson nfa, which is turned into a dfa
+ * lazily: a dfa state is the set of nfa nodes that are live, and its
+ * transitions are worked out the first time each byte is seen. when the
+ * cache fills up it is thrown away and rebuilt as needed.
+ *
+ * supported: literals, ., [classes], [^classes], \d \w \s (and negations),
+ * *, +, ?, |, (groups), and ^ / $ at the very start / end of the pattern.
+ * matches never span lines, and are leftmost-longest.
+ *
+ * a match is not looked for from every place in turn, which costs the
+ * square of the line for a pattern like .*x. the pattern is also compiled
+ * reversed, behind a loop taking anything, and one pass of that back over
+ * the line marks every place a match starts. the match is then run
+ * forward from the first mark, once */
+
+typedef struct
+{
+    int row;
+    line_t line;
+} re_edit_t;
+
+typedef struct
+{
+    page_t *page;
+    char *with;
+    int shards, *counts;
+    vector_t *edits;
+} re_job_t;
+
+int re_alt (re_t *re, char **p, int *s, int *e);
+
+int
+re_new (re_t *re, int type)
+{
+    re_node_t *n = vector_append (&re->nodes);
+    memset (n, 0, sizeof (re_node_t));
+    n->type = type;
+    n->out[0] = n->out[1] = -1;
+    return re->nodes.len - 1;
+}
+
+/* adds the shorthand class after a backslash to set, or returns false */
+bool
+re_shorthand (uint8_t *set, char c)
+{
+    int i;
+    bool neg = (isupper (c) != 0);
+
+    switch (tolower (c))
+        {
+        case 'd':
+            for (i = 0; i < 256; ++i)
+                if ((isdigit (i) != 0) != neg)
+                    SET_ADD (set, i);
+            return true;
+        case 'w':
+            for (i = 0; i < 256; ++i)
+                if ((isalnum (i) || i == '_') != neg)
+                    SET_ADD (set, i);
+            return true;
+        case 's':
+            for (i = 0; i < 256; ++i)
+                if ((isspace (i) != 0) != neg)
+                    SET_ADD (set, i);
+            return true;
+        }
+
+    return false;
+}
+
+char
+re_escape (char c)
+{
+    switch (c)
+        {
+        case 't':
+            return '\t';
+        case 'n':
+            return '\n';
+        default:
+            return c;
+        }
+}
+
+int
+re_class (re_t *re, char **p, uint8_t *set)
+{
+    uint8_t tmp[32];
+    bool neg = false, first = true;
+    int i;
+
+    memset (tmp, 0, sizeof (tmp));
+
+    if (**p == '^')
+        neg = true, (*p)++;
+
+    for (; **p != '\0' && (**p != ']' || first); first = false)
+        {
+            char lo = *(*p)++, hi;
+
+            if (lo == '\\' && **p != '\0')
+                {
+                    if (re_shorthand (tmp, **p))
+                        {
+                            (*p)++;
+                            continue;
+                        }
+                    lo = re_escape (*(*p)++);
+                }
+
+            hi = lo;
+            if ((*p)[0] == '-' && (*p)[1] != ']' && (*p)[1] != '\0')
+                {
+                    (*p)++;
+                    hi = *(*p)++;
+                    if (hi == '\\' && **p != '\0')
+                        hi = re_escape (*(*p)++);
+                }
+
+            for (i = (uint8_t)lo; i <= (uint8_t)hi; ++i)
+                SET_ADD (tmp, i);
+        }
+
+    if (**p != ']')
+        {
+            re->error = "unterminated [";
+            return -1;
+        }
+    (*p)++;
+
+    for (i = 0; i < 32; ++i)
+        set[i] = neg ? ~tmp[i] : tmp[i];
+    return 0;
+}
+
+int
+re_atom (re_t *re, char **p, int *s, int *e)
+{
+    uint8_t set[32];
+    char c = *(*p)++;
+
+    memset (set, 0, sizeof (set));
+
+    switch (c)
+        {
+        case '(':
+            if (re_alt (re, p, s, e))
+                return -1;
+            if (**p != ')')
+                {
+                    re->error = "unmatched (";
+                    return -1;
+                }
+            (*p)++;
+            return 0;
+
+        case '*':
+        case '+':
+        case '?':
+            re->error = "nothing to repeat";
+            return -1;
+
+        case '[':
+            if (re_class (re, p, set))
+                return -1;
+            break;
+
+        case '.':
+            memset (set, 0xff, sizeof (set));
+            break;
+
+        case '\\':
+            if (**p == '\0')
+                {
+                    re->error = "trailing \\";
+                    return -1;
+                }
+            c = *(*p)++;
+            if (!re_shorthand (set, c))
+                SET_ADD (set, re_escape (c));
+            break;
+
+        default:
+            SET_ADD (set, c);
+            break;
+        }
+
+    *s = re_new (re, RE_SET);
+    *e = re_new (re, RE_EPS);
+    memcpy (RE_NODE (re, *s)->set, set, sizeof (set));
+    RE_NODE (re, *s)->out[0] = *e;
+    return 0;
+}
+
+int
+re_repeat (re_t *re, char **p, int *s, int *e)
+{
+    int split, end;
+
+    if (re_atom (re, p, s, e))
+        return -1;
+
+    while (**p == '*' || **p == '+' || **p == '?')
+        {
+            end = re_new (re, RE_EPS);
+            switch (*(*p)++)
+                {
+                case '*':
+                    split = re_new (re, RE_EPS);
+                    RE_NODE (re, split)->out[0] = *s;
+                    RE_NODE (re, split)->out[1] = end;
+                    RE_NODE (re, *e)->out[0] = *s;
+                    RE_NODE (re, *e)->out[1] = end;
+                    *s = split;
+                    break;
+                case '+':
+                    RE_NODE (re, *e)->out[0] = *s;
+                    RE_NODE (re, *e)->out[1] = end;
+                    break;
+                case '?':
+                    split = re_new (re, RE_EPS);
+                    RE_NODE (re, split)->out[0] = *s;
+                    RE_NODE (re, split)->out[1] = end;
+                    RE_NODE (re, *e)->out[0] = end;
+                    *s = split;
+                    break;
+                }
+            *e = end;
+        }
+
+    return 0;
+}
+
+int
+re_concat (re_t *re, char **p, int *s, int *e)
+{
+    int s2, e2;
+
+    /* reversed, each piece goes before the ones already there */
+    *s = *e = re_new (re, RE_EPS);
+    while (**p != '\0' && **p != '|' && **p != ')')
+        {
+            if (re_repeat (re, p, &s2, &e2))
+                return -1;
+            if (re->rev)
+                {
+                    RE_NODE (re, e2)->out[0] = *s;
+                    *s = s2;
+                }
+            else
+                {
+                    RE_NODE (re, *e)->out[0] = s2;
+                    *e = e2;
+                }
+        }
+
+    return 0;
+}
+
+int
+re_alt (re_t *re, char **p, int *s, int *e)
+{
+    int s2, e2, split, join;
+
+    if (re_concat (re, p, s, e))
+        return -1;
+
+    while (**p == '|')
+        {
+            (*p)++;
+            if (re_concat (re, p, &s2, &e2))
+                return -1;
+
+            split = re_new (re, RE_EPS);
+            join = re_new (re, RE_EPS);
+            RE_NODE (re, split)->out[0] = *s;
+            RE_NODE (re, split)->out[1] = s2;
+            RE_NODE (re, *e)->out[0] = join;
+            RE_NODE (re, e2)->out[0] = join;
+            *s = split, *e = join;
+        }
+
+    return 0;
+}
+
+int
+re_compile (re_t *re, char *pattern)
+{
+    char buf[PROMPT_MAX], *p = buf, *from;
+    int len, slashes, any, loop;
+
+    re_free (re);
+    vector_init (&re->nodes, sizeof (re_node_t), 0x20);
+    re->error = NULL;
+    strncpy (re->str, pattern, PROMPT_MAX - 1);
+    re->str[PROMPT_MAX - 1] = '\0';
+    strcpy (buf, re->str);
+    len = strlen (buf);
+
+    if ((re->bol = (buf[0] == '^')))
+        p++;
+
+    /* a trailing $ anchors, unless it is escaped */
+    for (slashes = 0; len - 2 - slashes >= 0 && buf[len - 2 - slashes] == '\\';
+         ++slashes)
+        ;
+    if ((re->eol = (len > 0 && buf[len - 1] == '$' && slashes % 2 == 0)))
+        buf[len - 1] = '\0';
+
+    from = p;
+    if (re_alt (re, &p, &re->start, &re->accept))
+        return -1;
+
+    if (*p != '\0')
+        {
+            re->error = "unmatched )";
+            return -1;
+        }
+
+    /* again reversed, behind a loop taking anything unless the match has
+     * to end at the end of the line, where the pass back starts */
+    p = from;
+    re->rev = true;
+    re_alt (re, &p, &re->rstart, &re->raccept);
+    re->rev = false;
+    if (!re->eol)
+        {
+            any = re_new (re, RE_SET);
+            loop = re_new (re, RE_EPS);
+            memset (RE_NODE (re, any)->set, 0xff, 32);
+            RE_NODE (re, any)->out[0] = loop;
+            RE_NODE (re, loop)->out[0] = any;
+            RE_NODE (re, loop)->out[1] = re->rstart;
+            re->rstart = loop;
+        }
+
+    return 0;
+}
+
+void
+re_free (re_t *re)
+{
+    vector_deinit (&re->nodes);
+}
+
+/* adds the epsilon closure of node n to the working list */
+void
+dfa_close (dfa_t *d, int n)
+{
+    int sp = 0;
+
+    d->stack[sp++] = n;
+    while (sp > 0)
+        {
+            re_node_t *node;
+
+            if ((n = d->stack[--sp]) < 0 || d->mark[n] == d->gen)
+                continue;
+            d->mark[n] = d->gen;
+
+            node = RE_NODE (d->re, n);
+            if (node->type == RE_SET || n == d->accept)
+                d->list[d->nlist++] = n;
+            if (node->type == RE_EPS)
+                {
+                    d->stack[sp++] = node->out[1];
+                    d->stack[sp++] = node->out[0];
+                }
+        }
+}
+
+int
+dfa_compare (const void *a, const void *b)
+{
+    return *(int *)a - *(int *)b;
+}
+
+uint32_t
+dfa_hash (int *list, int n)
+{
+    uint32_t h = 2166136261u;
+    int i;
+    for (i = 0; i < n; ++i)
+        h = (h ^ list[i]) * 16777619u;
+    return h;
+}
+
+void
+dfa_flush (dfa_t *d)
+{
+    d->states.len = d->sets.len = 0;
+    memset (d->table, 0, DFA_TABLE_SIZE * sizeof (int));
+    d->flushes++;
+    d->start = dfa_add (d, d->startset, d->nstart);
+}
+
+/* finds or makes the state for a list of nfa nodes */
+int
+dfa_add (dfa_t *d, int *list, int n)
+{
+    dfa_state_t *st;
+    uint32_t h;
+    int i;
+
+    qsort (list, n, sizeof (int), dfa_compare);
+
+    for (h = dfa_hash (list, n) % DFA_TABLE_SIZE; d->table[h];
+         h = (h + 1) % DFA_TABLE_SIZE)
+        {
+            st = vector_get (&d->states, d->table[h] - 1);
+            if (st->len == n
+                && memcmp (vector_get (&d->sets, st->set), list,
+                           n * sizeof (int))
+                       == 0)
+                return d->table[h] - 1;
+        }
+
+    if (d->states.len == DFA_MAX_STATES)
+        {
+            dfa_flush (d);
+            return dfa_add (d, list, n);
+        }
+
+    st = vector_append (&d->states);
+    st->set = d->sets.len, st->len = n;
+    st->accept = false;
+    for (i = 0; i < 256; ++i)
+        st->next[i] = DFA_UNKNOWN;
+    for (i = 0; i < n; ++i)
+        {
+            *(int *)vector_append (&d->sets) = list[i];
+            if (list[i] == d->accept)
+                st->accept = true;
+        }
+
+    d->table[h] = d->states.len;
+    return d->states.len - 1;
+}
+
+/* a dfa for the nfa from node first to accept */
+void
+dfa_setup (dfa_t *d, re_t *re, int first, int accept)
+{
+    int n = re->nodes.len;
+
+    memset (d, 0, sizeof (dfa_t));
+    d->re = re;
+    d->accept = accept;
+    vector_init (&d->states, sizeof (dfa_state_t), 0x10);
+    vector_init (&d->sets, sizeof (int), 0x100);
+    d->table = calloc (DFA_TABLE_SIZE, sizeof (int));
+    d->mark = calloc (n, sizeof (int));
+    d->stack = malloc ((2 * n + 1) * sizeof (int));
+    d->list = malloc ((n + 1) * sizeof (int));
+
+    d->gen++;
+    dfa_close (d, first);
+    d->nstart = d->nlist;
+    d->startset = malloc ((d->nlist + 1) * sizeof (int));
+    memcpy (d->startset, d->list, d->nlist * sizeof (int));
+    d->start = dfa_add (d, d->startset, d->nstart);
+}
+
+/* a dfa for the pattern, and unless it is anchored at the start of the
+ * line, one for it reversed */
+void
+dfa_init (dfa_t *d, re_t *re)
+{
+    dfa_setup (d, re, re->start, re->accept);
+    if (!re->bol && (d->back = malloc (sizeof (dfa_t))) != NULL)
+        dfa_setup (d->back, re, re->rstart, re->raccept);
+}
+
+void
+dfa_deinit (dfa_t *d)
+{
+    if (d->back != NULL)
+        {
+            dfa_deinit (d->back);
+            free (d->back);
+        }
+    free (d->starts);
+    vector_deinit (&d->states);
+    vector_deinit (&d->sets);
+    free (d->table);
+    free (d->mark);
+    free (d->stack);
+    free (d->list);
+    free (d->startset);
+}
+
+int
+dfa_step (dfa_t *d, int s, uint8_t c)
+{
+    dfa_state_t *st = DFA_STATE (d, s);
+    int i, next, flushes = d->flushes;
+
+    if (st->next[c] != DFA_UNKNOWN)
+        return st->next[c];
+
+    d->gen++;
+    d->nlist = 0;
+    for (i = 0; i < st->len; ++i)
+        {
+            re_node_t *n = RE_NODE (d->re, *(int *)vector_get (&d->sets,
+                                                                st->set + i));
+            if (n->type == RE_SET && SET_HAS (n->set, c))
+                dfa_close (d, n->out[0]);
+        }
+
+    if (d->nlist == 0)
+        next = DFA_DEAD;
+    else if ((next = dfa_add (d, d->list, d->nlist)), d->flushes != flushes)
+        return next;
+
+    DFA_STATE (d, s)->next[c] = next;
+    return next;
+}
+
+bool
+dfa_accepts (dfa_t *d, int s, int at, int len)
+{
+    return DFA_STATE (d, s)->accept && (!d->re->eol || at == len);
+}
+
+/* the length of the longest match at from, or -1 */
+int
+dfa_longest (dfa_t *d, char *s, int n, int from)
+{
+    int j, st = d->start, last = dfa_accepts (d, st, from, n) ? from : -1;
+
+    for (j = from; j < n; ++j)
+        {
+            /* the cached transition, without a call in the common case */
+            int next = DFA_STATE (d, st)->next[(uint8_t)s[j]];
+            if (next == DFA_UNKNOWN)
+                next = dfa_step (d, st, s[j]);
+            if ((st = next) == DFA_DEAD)
+                break;
+            if (DFA_STATE (d, st)->accept && (!d->re->eol || j + 1 == n))
+                last = j + 1;
+        }
+    return last < 0 ? -1 : last - from;
+}
+
+/* marks the places in s a match starts at, going back over it once with
+ * the reversed pattern */
+void
+dfa_starts (dfa_t *d, char *s, int n)
+{
+    dfa_t *b = d->back;
+    int j, st = b->start;
+    uint8_t *p;
+
+    if (n + 1 > d->cap)
+        {
+            if ((p = realloc (d->starts, n + 1)) == NULL)
+                return;
+            d->starts = p, d->cap = n + 1;
+        }
+    memset (d->starts, 0, n + 1);
+    d->text = s, d->len = n;
+
+    d->starts[n] = DFA_STATE (b, st)->accept;
+    for (j = n - 1; j >= 0; --j)
+        {
+            int next = DFA_STATE (b, st)->next[(uint8_t)s[j]];
+            if (next == DFA_UNKNOWN)
+                next = dfa_step (b, st, s[j]);
+            if ((st = next) == DFA_DEAD)
+                break;
+            d->starts[j] = DFA_STATE (b, st)->accept;
+        }
+}
+
+/* leftmost-longest match in s[from, n), returning its start and length.
+ * the starts of a line are marked on the first call on it and kept for
+ * the calls after, which go on along the same line, so the line must not
+ * change in between */
+int
+dfa_match (dfa_t *d, char *s, int n, int from, int *len)
+{
+    int i;
+
+    if (d->re->bol)
+        return from == 0 && (*len = dfa_longest (d, s, n, 0)) >= 0 ? 0 : -1;
+    if (d->back == NULL)
+        return -1;
+
+    if (d->text != s || d->len != n || d->starts == NULL)
+        dfa_starts (d, s, n);
+    if (d->text != s || d->len != n)
+        return -1;
+
+    for (i = from; i <= n; ++i)
+        if (d->starts[i] && (*len = dfa_longest (d, s, n, i)) >= 0)
+            return i;
+    return -1;
+}
+
+/* appends the replacement to a line, with \0 standing for the match */
+void
+re_expand (line_t *line, char *with, char *match, int len)
+{
+    char *p;
+
+    for (p = with; *p != '\0'; ++p)
+        {
+            char *q = strchr (p, '\\');
+
+            if (q == NULL)
+                q = p + strlen (p);
+            line_extend (line, p, q - p);
+            if ((p = q)[0] == '\0')
+                break;
+
+            if (p[1] == '0')
+                line_extend (line, match, len), p++;
+            else if (p[1] != '\0')
+                line_extend (line, ++p, 1);
+        }
+}
+
+/* matches and rebuilds the lines of one shard. the page is only read here,
+ * the rebuilt lines are swapped in afterwards on the main thread */
+void
+re_replace_shard (void *data, int shard)
+{
+    re_job_t *job = data;
+    vector_t *edits = &job->edits[shard];
+    int row, lines = job->page->lines.len;
+    int first = (long)lines * shard / job->shards;
+    int last = (long)lines * (shard + 1) / job->shards;
+    dfa_t d;
+
+    dfa_init (&d, &rite.re);
+    vector_init (edits, sizeof (re_edit_t), 0x10);
+    job->counts[shard] = 0;
+
+    for (row = first; row < last; ++row)
+        {
+            line_t *l = vector_get (&job->page->lines, row);
+            char *text = LINE_TEXT (l);
+            int len = LINE_LEN (l), at = 0, prev = 0, m, mlen;
+            re_edit_t *e = NULL;
+
+            while (at <= len && (m = dfa_match (&d, text, len, at, &mlen)) >= 0)
+                {
+                    if (e == NULL)
+                        {
+                            e = vector_append (edits);
+                            e->row = row;
+                            line_init (&e->line);
+                        }
+                    line_extend (&e->line, text + prev, m - prev);
+                    re_expand (&e->line, job->with, text + m, mlen);
+                    job->counts[shard]++;
+                    prev = m + mlen;
+                    at = prev + (mlen == 0);
+                }
+
+            if (e != NULL)
+                line_extend (&e->line, text + prev, len - prev);
+        }
+
+    dfa_deinit (&d);
+}
+
+/* splices in the lines of a run of edits, from row first */
+void
+re_flush (page_t *page, vector_t *run, int first)
+{
+    if (run->len == 0)
+        return;
+    page_splice (page, first, run->len, run->data, run->len);
+    run->len = 0;
+}
+
+/* replaces every match in the page as one undoable change. matching and
+ * rebuilding run in parallel over shards of lines, then the new lines are
+ * swapped in, in line order. edits a few lines apart at most go in as one
+ * splice, the lines between them shared rather than copied, so the work
+ * every splice sets off is done once a run rather than once a line */
+int
+re_replace (page_t *page, char *with)
+{
+    re_job_t job;
+    int i, j, row, first = 0, next = 0, count = 0;
+    vector_t run;
+    line_t *l, *nl;
+
+    job.page = page, job.with = with;
+    job.shards = MAX (1, MIN (pool_size () * 4,
+                              page->lines.len / RE_SHARD_LINES));
+    job.edits = malloc (job.shards * sizeof (vector_t));
+    job.counts = malloc (job.shards * sizeof (int));
+
+    pool_run (re_replace_shard, &job, job.shards);
+
+    vector_init (&run, sizeof (line_t), 0x1000);
+    undo_begin (page);
+    for (i = 0; i < job.shards; ++i)
+        {
+            for (j = 0; j < job.edits[i].len; ++j)
+                {
+                    re_edit_t *e = vector_get (&job.edits[i], j);
+
+                    if (run.len > 0 && e->row - next > RE_GAP)
+                        re_flush (page, &run, first);
+                    if (run.len == 0)
+                        first = next = e->row;
+                    for (row = next; row < e->row; ++row)
+                        {
+                            l = vector_get (&page->lines, row);
+                            line_init (nl = vector_append (&run));
+                            if (LINE_TEXT (l) == NULL)
+                                continue;
+                            nl->text = l->text;
+                            share_ref (l);
+                            nl->shared = true;
+                        }
+                    *(line_t *)vector_append (&run) = e->line;
+                    next = e->row + 1;
+                }
+            vector_deinit (&job.edits[i]);
+            count += job.counts[i];
+        }
+    re_flush (page, &run, first);
+    undo_end (page);
+    vector_deinit (&run);
+
+    free (job.edits);
+    free (job.counts);
+
+    if (rite.page == page)
+        move_row (rite.row);
+    return count;
+}
+
+/* moves the cursor to the next match after it, wrapping at the end */
+bool
+re_find (page_t *page)
+{
+    int i, m, len, lines = page->lines.len;
+    dfa_t d;
+
+    if (lines == 0)
+        return false;
+
+    dfa_init (&d, &rite.re);
+    for (i = 0; i <= lines; ++i)
+        {
+            int row = (rite.row + i) % lines;
+            line_t *l = vector_get (&page->lines, row);
+            int from = (i == 0 ? rite.col + 1 : 0);
+
+            if (from > LINE_LEN (l))
+                continue;
+            if ((m = dfa_match (&d, LINE_TEXT (l), LINE_LEN (l), from, &len))
+                >= 0)
+                {
+                    rite.col = m;
+                    move_row (row);
+                    break;
+                }
+        }
+    dfa_deinit (&d);
+
+    return i <= lines;
+}
+
+void
+regex_find (char *str)
+{
+    if (re_compile (&rite.re, str))
+        status (rite.re.error);
+    else if (!re_find (rite.page))
+        status ("no match");
+}
+
+void
+regex_with (char *str)
+{
+    if (re_compile (&rite.re, str))
+        status (rite.re.error);
+    else
+        prompt ("with: ", rite.with, regex_replace);
+}
+
+void
+regex_replace (char *str)
+{
+    char msg[64];
+
+    strncpy (rite.with, str, PROMPT_MAX - 1);
+    sprintf (msg, "replaced %i", re_replace (rite.page, rite.with));
+    status (msg);
+}
@@ -1,14 +1,36 @@
+#define _DEFAULT_SOURCE
+
 #include "rite.h"
 
 #include <ctype.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
 
 #define LINE_MEMORY_PADDING 0x10
 
+#define FOLLOW_CHUNK 0x10000
+#define FOLLOW_INTERVAL 250
+#define STREAM_BURST 0x10
+
+
 #define HI_FG TERM_RED
 #define HI_BG TERM_WHITE
+#define FIND_BG TERM_YELLOW
+#define SELECT_BG TERM_CYAN
+#define WHEEL_ROWS 3
+#define FOLD_FG TERM_BLUE
+#define ADDED_FG TERM_GREEN
+#define CHANGED_FG TERM_YELLOW
+#define LOST_FG TERM_RED
+#define MATCH_BG TERM_MAGENTA
+#define FIND_MARKS 0x40
 
 void
 vector_init (vector_t *vec, int itemsize, int pad)
@@ -62,7 +84,14 @@ vector_resize (vector_t *vec)
             vec->data = NULL;
             vec->len = vec->size = 0;
         }
-    else if (vec->size < vec->len || vec->len < vec->size - vec->pad)
+    else if (vec->size < vec->len)
+        {
+            /* grow geometrically, so appending n items costs O(n) copies */
+            vec->size = MAX (vec->pad * (1 + vec->len / vec->pad),
+                             vec->size + vec->size / 2);
+            vec->data = realloc (vec->data, vec->size * vec->itemsize);
+        }
+    else if (vec->len < vec->size - vec->pad && vec->len < vec->size / 2)
         {
             vec->size = vec->pad * (1 + vec->len / vec->pad);
             vec->data = realloc (vec->data, vec->size * vec->itemsize);
@@ -122,6 +151,33 @@ vector_remove (vector_t *vec, int i)
         }
 }
 
+/* removes nremove items at i and opens a gap of ninsert in their place,
+ * with a single memmove of the tail */
+void *
+vector_splice (vector_t *vec, int i, int nremove, int ninsert)
+{
+    int tail = vec->len - i - nremove;
+
+    if (ninsert > nremove)
+        {
+            vec->len += ninsert - nremove;
+            vector_resize (vec);
+        }
+
+    if (tail > 0 && ninsert != nremove)
+        memmove ((char *)vec->data + vec->itemsize * (i + ninsert),
+                 (char *)vec->data + vec->itemsize * (i + nremove),
+                 vec->itemsize * tail);
+
+    if (ninsert < nremove)
+        {
+            vec->len -= nremove - ninsert;
+            vector_resize (vec);
+        }
+
+    return ninsert > 0 ? vector_get (vec, i) : NULL;
+}
+
 void
 vector_split (vector_t *dest, vector_t *src, int i)
 {
@@ -163,64 +219,85 @@ int
 main (int argc, char *argv[])
 {
     event_t evt;
+    bool follow = false;
+    char *sock = NULL;
+    int i;
 
     if (term_init ())
         return -1;
 
-    rite.page = malloc (sizeof (page_t));
-    page_read (rite.page, "test");
+    vector_init (&rite.watches, sizeof (watch_t), 0x4);
+    vector_init (&rite.pages, sizeof (page_t *), 0x10);
+    vector_init (&rite.cursors, sizeof (cursor_t), 0x100);
+    vector_init (&rite.clip.spans, sizeof (span_t), 0x100);
+    table_init (&rite.clip.shares, sizeof (share_t), 0x100, share_item,
+                share_same);
+    views_init (NULL);
+    hits_reset ();
+    word_init ();
+    dict_init ();
+    rite.want = -1;
+
+    /* pages are only read when first shown, so any number open at once */
+    for (i = 1; i < argc; ++i)
+        if (strcmp (argv[i], "-f") == 0)
+            follow = true;
+        else if (strcmp (argv[i], "-s") == 0 && i + 1 < argc)
+            sock = argv[++i];
+        else if (strcmp (argv[i], "-") == 0)
+            page_stream (pages_add (NULL), STDIN_FILENO);
+        else
+            pages_add (argv[i]);
+
+    if (rite.pages.len == 0 && !isatty (STDIN_FILENO))
+        page_stream (pages_add (NULL), STDIN_FILENO);
+    else if (rite.pages.len == 0)
+        pages_add ("test");
+
+    pages_switch (0);
+    if (follow)
+        page_follow (rite.page, true);
     move_row (rite.row), move_col (rite.col);
     term_cursor_show (false);
 
-    status ("howdy!");
+    status (rite.page->invalid ? "not valid utf-8" : "howdy!");
+    rite.ctl.fd = -1;
+    if (sock != NULL)
+        ctl_listen (sock);
     draw ();
-    while (term_poll (&evt))
+    while ((term_timeout = idle_timeout ()), term_poll (&evt))
         {
             switch (evt.type)
                 {
                 case RITE_EVENT_KEY:
-                    if (evt.u.k >= 128)
-                        {
-                            evt.u.k -= 128;
-                            switch (evt.u.k)
-                                {
-                                case RITE_KEY_UP:
-                                    move_row (rite.row - 1);
-                                    break;
-                                case RITE_KEY_DOWN:
-                                    move_row (rite.row + 1);
-                                    break;
-                                case RITE_KEY_LEFT:
-                                    if (RITE_MOD_GET (evt.mods, RITE_MOD_CTRL))
-                                        jump_back ();
-                                    else
-                                        move_col (rite.col - 1);
-                                    break;
-                                case RITE_KEY_RIGHT:
-                                    if (RITE_MOD_GET (evt.mods, RITE_MOD_CTRL))
-                                        jump_forward ();
-                                    else
-                                        move_col (rite.col + 1);
-                                    break;
-                                case RITE_KEY_BACKSPACE:
-                                    erase ();
-                                    break;
-                                case RITE_KEY_END:
-                                    end ();
-                                    break;
-                                case RITE_KEY_HOME:
-                                    home ();
-                                    break;
-                                case RITE_KEY_ENTER:
-                                    enter ();
-                                    break;
-                                }
-                        }
-                    else if (evt.u.k == 's'
-                             && RITE_MOD_GET (evt.mods, RITE_MOD_CTRL))
-                        page_write (rite.page);
-                    else if (isprint (evt.u.k))
-                        type (evt.u.k);
+                case RITE_EVENT_TEXT:
+                    macro_record (&evt);
+                    handle (&evt);
+                    break;
+
+                case RITE_EVENT_MOUSE:
+                    handle (&evt);
+                    break;
+
+                case RITE_EVENT_FD:
+                    {
+                        watch_t *w = NULL;
+                        for (i = 0; i < rite.watches.len; ++i)
+                            if ((w = vector_get (&rite.watches, i))->fd
+                                == evt.u.fd)
+                                break;
+                        if (i == rite.watches.len || !w->func (w->fd, w->data))
+                            continue;
+                    }
+                    break;
+
+                case RITE_EVENT_NONE:
+                    if (!idle ())
+                        continue;
+                    break;
+
+                case RITE_EVENT_RESIZED:
+                    rite.repaint = true;
                     break;
 
                 default:
@@ -232,8 +309,16 @@ main (int argc, char *argv[])
         }
 
     term_cursor_show (true);
-    page_deinit (rite.page);
-    free (rite.page);
+    codec_wait ();
+    ctl_close ();
+    views_free ();
+    pages_free ();
+    clip_free ();
+    re_free (&rite.re);
+    rite.find.len = 0;
+    hits_reset ();
+    vector_deinit (&rite.watches);
+    vector_deinit (&rite.macro.events);
     term_deinit ();
     return 0;
 }
@@ -248,6 +333,8 @@ line_init (line_t *line)
 void
 line_deinit (line_t *line)
 {
+    share_drop (line);
+    layout_drop (line);
     vector_deinit (&line->text);
     memset (line, 0, sizeof (line_t));
 }
@@ -255,16 +342,35 @@ line_deinit (line_t *line)
 void
 line_read (page_t *page, line_t *line, int start, int end)
 {
-    line->text.len = end - start + 1;
+    share_own (line);
+    line->text.len = 0;
+    vector_resize (&line->text);
+    line_extend (line, page->text + start, end - start);
+}
 
-    if (line->text.len > 1)
-        {
-            vector_resize (&line->text);
-            strncpy (line->text.data, page->text + start, line->text.len - 1);
-            line_print (line);
-        }
-    else
-        line->text.len = 0;
+void
+line_extend (line_t *line, char *str, int len)
+{
+    int at = MAX (line->text.len - 1, 0);
+    char *text;
+
+    if (len <= 0)
+        return;
+
+    share_own (line);
+    line->text.len = at + len + 1;
+    vector_resize (&line->text);
+
+    text = vector_head (&line->text);
+    memcpy (text + at, str, len);
+    text[at + len] = '\0';
+}
+
+void
+line_copy (line_t *dest, line_t *src)
+{
+    line_init (dest);
+    line_extend (dest, LINE_TEXT (src), LINE_LEN (src));
 }
 
 void
@@ -283,15 +389,21 @@ void
 page_init (page_t *page)
 {
     memset (page, 0, sizeof (page_t));
+    vector_init (&page->lines, sizeof (line_t), 0x10);
+    vector_init (&page->undo, sizeof (undo_t), 0x10);
+    vector_init (&page->folds, sizeof (fold_t), 0x10);
+    stats_clear (page);
+    match_clear (page);
+    page->fd = page->notify = -1;
 }
 
 void
 page_deinit (page_t *page)
 {
-    int i;
-    for (i = 0; i < page->lines.len; ++i)
-        line_deinit (vector_get (&page->lines, i));
+    page_close (page);
+    page_clear (page);
     vector_deinit (&page->lines);
+    vector_deinit (&page->folds);
 
     if (page->name != NULL)
         free (page->name);
@@ -302,21 +414,94 @@ page_deinit (page_t *page)
     memset (page, 0, sizeof (page_t));
 }
 
+void
+page_clear (page_t *page)
+{
+    int i;
+    page_editing (page, 0, page->lines.len);
+    for (i = 0; i < page->lines.len; ++i)
+        line_deinit (vector_get (&page->lines, i));
+    page->lines.len = 0;
+    vector_resize (&page->lines);
+    undo_clear (page);
+    fold_clear (page);
+    diff_stop (page);
+    pipe_stop (page);
+    stats_clear (page);
+    match_clear (page);
+    if (page == rite.page)
+        hits_reset ();
+    views_reset (page);
+
+    page->len = page->lexed = page->counted = 0;
+    page->partial = page->invalid = false;
+}
+
+/* splits buf into lines and appends them to the page. a trailing run
+ * without a newline stays "partial", and is extended by the next call */
+void
+page_ingest (page_t *page, char *buf, int len)
+{
+    char *end = buf + len, *nl;
+    int row = page->lines.len - (page->partial ? 1 : 0);
+    int nold = page->lines.len - row;
+
+    page_editing (page, row, nold);
+    page->len += len;
+
+    while (buf < end)
+        {
+            line_t *l;
+
+            if (page->partial)
+                l = vector_tail (&page->lines);
+            else if ((l = vector_append (&page->lines)) != NULL)
+                line_init (l);
+            else
+                return;
+
+            nl = memchr (buf, '\n', end - buf);
+            line_extend (l, buf, (nl == NULL ? end : nl) - buf);
+            page->partial = (nl == NULL);
+            buf = (nl == NULL ? end : nl + 1);
+
+            /* checked once whole, as a sequence may span two reads */
+            if (!page->partial && !page->invalid
+                && utf8_check (LINE_TEXT (l), LINE_LEN (l)) >= 0)
+                page->invalid = true;
+        }
+
+    page_edited (page, row, nold, page->lines.len - row);
+}
+
+/* reads a file into a page, which keeps its name, cursor and viewport. a
+ * file that is not there yet reads as empty */
 int
 page_read (page_t *page, char *filename)
 {
     int len = 0;
     FILE *f = fopen (filename, "r");
-    if (f == NULL)
-        return -1;
 
-    page_init (page);
+    page_clear (page);
+    page->loaded = true;
+    page->syntax = hl_detect (filename);
 
-    page->name = malloc (strlen (filename) + 1);
-    strncpy (page->name, filename, strlen (filename));
-    page->name[strlen (filename)] = '\0';
+    if (page->name != filename)
+        {
+            free (page->name);
+            page->name = malloc (strlen (filename) + 1);
+            strcpy (page->name, filename);
+        }
+
+    page->codec = codec_detect (f, filename);
+    if (f == NULL)
+        return -1;
 
-    printf ("page: \"%s\"\n", page->name);
+    if (page->codec != NULL)
+        {
+            fclose (f);
+            return codec_open (page);
+        }
 
     fseek (f, 0, SEEK_END);
     len = ftell (f);
@@ -324,30 +509,74 @@ page_read (page_t *page, char *filename)
 
     if (len)
         {
-            int i, start;
-
+            free (page->text);
             page->text = malloc (len);
-            fread (page->text, 1, len, f);
-
-            vector_init (&page->lines, sizeof (line_t), 0x10);
-
-            for (i = 0, start = 0; i < len; ++i)
-                if (page->text[i] == '\n')
-                    {
-                        line_t *l = vector_append (&page->lines);
-                        if (l != NULL)
-                            {
-                                line_init (l);
-                                line_read (page, l, start, i);
-                            }
-                        start = i + 1;
-                    }
+            len = fread (page->text, 1, len, f);
+            page_ingest (page, page->text, len);
         }
 
     fclose (f);
     return 0;
 }
 
+/* reads a pipe or stdin in the background. whatever has arrived is shown
+ * straight away, and the rest is pulled in by page_pull as it comes */
+int
+page_stream (page_t *page, int fd)
+{
+    page_close (page);
+    page_clear (page);
+
+    if (fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK) < 0
+        || watch (fd, page_pull, page))
+        return -1;
+
+    page->fd = fd;
+    page->loaded = true;
+    return 0;
+}
+
+bool
+page_pull (int fd, void *data)
+{
+    static char buf[FOLLOW_CHUNK];
+    page_t *page = data;
+    int i, n = 0;
+
+    /* a bounded burst per wakeup, so keys are still handled mid-stream */
+    for (i = 0; i < STREAM_BURST; ++i)
+        if ((n = read (fd, buf, FOLLOW_CHUNK)) > 0)
+            page_ingest (page, buf, n);
+        else
+            break;
+
+    if (n == 0)
+        page_close (page);
+
+    if (rite.page == page)
+        move_row (rite.row);
+
+    return i > 0 || n == 0;
+}
+
+void
+page_close (page_t *page)
+{
+    if (page->notify >= 0)
+        {
+            unwatch (page->notify);
+            close (page->notify);
+        }
+    if (page->fd >= 0)
+        {
+            unwatch (page->fd);
+            close (page->fd);
+        }
+    codec_reap (page);
+    page->fd = page->notify = -1;
+    page->follow = false;
+}
+
 int
 page_write (page_t *page)
 {
@@ -356,6 +585,9 @@ page_write (page_t *page)
     if (page->dirty == false || page->name == NULL || page->lines.data == NULL)
         return -1;
 
+    if (page->codec != NULL)
+        return codec_save (page);
+
     f = fopen (page->name, "w");
     if (f == NULL)
         return -1;
@@ -369,44 +601,566 @@ page_write (page_t *page)
         }
 
     page->dirty = false;
+    diff_saved (page);
 
     fclose (f);
     return 0;
 }
 
+bool
+page_notify (int fd, void *data)
+{
+    return page_update (data);
+}
+
+int
+page_follow (page_t *page, bool on)
+{
+    if (!on)
+        {
+            if (page->follow)
+                page_close (page);
+            return 0;
+        }
+
+    if (page->follow || page->fd >= 0)
+        return 0;
+
+    /* what is appended to a compressed file cannot be read on its own */
+    if (page->codec != NULL)
+        return -1;
+
+    if (page->name == NULL || (page->fd = open (page->name, O_RDONLY)) < 0)
+        return -1;
+
+#ifdef __linux__
+    if ((page->notify = inotify_init1 (IN_NONBLOCK)) >= 0
+        && (inotify_add_watch (page->notify, page->name, IN_MODIFY) < 0
+            || watch (page->notify, page_notify, page)))
+        {
+            close (page->notify);
+            page->notify = -1;
+        }
+#endif
+
+    page->follow = true;
+    page_update (page);
+    if (rite.page == page)
+        move_row (page->lines.len - 1);
+    return 0;
+}
+
+/* reads whatever was appended to a followed file since the last update.
+ * only the new bytes are read and split, so the cost is proportional to
+ * the growth, not the size of the file */
+bool
+page_update (page_t *page)
+{
+    static char buf[FOLLOW_CHUNK];
+    struct stat st;
+    bool pinned;
+    int n;
+
+    if (page->fd < 0)
+        return false;
+
+    if (page->notify >= 0)
+        while (read (page->notify, buf, FOLLOW_CHUNK) > 0)
+            ;
+
+    if (fstat (page->fd, &st) != 0 || st.st_size == page->len)
+        return false;
+
+    pinned = (rite.page == page && rite.row >= page->lines.len - 1);
+
+    /* truncated, probably rotated: start again from the top */
+    if (st.st_size < page->len)
+        page_clear (page);
+
+    if (lseek (page->fd, page->len, SEEK_SET) < 0)
+        return false;
+
+    while ((n = read (page->fd, buf, FOLLOW_CHUNK)) > 0)
+        page_ingest (page, buf, n);
+
+    if (rite.page == page)
+        {
+            if (pinned)
+                move_row (page->lines.len - 1);
+            else
+                move_row (rite.row);
+        }
+
+    return true;
+}
+
+int
+watch (int fd, bool (*func) (int fd, void *data), void *data)
+{
+    watch_t *w;
+
+    if (term_watch (fd, true))
+        return -1;
+
+    if ((w = vector_append (&rite.watches)) == NULL)
+        return -1;
+
+    w->fd = fd, w->func = func, w->data = data;
+    return 0;
+}
+
+/* watches fd for room to write, rather than for something to read */
+int
+watch_out (int fd, bool (*func) (int fd, void *data), void *data)
+{
+    if (watch (fd, func, data))
+        return -1;
+    term_watch_out (fd);
+    return 0;
+}
+
+void
+unwatch (int fd)
+{
+    int i;
+    for (i = 0; i < rite.watches.len; ++i)
+        if (((watch_t *)vector_get (&rite.watches, i))->fd == fd)
+            {
+                vector_remove (&rite.watches, i);
+                break;
+            }
+    term_watch (fd, false);
+}
+
+/* called whenever term_poll times out. returns true if anything changed */
+bool
+idle ()
+{
+    bool changed = false;
+
+    if (rite.page != NULL && rite.page->follow && rite.page->notify < 0)
+        changed |= page_update (rite.page);
+
+    changed |= hits_scan ();
+    changed |= views_idle ();
+    dict_scan ();
+    return changed;
+}
+
+/* how long term_poll may block before idle has work to do */
+int
+idle_timeout ()
+{
+    if (!hits_done () || !views_done () || !dict_done ())
+        return 0;
+
+    /* without inotify, a followed file is checked on every idle tick */
+    if (rite.page != NULL && rite.page->follow && rite.page->notify < 0)
+        return FOLLOW_INTERVAL;
+
+    return -1;
+}
+
+/* acts on a key or text event, from the terminal or a macro */
+void
+handle (event_t *evt)
+{
+    int want, count;
+
+    /* anything but typing, like moving the cursor, ends the record that
+     * typing goes on adding to */
+    if (evt->type == RITE_EVENT_MOUSE
+        || (evt->type == RITE_EVENT_KEY
+            && (evt->u.k >= 128
+                    ? evt->u.k - 128 != RITE_KEY_BACKSPACE
+                          && evt->u.k - 128 != RITE_KEY_DELETE
+                    : RITE_MOD_GET (evt->mods, RITE_MOD_CTRL)
+                          || RITE_MOD_GET (evt->mods, RITE_MOD_ALT))))
+        undo_seal (rite.page);
+
+    switch (evt->type)
+        {
+        case RITE_EVENT_KEY:
+            want = rite.want, rite.want = -1;
+            count = rite.count, rite.count = 0;
+            /* the query's marks show in every view of the page */
+            if (rite.prompt.on || rite.find.on)
+                views_touch (rite.page, 0);
+            if (rite.prompt.on)
+                prompt_key (evt);
+            else if (rite.find.on)
+                find_key (evt);
+            else if (evt->u.k >= 128 && multi_active ()
+                     && evt->u.k - 128 != RITE_KEY_BACKSPACE
+                     && evt->u.k - 128 != RITE_KEY_ENTER
+                     && evt->u.k - 128 != RITE_KEY_TAB)
+                multi_move (evt->u.k - 128,
+                            RITE_MOD_GET (evt->mods, RITE_MOD_CTRL),
+                            MAX (count, 1));
+            else if (evt->u.k >= 128)
+                {
+                    evt->u.k -= 128;
+                    select_key (evt->u.k,
+                                RITE_MOD_GET (evt->mods, RITE_MOD_SHIFT));
+                    switch (evt->u.k)
+                        {
+                        case RITE_KEY_UP:
+                            move_visual (rite.row - 1, want);
+                            break;
+                        case RITE_KEY_DOWN:
+                            move_visual (rite.row + 1, want);
+                            break;
+                        case RITE_KEY_LEFT:
+                            if (RITE_MOD_GET (evt->mods, RITE_MOD_CTRL))
+                                jump_back (MAX (count, 1));
+                            else
+                                left ();
+                            break;
+                        case RITE_KEY_RIGHT:
+                            if (RITE_MOD_GET (evt->mods, RITE_MOD_CTRL))
+                                jump_forward (MAX (count, 1));
+                            else
+                                right ();
+                            break;
+                        case RITE_KEY_BACKSPACE:
+                            if (!select_erase ())
+                                erase ();
+                            break;
+                        case RITE_KEY_END:
+                            end ();
+                            break;
+                        case RITE_KEY_HOME:
+                            home ();
+                            break;
+                        case RITE_KEY_ENTER:
+                            enter ();
+                            break;
+                        case RITE_KEY_TAB:
+                            type ('\t');
+                            break;
+                        }
+                }
+            else if (evt->u.k == 's'
+                     && RITE_MOD_GET (evt->mods, RITE_MOD_CTRL))
+                page_write (rite.page);
+            else if (evt->u.k == 'f'
+                     && RITE_MOD_GET (evt->mods, RITE_MOD_CTRL))
+                find_start ();
+            else if (evt->u.k == 'c'
+                     && RITE_MOD_GET (evt->mods, RITE_MOD_CTRL))
+                clip_copy ();
+            else if (evt->u.k == 'x'
+                     && RITE_MOD_GET (evt->mods, RITE_MOD_CTRL))
+                clip_cut ();
+            else if (evt->u.k == 'v'
+                     && RITE_MOD_GET (evt->mods, RITE_MOD_CTRL))
+                clip_paste ();
+            else if (evt->u.k == 'n'
+                     && RITE_MOD_GET (evt->mods, RITE_MOD_CTRL))
+                {
+                    if (!hits_step (false))
+                        status ("no hits");
+                }
+            else if (evt->u.k == 'p'
+                     && RITE_MOD_GET (evt->mods, RITE_MOD_CTRL))
+                {
+                    if (!hits_step (true))
+                        status ("no hits");
+                }
+            else if (evt->u.k == 'n'
+                     && RITE_MOD_GET (evt->mods, RITE_MOD_ALT))
+                prompt ("hit: ", "", hits_goto);
+            else if (evt->u.k == 'g'
+                     && RITE_MOD_GET (evt->mods, RITE_MOD_CTRL))
+                {
+                    rite.find.len = 0;
+                    hits_reset ();
+                    pipe_stop (NULL);
+                    multi_clear ();
+                    rite.selecting = false;
+                    views_touch (rite.page, 0);
+                }
+            else if (evt->u.k == 'z'
+                     && RITE_MOD_GET (evt->mods, RITE_MOD_CTRL))
+                {
+                    multi_clear ();
+                    if (undo (rite.page))
+                        status ("nothing to undo");
+                }
+            else if (evt->u.k == 's'
+                     && RITE_MOD_GET (evt->mods, RITE_MOD_ALT))
+                prompt ("regex: ", rite.re.str, regex_find);
+            else if (evt->u.k == 'r'
+                     && RITE_MOD_GET (evt->mods, RITE_MOD_ALT))
+                prompt ("replace: ", rite.re.str, regex_with);
+            else if (evt->u.k == 'a'
+                     && RITE_MOD_GET (evt->mods, RITE_MOD_ALT))
+                multi_hits ();
+            else if (evt->u.k == 'c'
+                     && RITE_MOD_GET (evt->mods, RITE_MOD_ALT))
+                multi_lines (MAX (count, 1));
+            else if (evt->u.k == 'm'
+                     && RITE_MOD_GET (evt->mods, RITE_MOD_ALT))
+                macro_toggle ();
+            else if (evt->u.k == 'e'
+                     && RITE_MOD_GET (evt->mods, RITE_MOD_ALT))
+                macro_play (MAX (count, 1));
+            else if (evt->u.k == 'E'
+                     && RITE_MOD_GET (evt->mods, RITE_MOD_ALT))
+                macro_play (0);
+            else if (evt->u.k == 'f'
+                     && RITE_MOD_GET (evt->mods, RITE_MOD_ALT))
+                {
+                    if (count > 0)
+                        fold_level (count);
+                    else
+                        fold_toggle ();
+                }
+            else if (evt->u.k == 'F'
+                     && RITE_MOD_GET (evt->mods, RITE_MOD_ALT))
+                fold_open_all ();
+            else if (evt->u.k == 'd'
+                     && RITE_MOD_GET (evt->mods, RITE_MOD_ALT))
+                diff_toggle ();
+            else if (evt->u.k == '/'
+                     && RITE_MOD_GET (evt->mods, RITE_MOD_ALT))
+                dict_complete ();
+            else if (evt->u.k == 'b'
+                     && RITE_MOD_GET (evt->mods, RITE_MOD_ALT))
+                {
+                    int row, col;
+
+                    if (!match_partner (rite.page, rite.row, rite.col, &row,
+                                        &col, false))
+                        status ("no partner");
+                    else
+                        {
+                            move_row (row);
+                            move_col (col);
+                        }
+                }
+            else if (evt->u.k == 'l'
+                     && RITE_MOD_GET (evt->mods, RITE_MOD_ALT))
+                prompt ("lines: ", "sort", sort_command);
+            else if (evt->u.k == '|'
+                     && RITE_MOD_GET (evt->mods, RITE_MOD_ALT))
+                prompt ("pipe: ", "", pipe_command);
+            else if (evt->u.k == 'w'
+                     && RITE_MOD_GET (evt->mods, RITE_MOD_ALT))
+                wrap_toggle ();
+            else if (evt->u.k == 'h'
+                     && RITE_MOD_GET (evt->mods, RITE_MOD_ALT))
+                views_split (false);
+            else if (evt->u.k == 'v'
+                     && RITE_MOD_GET (evt->mods, RITE_MOD_ALT))
+                views_split (true);
+            else if (evt->u.k == 'o'
+                     && RITE_MOD_GET (evt->mods, RITE_MOD_ALT))
+                views_step (MAX (count, 1));
+            else if (evt->u.k == 'x'
+                     && RITE_MOD_GET (evt->mods, RITE_MOD_ALT))
+                views_close ();
+            else if (evt->u.k == '.'
+                     && RITE_MOD_GET (evt->mods, RITE_MOD_ALT))
+                pages_step (MAX (count, 1));
+            else if (evt->u.k == ','
+                     && RITE_MOD_GET (evt->mods, RITE_MOD_ALT))
+                pages_step (-MAX (count, 1));
+            else if (isdigit (evt->u.k)
+                     && RITE_MOD_GET (evt->mods, RITE_MOD_ALT))
+                {
+                    /* alt and digits give the next motion a count */
+                    rite.count = count * 10 + evt->u.k - '0';
+                    sprintf (rite.status, "count: %i", rite.count);
+                }
+            else if (isprint (evt->u.k))
+                type (evt->u.k);
+            break;
+
+        case RITE_EVENT_TEXT:
+            rite.want = -1;
+            if (rite.prompt.on || rite.find.on)
+                views_touch (rite.page, 0);
+            if (rite.prompt.on)
+                prompt_key (evt);
+            else if (rite.find.on)
+                find_key (evt);
+            else
+                insert (evt->u.t.str, evt->u.t.len);
+            break;
+
+        case RITE_EVENT_MOUSE:
+            mouse (evt);
+            break;
+
+        default:
+            break;
+        }
+}
+
+/* scrolls the focused view n screen rows down, or up for a negative n,
+ * taking the cursor along if it would be left off the screen */
+void
+scroll_by (int n)
+{
+    view_t *v = rite.view;
+    int top, last, sub;
+
+    view_save ();
+    if (v->wrap.on)
+        {
+            top = wrap_before (v, rite.scroll) + rite.subscroll;
+            top = MAX (top + n, 0);
+            rite.scroll = wrap_at (v, top, &rite.subscroll);
+            last = wrap_at (v, top + MAX (v->rows, 1) - 1, &sub);
+        }
+    else
+        {
+            top = CLAMP (fold_down (rite.page, rite.scroll, n), 0,
+                         MAX (rite.page->lines.len - 1, 0));
+            rite.scroll = fold_top (rite.page, top);
+            last = fold_down (rite.page, rite.scroll, MAX (v->rows, 1) - 1);
+        }
+
+    if (rite.row < rite.scroll)
+        move_visual (rite.scroll, rite.want);
+    else if (rite.row > last)
+        move_visual (last, rite.want);
+    v->dirty = true;
+}
+
+/* a left press puts the cursor where it points and starts a selection
+ * there, which a drag with the button held extends. the wheel scrolls */
+void
+mouse (event_t *evt)
+{
+    int b = evt->u.m.b, row, col;
+    view_t *v;
+
+    view_save ();
+    v = views_locate (evt->u.m.y - 1, evt->u.m.x - 1, &row, &col);
+
+    if (b & 64)
+        {
+            if (v != NULL)
+                views_focus (v);
+            scroll_by ((b & 1 ? 1 : -1) * WHEEL_ROWS * evt->u.m.n);
+            return;
+        }
+
+    if ((b & 3) == 3)
+        {
+            rite.selecting = rite.selecting
+                             && (rite.anchor.row != rite.row
+                                 || rite.anchor.col != rite.col);
+            return;
+        }
+    if ((b & ~32) != 0 || v == NULL)
+        return;
+
+    /* a drag stays in the view it started in */
+    if (v != rite.view)
+        {
+            if (b & 32)
+                return;
+            views_focus (v);
+        }
+
+    multi_clear ();
+    rite.row = row, rite.col = col;
+    rite.want = -1;
+    if (!(b & 32))
+        {
+            rite.selecting = true;
+            rite.anchor.row = row, rite.anchor.col = col;
+        }
+}
+
+/* lines [row, row + n) of a page are about to be replaced. every edit
+ * reports here first, for derived state that needs their old text */
+void
+page_editing (page_t *page, int row, int n)
+{
+    stats_take (page, row, n);
+    dict_take (page, row, n);
+}
+
+/* lines [row, row + nold) of a page have been replaced by nnew lines. every
+ * edit reports here once it is done, so derived state can be patched up */
+void
+page_edited (page_t *page, int row, int nold, int nnew)
+{
+    int i, end;
+
+    for (i = row; i < row + nnew; ++i)
+        layout_drop (vector_get (&page->lines, i));
+    end = hl_edit (page, row, nold, nnew);
+    fold_edit (page, row, nold, nnew);
+    diff_edit (page, row, nold, nnew);
+    stats_edit (page, row, nold, nnew);
+    dict_edit (page, row, nold, nnew);
+    match_edit (page, row, nold, nnew);
+    pipe_edit (page, row, nold, nnew);
+
+    if (page == rite.page)
+        {
+            hits_edit (row, nold, nnew);
+            select_edit (row, nold, nnew);
+        }
+    views_edit (page, row, nold, nnew, end);
+}
+
 void
 type (char c)
+{
+    insert (&c, 1);
+}
+
+/* puts str, which holds no newlines, in front of the cursor */
+void
+insert (char *str, int len)
 {
     char *ptr;
     line_t *l = vector_get (&rite.page->lines, rite.row);
-    if (l == NULL)
+    if (l == NULL || len <= 0)
         return;
 
-    if (l->text.data == NULL)
+    if (multi_active ())
         {
-            ptr = vector_append (&l->text);
-            *ptr = c;
-            ptr = vector_append (&l->text);
-            *ptr = '\0';
+            multi_edit (MULTI_INSERT, str, len);
+            return;
         }
+
+    undo_save (rite.page, rite.row, 1, 1);
+
+    if (l->text.data == NULL || rite.col >= l->text.len - 1)
+        line_extend (l, str, len);
     else
         {
-            if (rite.col >= l->text.len - 1)
-                {
-                    ptr = vector_tail (&l->text);
-                    *ptr = c;
-                    ptr = vector_append (&l->text);
-                    *ptr = '\0';
-                }
-            else
-                {
-                    ptr = vector_insert (&l->text, rite.col);
-                    *ptr = c;
-                }
+            ptr = vector_splice (&l->text, rite.col, 0, len);
+            memcpy (ptr, str, len);
         }
 
     rite.page->dirty = true;
-    move_col (rite.col + 1);
+    page_edited (rite.page, rite.row, 1, 1);
+    move_col (rite.col + len);
+}
+
+/* moves to another row at display column want, or if that is negative,
+ * the column the cursor is at. a run of moves passes the same want along,
+ * so the cursor comes back to its column after crossing shorter lines */
+void
+move_visual (int row, int want)
+{
+    line_t *l = vector_get (&rite.page->lines, rite.row);
+
+    if (want < 0)
+        want = (l == NULL ? 0 : layout_col (l, rite.col));
+
+    move_row (row);
+    if ((l = vector_get (&rite.page->lines, rite.row)) != NULL)
+        rite.col = layout_byte (l, want);
+    rite.want = want;
 }
 
 void
@@ -414,19 +1168,37 @@ move_row (int row)
 {
     if (rite.page->lines.data != NULL)
         {
-            rite.row = CLAMP (row, 0, MAX (rite.page->lines.len - 1, 0));
+            row = CLAMP (row, 0, MAX (rite.page->lines.len - 1, 0));
+            rite.row = fold_reach (rite.page, rite.row, row);
             move_col (rite.col);
         }
     else
         rite.row = 0;
 }
 
+/* moves to byte col, or the start of the character it is in */
 void
 move_col (int col)
 {
     line_t *l = vector_get (&rite.page->lines, rite.row);
     if (l != NULL)
-        rite.col = CLAMP (col, 0, MAX (l->text.len - 1, 0));
+        rite.col = layout_snap (l, CLAMP (col, 0, LINE_LEN (l)));
+}
+
+void
+left ()
+{
+    line_t *l = vector_get (&rite.page->lines, rite.row);
+    if (l != NULL)
+        rite.col = layout_prev (l, rite.col);
+}
+
+void
+right ()
+{
+    line_t *l = vector_get (&rite.page->lines, rite.row);
+    if (l != NULL)
+        rite.col = layout_next (l, rite.col);
 }
 
 void
@@ -450,10 +1222,18 @@ erase ()
     if (curr == NULL)
         return;
 
+    if (multi_active ())
+        {
+            multi_edit (MULTI_ERASE, NULL, 0);
+            return;
+        }
+
     if (curr->text.data == NULL && rite.row > 0)
         {
+            undo_save (rite.page, rite.row, 1, 0);
             line_deinit (curr);
             vector_remove (&rite.page->lines, rite.row);
+            page_edited (rite.page, rite.row, 1, 0);
             move_row (rite.row - 1);
             end ();
         }
@@ -463,20 +1243,27 @@ erase ()
             if (prev != NULL)
                 {
                     int len = prev->text.len;
+                    undo_save (rite.page, rite.row - 1, 2, 1);
                     vector_remove (&prev->text, prev->text.len);
                     vector_join (&prev->text, &curr->text);
                     line_deinit (curr);
                     vector_remove (&rite.page->lines, rite.row);
+                    page_edited (rite.page, rite.row - 1, 2, 1);
                     move_row (rite.row - 1);
                     move_col (rite.col + len - 1);
                 }
         }
     else
         {
-            vector_remove (&curr->text, rite.col - 1);
+            /* the whole character before the cursor goes */
+            int at = layout_prev (curr, rite.col);
+
+            undo_save (rite.page, rite.row, 1, 1);
+            vector_splice (&curr->text, at, rite.col - at, 0);
             if (curr->text.len == 1)
                 vector_remove (&curr->text, 0);
-            move_col (rite.col - 1);
+            page_edited (rite.page, rite.row, 1, 1);
+            move_col (at);
         }
 }
 
@@ -485,15 +1272,24 @@ enter ()
 {
     line_t *prev, *new;
 
+    if (multi_active ())
+        {
+            multi_edit (MULTI_ENTER, NULL, 0);
+            return;
+        }
+
     if (rite.col == 0)
         {
+            undo_save (rite.page, rite.row, 0, 1);
             if ((new = vector_insert (&rite.page->lines, rite.row)) == NULL)
                 return;
 
             line_init (new);
+            page_edited (rite.page, rite.row, 0, 1);
         }
     else
         {
+            undo_save (rite.page, rite.row, 1, 2);
             if ((new = vector_insert (&rite.page->lines, rite.row + 1))
                 == NULL)
                 return;
@@ -510,6 +1306,8 @@ enter ()
                             *c = '\0';
                         }
                 }
+
+            page_edited (rite.page, rite.row, 1, 2);
         }
 
     move_col (0);
@@ -517,86 +1315,80 @@ enter ()
 }
 
 void
-jump_forward ()
+status (char *str)
 {
-    line_t *l;
-    char c;
-
-    if ((l = vector_get (&rite.page->lines, rite.row)) == NULL)
-        return;
+    if (str == NULL)
+        rite.status[0] = '\0';
+    else
+        strncpy (rite.status, str, 64);
 
-    if (l->text.data == NULL)
-        return;
+    /* a message while a macro plays means a step went wrong */
+    if (str != NULL && rite.macro.playing)
+        rite.macro.failed = true;
+}
 
-    if (rite.col == l->text.len - 1)
-        return;
+/* asks for a line of input in the status line, passing it to func */
+void
+prompt (char *label, char *str, void (*func) (char *str))
+{
+    rite.prompt.on = true;
+    rite.prompt.label = label;
+    rite.prompt.func = func;
+    strncpy (rite.prompt.str, str, PROMPT_MAX - 1);
+    rite.prompt.str[PROMPT_MAX - 1] = '\0';
+    rite.prompt.len = strlen (rite.prompt.str);
+}
 
-    c = *(char *)vector_get (&l->text, rite.col);
+void
+prompt_key (event_t *evt)
+{
+    char str[PROMPT_MAX];
 
-    if (c == ' ')
+    if (evt->type == RITE_EVENT_TEXT)
         {
-            while (rite.col < l->text.len - 1)
-                if (*(char *)vector_get (&l->text, ++rite.col) != ' ')
-                    break;
+            if (rite.prompt.len + evt->u.t.len < PROMPT_MAX)
+                {
+                    memcpy (rite.prompt.str + rite.prompt.len, evt->u.t.str,
+                            evt->u.t.len);
+                    rite.prompt.len += evt->u.t.len;
+                    rite.prompt.str[rite.prompt.len] = '\0';
+                }
         }
-    else
+    else if (evt->u.k == RITE_KEY_ENTER + 128)
         {
-            while (rite.col < l->text.len - 1)
-                if (*(char *)vector_get (&l->text, ++rite.col) == ' ')
-                    break;
+            rite.prompt.on = false;
+            strcpy (str, rite.prompt.str);
+            rite.prompt.func (str);
         }
-}
-
-void
-jump_back ()
-{
-    line_t *l;
-    char c;
-
-    if (rite.col == 0)
-        return;
-
-    if ((l = vector_get (&rite.page->lines, rite.row)) == NULL)
-        return;
-
-    if (l->text.data == NULL)
-        return;
-
-    c = *(char *)vector_get (&l->text, rite.col - 1);
-
-    if (c == ' ')
+    else if (evt->u.k == RITE_KEY_BACKSPACE + 128)
         {
-            while (rite.col > 0)
-                if (*(char *)vector_get (&l->text, rite.col - 1) != ' ')
-                    break;
-                else
-                    rite.col--;
+            while (rite.prompt.len > 0
+                   && (rite.prompt.str[--rite.prompt.len] & 0xc0) == 0x80)
+                ;
+            rite.prompt.str[rite.prompt.len] = '\0';
         }
-    else
+    else if (evt->u.k == 'g' && RITE_MOD_GET (evt->mods, RITE_MOD_CTRL))
+        rite.prompt.on = false;
+    else if (evt->u.k < 128 && isprint (evt->u.k)
+             && rite.prompt.len < PROMPT_MAX - 1)
         {
-            while (rite.col > 0)
-                if (*(char *)vector_get (&l->text, rite.col - 1) == ' ')
-                    break;
-                else
-                    rite.col--;
+            rite.prompt.str[rite.prompt.len++] = evt->u.k;
+            rite.prompt.str[rite.prompt.len] = '\0';
         }
 }
 
-void
-status (char *str)
-{
-    if (str == NULL)
-        rite.status[0] = '\0';
-    else
-        strncpy (rite.status, str, 64);
-}
-
 void
 draw_ui ()
 {
     static char fmt[] = "[%02x_%02x] :: %s%c";
+    page_t *page = rite.page;
+    char stats[0x80];
+    int n;
 
-    term_clear (), term_cursor_reset ();
+    if (rite.repaint)
+        term_clear ();
+    term_cursor_reset ();
+    term_clear_line ();
 
     if (rite.page == NULL)
         return;
@@ -604,8 +1396,21 @@ draw_ui ()
     term_bold (true);
     term_underline (true);
 
-    printf (fmt, rite.col, rite.row, rite.page->name,
-            rite.page->dirty ? '+' : ' ');
+    n = printf (fmt, rite.col, rite.row,
+                rite.page->name == NULL ? "(stdin)" : rite.page->name,
+                rite.page->dirty ? '+' : ' ');
+    if (rite.pages.len > 1)
+        n += printf ("(%i/%i)", rite.current + 1, rite.pages.len);
+    if (rite.macro.recording)
+        n += printf (" rec");
+
+    /* the words are still being counted while there is a '+' */
+    n += sprintf (stats, "  %i lines  %li bytes  %li%s words  @%li",
+                  page->lines.len, page->stats.bytes, page->stats.words,
+                  page->counted < page->lines.len ? "+" : "",
+                  stats_offset (page, rite.row, rite.col));
+    if (n < term_cols)
+        printf ("%s", stats);
 
     /* { */
     /*     int i; */
@@ -617,50 +1422,133 @@ draw_ui ()
     /*          ++i) */
     /*         putchar (' '); */
     /* } */
-    putchar ('\n');
 
     term_normal ();
 }
 
+/* draws the lines of a view, after scrolling it to keep its cursor on
+ * screen, and blanks the rows below the last one */
 void
-draw_page ()
+draw_page (view_t *v)
 {
-    if (rite.page == NULL)
-        return;
-    else
+    spot_t *at = &v->at;
+    line_t *l = vector_get (&v->page->lines, at->row);
+    int i, n, rows = v->rows;
+
+    /* rows are counted in lines shown, past folds */
+    if (v->wrap.on)
+        wrap_scroll (v);
+    else if (at->row < at->scroll)
+        at->scroll = at->row, at->subscroll = 0;
+    else if (fold_visible (v->page, at->row)
+             >= fold_visible (v->page, at->scroll) + rows)
+        at->scroll = fold_down (v->page, at->row, 1 - rows),
+        at->subscroll = 0;
+    at->scroll = fold_top (v->page, at->scroll);
+
+    /* the partner of a bracket at the cursor, once the lines are measured */
+    rite.partner.row = -1;
+    if (v == rite.view && !multi_active ()
+        && !match_partner (v->page, at->row, at->col, &rite.partner.row,
+                           &rite.partner.col, true))
+        rite.partner.row = -1;
+
+    /* scroll sideways to keep the whole cursor cell on screen */
+    if (l != NULL && !v->wrap.on)
         {
-            int i;
-            for (i = 0; i < MIN (term_rows - 1, rite.page->lines.len); ++i)
-                draw_line (vector_get (&rite.page->lines, i), i == rite.row);
-            term_normal ();
+            char buf[GUTTER_MAX];
+            int cols = MAX (v->cols - gutter (l, buf), 1);
+            int x = layout_col (l, at->col);
+            int w = MAX (layout_col (l, layout_next (l, at->col)) - x, 1);
+
+            if (x < at->hscroll)
+                at->hscroll = x;
+            else if (x + w > at->hscroll + cols)
+                at->hscroll = x + w - cols;
         }
+
+    for (i = at->scroll, n = 0; n < rows && i < v->page->lines.len;
+         i = fold_next (v->page, i))
+        n += draw_line (v, i, i == at->scroll ? at->subscroll : 0, n,
+                        rows - n);
+    for (; n < rows; ++n)
+        draw_row (v, n);
+    term_normal ();
 }
 
+/* moves to the start of the n'th row of a view, blanking it */
 void
-draw_line (line_t *line, bool hi)
+draw_row (view_t *v, int n)
+{
+    term_goto (v->y + n, v->x);
+    printf ("%*s", v->cols, "");
+    term_goto (v->y + n, v->x);
+}
+
+/* formats the part of a row drawn before the text, returning its width */
+int
+gutter (line_t *line, char *buf)
 {
     if (line->text.data != NULL)
-        {
-            char *str = vector_head (&line->text);
+        return sprintf (buf, "[%02x,%02x]__", line->text.len - 1,
+                        line->text.size);
+    else
+        return sprintf (buf, "[NA,NA]__");
+}
 
-            printf ("[%02x,%02x]__", line->text.len - 1, line->text.size);
+/* prints the gutter of a row, its last cell showing how the row differs
+ * from the file when comparing with it */
+void
+draw_gutter (view_t *v, int row, char *buf, int g)
+{
+    char mark = diff_mark (v->page, row);
 
-            if (hi)
-                {
-                    int i = MIN (line->text.len - 1, rite.col);
-                    printf ("%.*s", i, str);
-                    str += i;
+    if (mark == 0 || g > v->cols)
+        {
+            printf ("%.*s", v->cols, buf);
+            return;
+        }
 
-                    term_fg (HI_FG), term_bg (HI_BG);
-                    if (line->text.data == NULL || i == line->text.len - 1)
-                        putchar (' ');
-                    else
-                        putchar (*str++);
-                    term_fg (TERM_DEFAULT), term_bg (TERM_DEFAULT);
-                }
+    printf ("%.*s", g - 1, buf);
+    term_fg (mark == '+' ? ADDED_FG : mark == '~' ? CHANGED_FG : LOST_FG);
+    putchar (mark);
+    term_fg (TERM_DEFAULT);
+}
 
-            if (str != NULL)
-                printf ("%s", str);
+/* draws a line of a view from its skip'th screen row, on row y of the view
+ * and at most max rows of it, returning how many were drawn. unless
+ * wrapping, a line is one row. only the focused view shows its cursor */
+int
+draw_line (view_t *v, int row, int skip, int y, int max)
+{
+    line_t *line = vector_get (&v->page->lines, row);
+    int marks[FIND_MARKS * 2], nmarks = 0, g, w, x, k, n = 0, from, next;
+    int ncursors = 0, sel[2], *select = NULL;
+    char buf[GUTTER_MAX];
+    uint8_t *colors = hl_colors_of (v->page, row);
+    cursor_t one, *cursors = &one;
+
+    one.row = row, one.col = v->at.col;
+    if (v == rite.view && multi_active ())
+        cursors = multi_row (row, &ncursors);
+    else if (v == rite.view && row == v->at.row)
+        ncursors = 1;
+
+    if (v->page == rite.page)
+        nmarks = find_marks (row, marks, FIND_MARKS);
+    if (v == rite.view && select_row (row, &sel[0], &sel[1]))
+        select = sel;
+    g = gutter (line, buf);
+    w = v->cols - g;
+
+    if (!v->wrap.on)
+        {
+            draw_row (v, y);
+            draw_gutter (v, row, buf, g);
+            draw_text (line, cursors, ncursors, marks, nmarks, select,
+                       colors, v->at.hscroll, w);
+            draw_match (v, line, row, y, g, v->at.hscroll, w);
+            draw_fold (v, row, y, g + layout_width (line) - v->at.hscroll);
 
             if (line->text.data != NULL)
                 {
@@ -671,31 +1559,257 @@ draw_line (line_t *line, bool hi)
                             printf ("__%i", end);
                         }
                 }
+
+            return 1;
         }
-    else
+
+    /* wrapped rows after the first are indented past the gutter */
+    wrap_fix (v, row, false);
+    w = MAX (w, 1);
+    for (k = from = 0; n < max; ++k, from = next)
+        {
+            next = wrap_next (line, from, w);
+            if (k >= skip)
+                {
+                    draw_row (v, y + n);
+                    if (k == 0)
+                        draw_gutter (v, row, buf, g);
+                    x = layout_col (line, from);
+                    draw_text (line, cursors, ncursors, marks, nmarks, select,
+                               colors, x,
+                               next < 0 ? w : layout_col (line, next) - x);
+                    draw_match (v, line, row, y + n, g, x,
+                                next < 0 ? w : layout_col (line, next) - x);
+                    if (next < 0)
+                        draw_fold (v, row, y + n, g + layout_width (line) - x);
+                    n++;
+                }
+            if (next < 0)
+                break;
+        }
+
+    return n;
+}
+
+/* shows how many lines the fold starting at row hides, on row y of the
+ * view after column x, past the cell a cursor at the end of the line takes */
+void
+draw_fold (view_t *v, int row, int y, int x)
+{
+    fold_t *f = fold_head (v->page, row);
+    char buf[32];
+    int n;
+
+    x = MAX (x, 0) + 2;
+    if (f == NULL || x >= v->cols)
+        return;
+
+    n = sprintf (buf, "+%i lines", f->n);
+    term_goto (v->y + y, v->x + x);
+    term_fg (FOLD_FG);
+    printf ("%.*s", MIN (n, v->cols - x), buf);
+    term_fg (TERM_DEFAULT);
+}
+
+/* shows the partner of the bracket at the cursor, if it is on row y of the
+ * view, drawn at column x with display columns [from, from + cols) of the
+ * line */
+void
+draw_match (view_t *v, line_t *l, int row, int y, int x, int from, int cols)
+{
+    int col = rite.partner.col, at;
+
+    if (v != rite.view || row != rite.partner.row)
+        return;
+
+    at = layout_col (l, col) - from;
+    if (at < 0 || at >= cols || x + at >= v->cols)
+        return;
+
+    term_goto (v->y + y, v->x + x + at);
+    term_bg (MATCH_BG);
+    draw_run (l, col, layout_next (l, col));
+    term_bg (TERM_DEFAULT);
+}
+
+/* prints display columns [x, x + cols) of a line in runs, switching colour
+ * for the characters under the cursors, which must be sorted, for any
+ * marked [start, end) ranges, which must be sorted and disjoint, for the
+ * selected range in select if it is not NULL, and for each class in
+ * colors */
+void
+draw_text (line_t *l, cursor_t *cursors, int ncursors, int *marks,
+           int nmarks, int *select, uint8_t *colors, int x, int cols)
+{
+    int i, j, k, c = 0, m = 0, len = LINE_LEN (l), stop;
+    bool in, sel;
+
+    if (cols <= 0)
+        return;
+
+    /* only whole characters are drawn: a tab or wide character cut by the
+     * left edge shows as blanks, and one cut by the right edge is left
+     * out, as layout_byte gives the start of the one covering a column */
+    i = layout_byte (l, x);
+    if (i < len && layout_col (l, i) < x)
         {
-            printf ("[NA,NA]__");
-            if (hi)
+            j = layout_next (l, i);
+            printf ("%*s", MIN (layout_col (l, j), x + cols) - x, "");
+            i = j;
+        }
+    stop = layout_byte (l, x + cols);
+
+    while (i < stop)
+        {
+            while (m < nmarks && marks[2 * m + 1] <= i)
+                m++;
+            while (c < ncursors && cursors[c].col < i)
+                c++;
+
+            if (c < ncursors && cursors[c].col == i)
                 {
+                    j = layout_next (l, i);
                     term_fg (HI_FG), term_bg (HI_BG);
-                    putchar (' ');
+                    draw_run (l, i, j);
                     term_fg (TERM_DEFAULT), term_bg (TERM_DEFAULT);
+                    i = j;
+                    continue;
                 }
+
+            in = (m < nmarks && marks[2 * m] <= i);
+            j = in ? marks[2 * m + 1] : m < nmarks ? marks[2 * m] : stop;
+            if (c < ncursors && cursors[c].col < j)
+                j = cursors[c].col;
+            sel = (select != NULL && select[0] <= i && i < select[1]);
+            if (select != NULL && i < select[0])
+                j = MIN (j, select[0]);
+            else if (sel)
+                j = MIN (j, select[1]);
+            j = MIN (j, stop);
+
+            k = (colors == NULL ? HL_NONE : colors[i]);
+            if (colors != NULL)
+                j = hl_run (colors, i, j);
+            if (k != HL_NONE)
+                term_fg (hl_colors[k]);
+            if (in || sel)
+                term_bg (sel ? SELECT_BG : FIND_BG);
+            draw_run (l, i, j);
+            if (in || sel)
+                term_bg (TERM_DEFAULT);
+            if (k != HL_NONE)
+                term_fg (TERM_DEFAULT);
+            i = j;
+        }
+
+    j = layout_width (l);
+    if (ncursors > 0 && cursors[ncursors - 1].col >= len && j >= x
+        && j < x + cols)
+        {
+            term_fg (HI_FG), term_bg (HI_BG);
+            putchar (' ');
+            term_fg (TERM_DEFAULT), term_bg (TERM_DEFAULT);
         }
+}
 
-    putchar ('\n');
+/* prints bytes [from, to) of a line as laid out: tabs are expanded, other
+ * control characters shown as ^X, and bytes that are not valid utf-8 as a
+ * replacement character */
+void
+draw_run (line_t *l, int from, int to)
+{
+    char *str = LINE_TEXT (l);
+    int i = from, k;
+
+    while (i < to)
+        {
+            k = i + layout_scan (str + i, to - i);
+            printf ("%.*s", k - i, str + i);
+            if ((i = k) >= to)
+                break;
+
+            k = MIN (layout_next (l, i), to);
+            if (str[i] == '\t')
+                printf ("%*s", layout_col (l, k) - layout_col (l, i), "");
+            else if ((uint8_t)str[i] < 0x20 || str[i] == 0x7f)
+                printf ("^%c", str[i] ^ 0x40);
+            else if (k - i == 1 && (uint8_t)str[i] >= 0x80)
+                printf ("\xef\xbf\xbd");
+            else
+                printf ("%.*s", k - i, str + i);
+            i = k;
+        }
 }
 
 void
 draw_status ()
 {
-    printf ("--------------------\n%s\n", rite.status);
+    term_goto (PAGE_ROWS + 1, 0);
+    term_clear_line ();
+    printf ("--------------------\n");
+    term_clear_line ();
+    if (rite.prompt.on)
+        printf ("%s%s", rite.prompt.label, rite.prompt.str);
+    else if (rite.find.on || (rite.status[0] == '\0' && rite.find.len > 0))
+        find_print ();
+    else
+        printf ("%s", rite.status);
+}
+
+/* draws the lines between the halves of every split */
+void
+draw_splits (split_t *s)
+{
+    int i;
+
+    if (s == NULL || s->view != NULL)
+        return;
+
+    if (s->vertical)
+        for (i = 0; i < s->rows; ++i)
+            {
+                term_goto (s->y + i, s->half[1]->x - 1);
+                putchar ('|');
+            }
+    else
+        {
+            term_goto (s->half[1]->y - 1, s->x);
+            for (i = 0; i < s->cols; ++i)
+                putchar ('-');
+        }
+
+    draw_splits (s->half[0]);
+    draw_splits (s->half[1]);
 }
 
+/* a full repaint lays the views out again. otherwise only the focused view
+ * and those an edit reached are drawn */
 void
 draw ()
 {
+    int i;
+    view_t *v;
+
+    view_save ();
+    if (rite.repaint)
+        views_layout ();
+
     draw_ui ();
-    draw_page ();
+    for (i = 0; i < rite.views.len; ++i)
+        if ((v = *(view_t **)vector_get (&rite.views, i)) == rite.view
+            || v->dirty || rite.repaint)
+            {
+                if (v->page != NULL)
+                    draw_page (v);
+                v->dirty = false;
+            }
+    if (rite.repaint)
+        draw_splits (rite.splits);
     draw_status ();
+    view_load ();
+    rite.repaint = false;
+
+    /* the status line ends without a newline, so it would wait for the
+     * next frame */
+    fflush (stdout);
 }
@@ -75,6 +75,8 @@ enum RITE_EVENT
     RITE_EVENT_KEY,
     RITE_EVENT_MOUSE,
     RITE_EVENT_RESIZED,
+    RITE_EVENT_FD,
+    RITE_EVENT_TEXT,
     RITE_NUM_EVENTS
 };
 
@@ -94,6 +96,7 @@ void *vector_append (vector_t *vec);
 void *vector_prepend (vector_t *vec);
 void *vector_insert (vector_t *vec, int i);
 void vector_remove (vector_t *vec, int i);
+void *vector_splice (vector_t *vec, int i, int nremove, int ninsert);
 void vector_split (vector_t *dest, vector_t *src, int i);
 void vector_join (vector_t *dest, vector_t *src);
 
@@ -101,34 +104,470 @@ typedef struct
 {
     union
     {
+        /* a motion or wheel event stands for n reports in a row */
         struct
         {
-            uint8_t b, x, y;
+            uint8_t b;
+            int x, y, n;
         } m;
         uint16_t k;
+        int fd;
+        struct
+        {
+            uint8_t len;
+            char str[16];
+        } t;
     } u;
     enum RITE_EVENT type;
     uint8_t mods;
 } event_t;
 
+/* layout.c: a cell without a len starts a run of ascii */
+typedef struct
+{
+    int byte, col, len;
+} cell_t;
+
+typedef struct
+{
+    int cols;
+    vector_t cells;
+} layout_t;
+
+/* hl.c: what a byte is coloured as */
+enum HL_CLASS
+{
+    HL_NONE,
+    HL_KEYWORD,
+    HL_TYPE,
+    HL_STRING,
+    HL_NUMBER,
+    HL_COMMENT,
+    HL_PREPROC,
+    HL_NUM_CLASSES
+};
+
+/* keywords and types are sorted, for a binary search */
+typedef struct
+{
+    char *exts, *line, *start, *end, *quotes, preproc;
+    char **keywords;
+    int nkeywords;
+    char **types;
+    int ntypes;
+} syntax_t;
+
+/* state is where the highlighter was at the end of the line, and shared
+ * is set while its text may be held somewhere else as well */
 typedef struct
 {
     vector_t text;
+    layout_t *layout;
+    uint8_t state;
+    bool shared;
 } line_t;
 
+/* a line's text is NUL terminated when it has any, and NULL when empty */
+#define LINE_LEN(l) MAX ((l)->text.len - 1, 0)
+#define LINE_TEXT(l) ((char *)(l)->text.data)
+
+/* undo.c: nnew lines at row replaced the lines kept in old */
+typedef struct
+{
+    int row, nnew;
+    vector_t old;
+} hunk_t;
+
+/* a record of typing takes in the typing after it on the same line */
+typedef struct
+{
+    bool open, typing;
+    int row, col;
+    vector_t hunks;
+} undo_t;
+
+/* diff.c: page lines [a, a + na) stand where the file has [b, b + nb), or
+ * are yet to be compared with them if dirty */
 typedef struct
 {
+    int a, na, b, nb;
     bool dirty;
+} diffhunk_t;
+
+/* the hashes of the file's lines and of the page's, 0 until taken */
+typedef struct
+{
+    vector_t disk, lines, hunks, scratch;
+    int dirty;
+    long budget;
+} diff_t;
+
+/* stats.c: a run of lines, and the bytes they take with their newlines */
+typedef struct
+{
+    int lines;
+    long bytes;
+} statblock_t;
+
+/* the blocks of a page's lines, the tree summing them, and the totals */
+typedef struct
+{
+    vector_t blocks, tree;
+    bool dirty;
+    long bytes, words;
+} stats_t;
+
+/* match.c: how a run of lines changes the bracket depth, and the lowest it
+ * goes on the way */
+typedef struct
+{
+    int net, low;
+} nest_t;
+
+/* a node of the tree over the blocks of nest_t, one per line */
+typedef struct
+{
+    int lines;
+    nest_t nest;
+} nestnode_t;
+
+typedef struct
+{
+    vector_t blocks, tree;
+    int size, scan;
+    bool dirty;
+} match_t;
+
+/* codec.c: a compression format, told by the len bytes of magic a file
+ * starts with or the suffix of its name, and the programs that undo and
+ * redo it */
+typedef struct
+{
+    char *name, *suffix, *magic;
     int len;
+    char *unpack[4], *pack[4];
+} codec_t;
+
+/* a cursor and the viewport around it */
+typedef struct
+{
+    int row, col, scroll, subscroll, hscroll;
+} spot_t;
+
+typedef struct
+{
+    bool dirty, partial, follow, invalid, loaded;
+    long len, used;
+    int fd, notify, pid, undo_depth, lexed, counted;
+    spot_t spot;
     char *text, *name;
-    vector_t lines;
+    codec_t *codec;
+    syntax_t *syntax;
+    diff_t *diff;
+    stats_t stats;
+    match_t match;
+    vector_t lines, undo, folds;
 } page_t;
 
+typedef struct
+{
+    int fd;
+    bool (*func) (int fd, void *data);
+    void *data;
+} watch_t;
+
+#define FIND_MAX 64
+#define GUTTER_MAX 0x40
+#define PAGE_ROWS (term_rows - 3)
+#define PROMPT_MAX 256
+
+typedef struct
+{
+    bool on, fail;
+    int row, col, len, segments;
+    char str[FIND_MAX];
+} find_t;
+
+/* hits.c: rows are relative to the block's shift */
 typedef struct
 {
     int row, col;
+} hit_t;
+
+typedef struct
+{
+    int shift;
+    vector_t hits;
+} hitblock_t;
+
+typedef struct
+{
+    bool dirty;
+    int count, scan;
+    vector_t blocks, prefix;
+} hits_t;
+
+/* wrap.c: screen rows per line, in blocks */
+typedef struct
+{
+    int rows;
+    vector_t counts;
+} wrapblock_t;
+
+typedef struct
+{
+    bool on, dirty;
+    int cols, scan;
+    vector_t blocks, lines, rows;
+} wrap_t;
+
+/* view.c: a page shown in a rectangle of the screen. two views of one page
+ * share it, and the focused view keeps its cursor in rite */
+typedef struct
+{
     page_t *page;
-    char status[64];
+    spot_t at;
+    int y, x, rows, cols;
+    bool dirty;
+    wrap_t wrap;
+} view_t;
+
+/* a leaf of the split tree holds a view, any other node two halves */
+typedef struct split
+{
+    bool vertical;
+    int y, x, rows, cols;
+    struct split *parent, *half[2];
+    view_t *view;
+} split_t;
+
+/* multi.c */
+enum MULTI_OP
+{
+    MULTI_INSERT,
+    MULTI_ERASE,
+    MULTI_ENTER
+};
+
+typedef struct
+{
+    int row, col;
+} cursor_t;
+
+typedef struct
+{
+    bool on;
+    int len;
+    char *label, str[PROMPT_MAX];
+    void (*func) (char *str);
+} prompt_t;
+
+/* word.c */
+enum WORD_CLASS
+{
+    WORD_SPACE,
+    WORD_PUNCT,
+    WORD_WORD
+};
+
+/* regex.c */
+enum RE_NODE
+{
+    RE_EPS,
+    RE_SET
+};
+
+typedef struct
+{
+    uint8_t type, set[32];
+    int out[2];
+} re_node_t;
+
+/* the nodes hold the pattern twice: from start to accept, and reversed,
+ * with anything allowed before it, from rstart to raccept */
+typedef struct
+{
+    vector_t nodes;
+    int start, accept, rstart, raccept;
+    bool bol, eol, rev;
+    char *error, str[PROMPT_MAX];
+} re_t;
+
+typedef struct
+{
+    int set, len, next[256];
+    bool accept;
+} dfa_state_t;
+
+/* a dfa runs from the nfa node first to accept. back runs the pattern
+ * reversed, to mark where in text the matches start */
+typedef struct dfa
+{
+    re_t *re;
+    vector_t states, sets;
+    int start, accept, flushes, gen, nlist, nstart;
+    int *table, *mark, *stack, *list, *startset;
+    struct dfa *back;
+    uint8_t *starts;
+    char *text;
+    int len, cap;
+} dfa_t;
+
+/* table.c: a hash table of items kept in its slots, each starting with a
+ * pointer that is NULL in an empty slot */
+typedef struct
+{
+    vector_t slots;
+    int n, least;
+    unsigned long (*hash) (void *item);
+    bool (*same) (void *item, void *key);
+} table_t;
+
+/* clip.c: a piece of a line's text, held without copying it */
+typedef struct
+{
+    char *text;
+    int from, len;
+} span_t;
+
+/* how many hold a line's text, the line included */
+typedef struct
+{
+    char *text;
+    int refs;
+} share_t;
+
+typedef struct
+{
+    vector_t spans;
+    table_t shares;
+} clip_t;
+
+/* fold.c: the n lines after row are hidden, and the folds above hide
+ * before lines */
+typedef struct
+{
+    int row, n, before;
+} fold_t;
+
+/* dict.c: a word of the open pages, and how often it occurs in them */
+typedef struct
+{
+    unsigned long hash;
+    int count, len;
+    char s[1];
+} dictword_t;
+
+/* a word looked for in the table */
+typedef struct
+{
+    char *s;
+    int len;
+    unsigned long hash;
+} dictkey_t;
+
+#define DICT_LONG 64
+
+/* the table of words, the sorted list of them and the words not yet in
+ * it, and the word completed last, from col of row */
+typedef struct
+{
+    table_t words;
+    vector_t sorted, fresh;
+    int row, col, plen;
+    char prefix[DICT_LONG + 1], word[DICT_LONG + 1];
+} dict_t;
+
+/* ctl.c: a program connected to the control socket, and what it sent
+ * that is not yet acted on and the replies not yet taken */
+typedef struct
+{
+    int fd;
+    vector_t in, out;
+} ctlclient_t;
+
+typedef struct
+{
+    int fd;
+    char *path;
+    vector_t clients;
+} ctl_t;
+
+/* sort.c: a line to sort, and its first bytes to compare before its text */
+typedef struct
+{
+    uint64_t key;
+    char *s;
+    int len, row;
+} sortitem_t;
+
+/* a sort, dedup or filter shared by the workers. items are sorted from
+ * from into to, and keep marks the lines to keep */
+typedef struct
+{
+    page_t *page;
+    sortitem_t *from, *to;
+    uint8_t *keep;
+    int first, n, skip, shards, width, pieces;
+    bool reverse;
+} sortjob_t;
+
+/* a sorted run on disk, the items read from it and how many are left */
+typedef struct
+{
+    void *f;
+    int at, len, left;
+} sortrun_t;
+
+/* pipe.c: a command lines [first, first + n) of page are piped through.
+ * row and at are how far its input has got, and lines what it gave back */
+typedef struct
+{
+    page_t *page;
+    int pid, in, out, first, n, row, at;
+    bool partial, invalid;
+    vector_t lines;
+} pipe_t;
+
+/* codec.c: a compressed save under way. the page's text as it was, the
+ * program it is being written through and the file it goes to first */
+typedef struct
+{
+    page_t *page;
+    char *text, *tmp;
+    long len;
+    int pid, in, done[2];
+    bool failed;
+} codecsave_t;
+
+/* macro.c */
+typedef struct
+{
+    vector_t events;
+    bool recording, playing, failed;
+} macro_t;
+
+typedef struct
+{
+    int row, col, want, count, scroll, subscroll, hscroll, current;
+    long tick;
+    bool repaint, selecting;
+    cursor_t anchor, partner;
+    page_t *page;
+    view_t *view;
+    split_t *splits;
+    vector_t watches, pages, views, cursors;
+    find_t find;
+    hits_t hits;
+    prompt_t prompt;
+    re_t re;
+    macro_t macro;
+    clip_t clip;
+    dict_t dict;
+    ctl_t ctl;
+    pipe_t pipe;
+    codecsave_t save;
+    char status[64], with[PROMPT_MAX];
 } rite_t;
 
 /**/
@@ -139,36 +578,530 @@ extern rite_t rite;
 void line_init (line_t *line);
 void line_deinit (line_t *line);
 void line_read (page_t *page, line_t *line, int start, int end);
+void line_extend (line_t *line, char *str, int len);
+void line_copy (line_t *dest, line_t *src);
 void line_print (line_t *line);
 
 void page_init (page_t *page);
 void page_deinit (page_t *page);
+void page_clear (page_t *page);
+void page_ingest (page_t *page, char *buf, int len);
 int page_read (page_t *page, char *filename);
+int page_stream (page_t *page, int fd);
+bool page_pull (int fd, void *data);
+void page_close (page_t *page);
 int page_write (page_t *page);
+int page_follow (page_t *page, bool on);
+bool page_notify (int fd, void *data);
+bool page_update (page_t *page);
+
+int watch (int fd, bool (*func) (int fd, void *data), void *data);
+int watch_out (int fd, bool (*func) (int fd, void *data), void *data);
+void unwatch (int fd);
+bool idle ();
+int idle_timeout ();
+void handle (event_t *evt);
+void scroll_by (int n);
+void mouse (event_t *evt);
+void page_editing (page_t *page, int row, int n);
+void page_edited (page_t *page, int row, int nold, int nnew);
 
 void type (char c);
+void insert (char *str, int len);
+void move_visual (int row, int want);
 void move_row (int row);
 void move_col (int col);
+void left ();
+void right ();
 void end ();
 void home ();
 void erase ();
 void enter ();
-void jump_forward ();
-void jump_back ();
 
 void status (char *str);
+void prompt (char *label, char *str, void (*func) (char *str));
+void prompt_key (event_t *evt);
 
 void draw_ui ();
-void draw_page ();
-void draw_line (line_t *line, bool hi);
+void draw_page (view_t *v);
+void draw_row (view_t *v, int n);
+int gutter (line_t *line, char *buf);
+int draw_line (view_t *v, int row, int skip, int y, int max);
+void draw_fold (view_t *v, int row, int y, int x);
+void draw_match (view_t *v, line_t *l, int row, int y, int x, int from,
+                 int cols);
+void draw_gutter (view_t *v, int row, char *buf, int g);
+void draw_text (line_t *l, cursor_t *cursors, int ncursors, int *marks,
+                int nmarks, int *select, uint8_t *colors, int x, int cols);
+void draw_run (line_t *l, int from, int to);
 void draw_status ();
+void draw_splits (split_t *s);
 void draw ();
 /**/
 
+/**/
+/* search.c */
+/**/
+int find_mem (char *s, int n, char *q, int m);
+int find_segment (int i, char **seg);
+int find_span (int row);
+int find_line (int row, int from, bool back);
+bool find_next (int *row, int *col, bool back);
+int find_marks (int row, int *marks, int max);
+void find_start ();
+void find_stop (bool accept);
+void find_update ();
+void find_step (bool back);
+void find_key (event_t *evt);
+void find_print ();
+/**/
+
+/**/
+/* hits.c */
+/**/
+void hits_reset ();
+bool hits_active ();
+bool hits_done ();
+void hits_locate (int row, int col, int *block, int *i);
+int hits_find (int row, int col);
+bool hits_get (int n, int *row, int *col);
+void hits_fill (int *block, hit_t *hits, int n, int shift);
+void hits_insert (int row, int col, hit_t *hits, int n);
+void hits_row (int row, vector_t *out);
+bool hits_scan ();
+void hits_edit (int row, int nold, int nnew);
+bool hits_step (bool back);
+bool hits_jump (int n);
+void hits_goto (char *str);
+int hits_current ();
+/**/
+
+/**/
+/* utf8.c */
+/**/
+int utf8_decode (char *s, int n, uint32_t *c);
+int utf8_encode (uint32_t c, char *s);
+int utf8_width (uint32_t c);
+int utf8_ascii (char *s, int n);
+int utf8_check (char *s, int n);
+bool utf8_cut (char *s, int n);
+int utf8_cluster (char *s, int n, int *width);
+/**/
+
+/**/
+/* layout.c */
+/**/
+int layout_scan (char *s, int n);
+cell_t *layout_cell (layout_t *lo, int at, bool col);
+layout_t *layout_get (line_t *l);
+void layout_drop (line_t *l);
+int layout_col (line_t *l, int byte);
+int layout_byte (line_t *l, int col);
+int layout_width (line_t *l);
+int layout_snap (line_t *l, int byte);
+int layout_next (line_t *l, int byte);
+int layout_prev (line_t *l, int byte);
+/**/
+
+/**/
+/* wrap.c */
+/**/
+void wrap_reset (view_t *v);
+void wrap_toggle ();
+void wrap_resize (view_t *v);
+bool wrap_done (view_t *v);
+int wrap_width (view_t *v, line_t *l);
+int wrap_next (line_t *l, int from, int w);
+int wrap_rows (view_t *v, line_t *l);
+int wrap_find (view_t *v, line_t *l, int byte, int *x);
+void wrap_prefix (view_t *v);
+int wrap_block (view_t *v, int row, int *i);
+void wrap_insert (view_t *v, int row, int n);
+void wrap_remove (view_t *v, int row, int n);
+void wrap_fix (view_t *v, int row, bool force);
+void wrap_edit (view_t *v, int row, int nold, int nnew);
+bool wrap_scan (view_t *v);
+int wrap_before (view_t *v, int row);
+int wrap_at (view_t *v, int n, int *sub);
+void wrap_scroll (view_t *v);
+int wrap_count (view_t *v, int row);
+void wrap_fold (view_t *v, int row, int n, bool hide);
+/**/
+
+/**/
+/* word.c */
+/**/
+extern uint8_t word_class[256];
+void word_init ();
+int word_run (char *s, int n, int cls);
+int word_run_back (char *s, int n, int cls);
+bool word_next (int *row, int *col);
+bool word_prev (int *row, int *col);
+void jump_forward (int n);
+void jump_back (int n);
+/**/
+
+/**/
+/* pages.c */
+/**/
+page_t *pages_add (char *name);
+void pages_free ();
+long pages_memory (page_t *page);
+bool pages_evictable (page_t *page);
+void pages_evict ();
+void pages_switch (int i);
+void pages_step (int n);
+/**/
+
+/**/
+/* view.c */
+/**/
+view_t *view_new (page_t *page);
+void view_free (view_t *v);
+void view_save ();
+void view_load ();
+void views_init (page_t *page);
+void views_free_split (split_t *s);
+void views_free ();
+void views_place (split_t *s, int y, int x, int rows, int cols);
+void views_layout ();
+split_t *views_leaf (split_t *s, view_t *v);
+int views_index (view_t *v);
+void views_focus (view_t *v);
+void views_split (bool vertical);
+void views_close ();
+void views_step (int n);
+bool views_shows (page_t *page);
+void views_reset (page_t *page);
+bool views_touch (page_t *page, int row);
+view_t *views_locate (int y, int x, int *row, int *col);
+void views_edit (page_t *page, int row, int nold, int nnew, int end);
+bool views_done ();
+bool views_idle ();
+/**/
+
+/**/
+/* multi.c */
+/**/
+int multi_cmp (const void *a, const void *b);
+bool multi_active ();
+void multi_clear ();
+void multi_sort ();
+void multi_add (int row, int col);
+void multi_report ();
+cursor_t *multi_row (int row, int *n);
+void multi_lines (int n);
+void multi_hits ();
+void multi_move (int key, bool ctrl, int count);
+void multi_copy (line_t *piece, char *text, int from, int to);
+bool multi_joins (int op, cursor_t *c);
+void multi_build (int op, char *str, int len, vector_t *runs,
+                  vector_t *pieces);
+void multi_edit (int op, char *str, int len);
+/**/
+
+/**/
+/* table.c */
+/**/
+void table_init (table_t *t, int itemsize, int least,
+                 unsigned long (*hash) (void *item),
+                 bool (*same) (void *item, void *key));
+void table_deinit (table_t *t);
+void *table_slot (table_t *t, unsigned long hash, void *key);
+void table_room (table_t *t);
+void table_remove (table_t *t, void *at);
+/**/
+
+/**/
+/* clip.c */
+/**/
+unsigned long share_hash (char *text);
+unsigned long share_item (void *item);
+bool share_same (void *item, void *key);
+void share_ref (line_t *l);
+bool share_unref (char *text);
+void share_own (line_t *l);
+void share_drop (line_t *l);
+void clip_clear ();
+void clip_free ();
+void clip_take (page_t *page, int r0, int c0, int r1, int c1);
+void clip_delete (int r0, int c0, int r1, int c1);
+void clip_copy ();
+void clip_cut ();
+void clip_paste ();
+bool select_range (int *r0, int *c0, int *r1, int *c1);
+bool select_row (int row, int *from, int *to);
+void select_key (int key, bool shift);
+bool select_erase ();
+void select_edit (int row, int nold, int nnew);
+/**/
+
+/**/
+/* fold.c */
+/**/
+int fold_find (page_t *page, int row);
+fold_t *fold_at (page_t *page, int row);
+fold_t *fold_head (page_t *page, int row);
+int fold_visible (page_t *page, int row);
+int fold_row (page_t *page, int n);
+int fold_down (page_t *page, int row, int n);
+int fold_top (page_t *page, int row);
+int fold_next (page_t *page, int row);
+int fold_reach (page_t *page, int from, int to);
+void fold_count (page_t *page, int i);
+void fold_show (page_t *page, int row, int n, bool hide);
+void fold_remove (page_t *page, int i);
+void fold_add (page_t *page, int row, int n);
+void fold_clear (page_t *page);
+void fold_edit (page_t *page, int row, int nold, int nnew);
+int fold_indent (line_t *l);
+int fold_braces (line_t *l, int *low);
+int fold_block (page_t *page, int row);
+void fold_toggle ();
+void fold_level (int level);
+void fold_open_all ();
+/**/
+
+/**/
+/* diff.c */
+/**/
+unsigned long diff_hash (char *s, int len);
+unsigned long diff_line (page_t *page, int row);
+bool diff_same (page_t *page, int row, int disk);
+void diff_stop (page_t *page);
+bool diff_start (page_t *page);
+void diff_saved (page_t *page);
+void diff_toggle ();
+int diff_find (diff_t *df, int row);
+int diff_offset (diff_t *df, int i);
+void diff_edit (page_t *page, int row, int nold, int nnew);
+void diff_emit (vector_t *out, int a, int na, int b, int nb);
+bool diff_split (page_t *page, int a0, int a1, int b0, int b1, int *sx,
+                 int *sy);
+void diff_compare (page_t *page, vector_t *out, int a0, int a1, int b0,
+                   int b1);
+bool diff_done (page_t *page);
+bool diff_scan (page_t *page);
+char diff_mark (page_t *page, int row);
+/**/
+
+/**/
+/* stats.c */
+/**/
+void stats_clear (page_t *page);
+void stats_build (stats_t *st);
+void stats_add (stats_t *st, int block, int lines, long bytes);
+statblock_t stats_before (stats_t *st, int block);
+int stats_find (stats_t *st, int row, int *i);
+long stats_line (page_t *page, int row);
+void stats_take (page_t *page, int row, int n);
+void stats_split (page_t *page, int block, int row);
+void stats_edit (page_t *page, int row, int nold, int nnew);
+long stats_offset (page_t *page, int row, int col);
+/**/
+
+/**/
+/* dict.c */
+/**/
+void dict_init ();
+unsigned long dict_item (void *item);
+bool dict_same (void *item, void *key);
+dictword_t **dict_slot (char *s, int len, unsigned long hash);
+void dict_count (char *s, int len, int d);
+int dict_line (line_t *l, int d);
+void dict_take (page_t *page, int row, int n);
+void dict_edit (page_t *page, int row, int nold, int nnew);
+page_t *dict_pending ();
+bool dict_done ();
+void dict_scan ();
+int dict_cmp (const void *a, const void *b);
+void dict_merge ();
+dictword_t *dict_find (char *prefix, int plen, char *after);
+void dict_complete ();
+/**/
+
+/**/
+/* match.c */
+/**/
+nest_t match_join (nest_t a, nest_t b);
+nest_t match_nest (char *s, int len);
+int match_side (char c);
+void match_clear (page_t *page);
+nestnode_t match_sum (vector_t *b);
+void match_build (match_t *m);
+void match_update (match_t *m, int block);
+int match_block (match_t *m, int row, int *i);
+void match_insert (match_t *m, int row, int n);
+void match_remove (match_t *m, int row, int n);
+void match_measure (page_t *page, int row, int n);
+void match_edit (page_t *page, int row, int nold, int nnew);
+bool match_done (page_t *page);
+bool match_scan (page_t *page);
+int match_walk (match_t *m, int block, int i, int *d, bool back);
+int match_blocks (match_t *m, int block, int *d, bool back);
+int match_row (match_t *m, int block);
+int match_col (line_t *l, int col, int *d, bool back);
+bool match_partner (page_t *page, int row, int col, int *prow, int *pcol,
+                    bool quick);
+/**/
+
+/**/
+/* ctl.c */
+/**/
+bool ctl_free (char *path);
+void ctl_listen (char *path);
+void ctl_close ();
+bool ctl_accept (int fd, void *data);
+void ctl_drop (ctlclient_t *c);
+uint32_t ctl_u32 (uint8_t *p);
+void ctl_put (vector_t *out, uint32_t n);
+int ctl_begin (ctlclient_t *c, bool failed);
+void ctl_end (ctlclient_t *c, int at);
+void ctl_text (ctlclient_t *c, char *s, int len);
+int ctl_fail (ctlclient_t *c, char *why);
+int ctl_open (ctlclient_t *c, char *name, int len);
+int ctl_check (uint8_t *p, uint8_t *end, int n, int lines);
+uint8_t *ctl_edit (page_t *page, uint8_t *p);
+int ctl_edits (ctlclient_t *c, uint8_t *p, uint8_t *end);
+int ctl_read (ctlclient_t *c, int row, int n);
+int ctl_do (ctlclient_t *c, uint8_t *p, int len);
+int ctl_flush (ctlclient_t *c);
+bool ctl_pull (int fd, void *data);
+/**/
+
+/**/
+/* sort.c */
+/**/
+int sort_prefix (page_t *page, int first, int n);
+uint64_t sort_key (line_t *l, int skip);
+int sort_cmp (sortjob_t *job, sortitem_t *x, sortitem_t *y);
+void sort_merge (sortjob_t *job, sortitem_t *a, int na, sortitem_t *b, int nb,
+                 sortitem_t *out);
+void sort_run (sortjob_t *job, sortitem_t *items, sortitem_t *spare, int n);
+int sort_rank (sortjob_t *job, sortitem_t *a, int na, sortitem_t *b, int nb,
+               int k);
+void sort_fill_shard (void *data, int shard);
+void sort_run_shard (void *data, int shard);
+void sort_merge_shard (void *data, int shard);
+sortitem_t *sort_items (page_t *page, int first, int n, int skip,
+                        bool reverse);
+int sort_rows (page_t *page, int first, int n, bool reverse, int *rows);
+void sort_uniq_shard (void *data, int shard);
+void sort_filter_shard (void *data, int shard);
+int sort_keep (page_t *page, int first, int n, bool reverse,
+               void (*func) (void *data, int shard), int *rows);
+void sort_apply (page_t *page, int first, int n, int *rows, int m);
+void sort_range (int *first, int *n);
+void sort_command (char *str);
+/**/
+
+/**/
+/* pipe.c */
+/**/
+int pipe_start (page_t *page, int first, int n, char *cmd);
+void pipe_shut ();
+bool pipe_push (int fd, void *data);
+void pipe_split (char *buf, int len);
+bool pipe_pull (int fd, void *data);
+void pipe_finish ();
+void pipe_free ();
+void pipe_stop (page_t *page);
+void pipe_edit (page_t *page, int row, int nold, int nnew);
+void pipe_command (char *cmd);
+/**/
+
+/**/
+/* codec.c */
+/**/
+extern codec_t codecs[];
+
+codec_t *codec_detect (void *f, char *name);
+int codec_spawn (char **argv, int in, int out);
+int codec_open (page_t *page);
+void codec_reap (page_t *page);
+void *codec_worker (void *data);
+int codec_temp (char *name, char **tmp);
+void codec_drop (codecsave_t *s);
+int codec_save (page_t *page);
+bool codec_saved (int fd, void *data);
+void codec_wait ();
+/**/
+
+/**/
+/* macro.c */
+/**/
+void macro_toggle ();
+void macro_record (event_t *evt);
+int macro_text (event_t *evt, char *buf);
+bool macro_motion (event_t *evt);
+bool macro_run ();
+void macro_play (int n);
+/**/
+
+/**/
+/* hl.c */
+/**/
+extern enum TERM_COLOR hl_colors[HL_NUM_CLASSES];
+syntax_t *hl_detect (char *name);
+bool hl_lookup (char **words, int n, char *s, int len);
+bool hl_at (char *s, int n, int i, char *delim);
+int hl_lex (syntax_t *syn, char *s, int n, int state, uint8_t *colors);
+int hl_start (page_t *page, int row);
+void hl_catchup (page_t *page, int row);
+int hl_edit (page_t *page, int row, int nold, int nnew);
+bool hl_done (page_t *page);
+bool hl_scan (page_t *page);
+uint8_t *hl_colors_of (page_t *page, int row);
+int hl_run (uint8_t *colors, int from, int to);
+/**/
+
+/**/
+/* undo.c */
+/**/
+undo_t *undo_record (page_t *page);
+void undo_free (undo_t *u);
+void undo_clear (page_t *page);
+void undo_begin (page_t *page);
+void undo_end (page_t *page);
+hunk_t *undo_hunk (page_t *page, int row, int nold, int nnew);
+void undo_save (page_t *page, int row, int nold, int nnew);
+void undo_seal (page_t *page);
+void page_splice (page_t *page, int row, int nold, line_t *lines, int nnew);
+int undo (page_t *page);
+/**/
+
+/**/
+/* pool.c */
+/**/
+int pool_size ();
+void pool_run (void (*func) (void *data, int shard), void *data, int shards);
+/**/
+
+/**/
+/* regex.c */
+/**/
+int re_compile (re_t *re, char *pattern);
+void re_free (re_t *re);
+void dfa_setup (dfa_t *d, re_t *re, int first, int accept);
+void dfa_init (dfa_t *d, re_t *re);
+void dfa_deinit (dfa_t *d);
+int dfa_add (dfa_t *d, int *list, int n);
+int dfa_step (dfa_t *d, int s, uint8_t c);
+int dfa_longest (dfa_t *d, char *s, int n, int from);
+void dfa_starts (dfa_t *d, char *s, int n);
+int dfa_match (dfa_t *d, char *s, int n, int from, int *len);
+void re_flush (page_t *page, vector_t *run, int first);
+int re_replace (page_t *page, char *with);
+bool re_find (page_t *page);
+void regex_find (char *str);
+void regex_with (char *str);
+void regex_replace (char *str);
+/**/
+
 /**/
 /* term.c */
 /**/
-extern int term_rows, term_cols;
+extern int term_rows, term_cols, term_timeout;
 int term_init ();
 void term_deinit ();
 
@@ -176,6 +1109,8 @@ void term_altbuf (bool on);
 
 void term_clear ();
 void term_cursor_reset ();
+void term_clear_line ();
+void term_goto (int row, int col);
 void term_cursor_up (int i);
 void term_cursor_up1 ();
 void term_cursor_down (int i);
@@ -203,5 +1138,8 @@ char *term_modname (enum RITE_MOD mod);
 char *term_eventname (enum RITE_EVENT evt);
 char *term_keyname (enum RITE_KEY key);
 
+int term_watch (int fd, bool on);
+void term_watch_out (int fd);
 int term_poll (event_t *evt);
+bool term_pending ();
 /**/
@@ -0,0 +1,379 @@
+#include "rite.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* a query may contain newlines, in which case it is matched as a run of
+ * "segments" over consecutive lines: the first must end a line, the last
+ * must start one, and the ones in between must be whole lines */
+
+int
+find_mem (char *s, int n, char *q, int m)
+{
+    char *p = s, *end;
+
+    if (m <= 0 || m > n)
+        return m <= 0 ? 0 : -1;
+
+    if (m == 1)
+        {
+            p = memchr (s, q[0], n);
+            return p == NULL ? -1 : p - s;
+        }
+
+    /* end is the last position a match can start at */
+    end = s + n - m;
+
+#ifdef __SSE2__
+    /* compare the first and last bytes of the query against 16 candidate
+     * positions at once, and only memcmp where both agree */
+    {
+        __m128i first = _mm_set1_epi8 (q[0]), last = _mm_set1_epi8 (q[m - 1]);
+
+        for (; p + 16 <= end + 1; p += 16)
+            {
+                __m128i a = _mm_loadu_si128 ((__m128i *)p);
+                __m128i b = _mm_loadu_si128 ((__m128i *)(p + m - 1));
+                unsigned int mask = _mm_movemask_epi8 (_mm_and_si128 (
+                    _mm_cmpeq_epi8 (a, first), _mm_cmpeq_epi8 (b, last)));
+
+                while (mask)
+                    {
+                        int bit = __builtin_ctz (mask);
+                        if (memcmp (p + bit + 1, q + 1, m - 2) == 0)
+                            return p + bit - s;
+                        mask &= mask - 1;
+                    }
+            }
+    }
+#endif
+
+    for (; p <= end; ++p)
+        {
+            if ((p = memchr (p, q[0], end - p + 1)) == NULL)
+                break;
+            if (p[m - 1] == q[m - 1] && memcmp (p + 1, q + 1, m - 2) == 0)
+                return p - s;
+        }
+
+    return -1;
+}
+
+/* length of the i'th segment of the query, and its offset in *seg */
+int
+find_segment (int i, char **seg)
+{
+    char *s = rite.find.str, *end = rite.find.str + rite.find.len, *nl;
+
+    for (;;)
+        {
+            nl = memchr (s, '\n', end - s);
+            if (i-- == 0)
+                break;
+            if (nl == NULL)
+                return -1;
+            s = nl + 1;
+        }
+
+    *seg = s;
+    return (nl == NULL ? end : nl) - s;
+}
+
+/* checks whether a multi line match starts in the given row, returning the
+ * column it starts at */
+int
+find_span (int row)
+{
+    page_t *page = rite.page;
+    line_t *l;
+    char *seg;
+    int i, m, col;
+
+    if ((l = vector_get (&page->lines, row)) == NULL
+        || (m = find_segment (0, &seg)) > LINE_LEN (l))
+        return -1;
+
+    col = LINE_LEN (l) - m;
+    if (memcmp (LINE_TEXT (l) + col, seg, m) != 0)
+        return -1;
+
+    for (i = 1; i < rite.find.segments; ++i)
+        {
+            m = find_segment (i, &seg);
+            if ((l = vector_get (&page->lines, row + i)) == NULL)
+                return -1;
+            if (i < rite.find.segments - 1 ? LINE_LEN (l) != m
+                                           : LINE_LEN (l) < m)
+                return -1;
+            if (memcmp (LINE_TEXT (l), seg, m) != 0)
+                return -1;
+        }
+
+    return col;
+}
+
+/* finds the first match in a row at or after from, or with back, the last
+ * match before from */
+int
+find_line (int row, int from, bool back)
+{
+    line_t *l = vector_get (&rite.page->lines, row);
+    int at, found = -1;
+
+    if (l == NULL || rite.find.len == 0)
+        return -1;
+
+    if (rite.find.segments > 1)
+        {
+            at = find_span (row);
+            if (back ? at < from : at >= from)
+                return at;
+            return -1;
+        }
+
+    if (!back)
+        {
+            if (from > LINE_LEN (l))
+                return -1;
+            at = find_mem (LINE_TEXT (l) + from, LINE_LEN (l) - from,
+                           rite.find.str, rite.find.len);
+            return at < 0 ? -1 : at + from;
+        }
+
+    for (at = 0; at < MIN (from, LINE_LEN (l)); ++at)
+        {
+            int i = find_mem (LINE_TEXT (l) + at, LINE_LEN (l) - at,
+                              rite.find.str, rite.find.len);
+            if (i < 0 || at + i >= from)
+                break;
+            found = at += i;
+        }
+
+    return found;
+}
+
+/* searches the page from *row, *col, wrapping around at either end */
+bool
+find_next (int *row, int *col, bool back)
+{
+    int i, r, c, len = rite.page->lines.len;
+
+    if (len == 0 || rite.find.len == 0)
+        return false;
+
+    for (i = 0; i <= len; ++i)
+        {
+            if (back)
+                {
+                    r = ((*row - i) % len + len) % len;
+                    c = (i == 0 ? *col : 0x7fffffff);
+                }
+            else
+                {
+                    r = (*row + i) % len;
+                    c = (i == 0 ? *col : 0);
+                }
+
+            if ((c = find_line (r, c, back)) >= 0)
+                {
+                    *row = r, *col = c;
+                    return true;
+                }
+        }
+
+    return false;
+}
+
+/* fills marks with [start, end) pairs for every match touching a row */
+int
+find_marks (int row, int *marks, int max)
+{
+    line_t *l = vector_get (&rite.page->lines, row);
+    int n = 0, at = 0, i, j;
+
+    if (l == NULL || rite.find.len == 0)
+        return 0;
+
+    if (rite.find.segments > 1)
+        {
+            for (i = 0; i < rite.find.segments && n < max; ++i)
+                {
+                    char *seg;
+                    int col = find_span (row - i);
+                    if (col < 0)
+                        continue;
+                    marks[2 * n] = (i == 0 ? col : 0);
+                    marks[2 * n + 1] = (i == rite.find.segments - 1
+                                            ? find_segment (i, &seg)
+                                            : LINE_LEN (l));
+                    n++;
+                }
+
+            /* spans from different matches can overlap on one row, so sort
+             * and merge them into ascending, disjoint runs */
+            for (i = 1; i < n; ++i)
+                {
+                    int a = marks[2 * i], b = marks[2 * i + 1];
+                    for (j = i; j > 0 && marks[2 * (j - 1)] > a; --j)
+                        {
+                            marks[2 * j] = marks[2 * (j - 1)];
+                            marks[2 * j + 1] = marks[2 * (j - 1) + 1];
+                        }
+                    marks[2 * j] = a, marks[2 * j + 1] = b;
+                }
+
+            for (i = 1, j = MIN (n, 1); i < n; ++i)
+                if (marks[2 * i] <= marks[2 * j - 1])
+                    marks[2 * j - 1]
+                        = MAX (marks[2 * j - 1], marks[2 * i + 1]);
+                else
+                    {
+                        marks[2 * j] = marks[2 * i];
+                        marks[2 * j + 1] = marks[2 * i + 1];
+                        j++;
+                    }
+
+            return j;
+        }
+
+    while (n < max && (i = find_line (row, at, false)) >= 0)
+        {
+            marks[2 * n] = i;
+            marks[2 * n + 1] = at = i + rite.find.len;
+            n++;
+        }
+
+    return n;
+}
+
+void
+find_start ()
+{
+    memset (&rite.find, 0, sizeof (find_t));
+    rite.find.on = true;
+    rite.find.row = rite.row, rite.find.col = rite.col;
+    hits_reset ();
+}
+
+void
+find_stop (bool accept)
+{
+    rite.find.on = false;
+    if (!accept)
+        {
+            rite.find.len = 0;
+            hits_reset ();
+            rite.col = rite.find.col;
+            move_row (rite.find.row);
+        }
+}
+
+/* re-runs the search from where it started, as the query changes */
+void
+find_update ()
+{
+    int i, row = rite.find.row, col = rite.find.col;
+
+    rite.find.segments = 1;
+    for (i = 0; i < rite.find.len; ++i)
+        if (rite.find.str[i] == '\n')
+            rite.find.segments++;
+
+    /* the index is rebuilt in the background from idle */
+    hits_reset ();
+
+    if ((rite.find.fail = !find_next (&row, &col, false)) == false)
+        {
+            rite.col = col;
+            move_row (row);
+        }
+}
+
+void
+find_step (bool back)
+{
+    rite.find.fail = !hits_step (back);
+}
+
+void
+find_key (event_t *evt)
+{
+    bool ctrl = RITE_MOD_GET (evt->mods, RITE_MOD_CTRL) != 0;
+
+    if (evt->type == RITE_EVENT_TEXT)
+        {
+            if (rite.find.len + evt->u.t.len < FIND_MAX)
+                {
+                    memcpy (rite.find.str + rite.find.len, evt->u.t.str,
+                            evt->u.t.len);
+                    rite.find.len += evt->u.t.len;
+                    rite.find.str[rite.find.len] = '\0';
+                    find_update ();
+                }
+        }
+    else if (evt->u.k >= 128)
+        switch (evt->u.k - 128)
+            {
+            case RITE_KEY_ENTER:
+                find_stop (true);
+                break;
+            case RITE_KEY_BACKSPACE:
+                if (rite.find.len > 0)
+                    {
+                        while (rite.find.len > 0
+                               && (rite.find.str[--rite.find.len] & 0xc0)
+                                      == 0x80)
+                            ;
+                        rite.find.str[rite.find.len] = '\0';
+                        find_update ();
+                    }
+                break;
+            case RITE_KEY_DOWN:
+                find_step (false);
+                break;
+            case RITE_KEY_UP:
+                find_step (true);
+                break;
+            }
+    else if (ctrl && evt->u.k == 'g')
+        find_stop (false);
+    else if (ctrl && evt->u.k == 'f')
+        find_step (false);
+    else if (ctrl && evt->u.k == 'r')
+        find_step (true);
+    else if ((isprint (evt->u.k) && !ctrl) || (ctrl && evt->u.k == 'j'))
+        {
+            /* ctrl-j puts a newline in the query, to match across lines */
+            if (rite.find.len < FIND_MAX - 1)
+                {
+                    rite.find.str[rite.find.len++] = ctrl ? '\n' : evt->u.k;
+                    rite.find.str[rite.find.len] = '\0';
+                    find_update ();
+                }
+        }
+}
+
+void
+find_print ()
+{
+    int i, n = hits_current ();
+
+    printf ("%sfind: ", rite.find.fail ? "failing " : "");
+    for (i = 0; i < rite.find.len; ++i)
+        if (rite.find.str[i] == '\n')
+            printf ("^J");
+        else
+            putchar (rite.find.str[i]);
+
+    if (rite.find.len == 0)
+        return;
+
+    printf ("  [");
+    if (n > 0)
+        printf ("%i/", n);
+    printf ("%i%s]", rite.hits.count, hits_done () ? "" : "+");
+}
@@ -0,0 +1,477 @@
+#include "rite.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SORT_SMALL 0x10
+#define SORT_SHARD_LINES 0x1000
+#define SORT_BUDGET 0x4000000
+#define SORT_READ 0x1000
+
+/* sorting, deduplicating and filtering lines, of the selection or the
+ * whole page. the lines are never copied: the result is a list of rows,
+ * and the new lines share the text of the old ones, which go to undo.
+ *
+ * a sort works on items of a row, where its text is and 8 bytes of it as
+ * a number, so most comparisons never touch the text or the lines. the
+ * bytes are the first after what all the lines start with, so lines that
+ * share indentation or a date still differ in them. shards of items are
+ * merge sorted on every core, then merged in rounds, each pair of runs cut
+ * into pieces at the same rank of both so the last rounds are parallel
+ * too. items are only ever compared by text and then row, so the sort is
+ * stable.
+ *
+ * when the items of a range would take more than SORT_BUDGET, it is
+ * sorted a budget at a time into runs on disk, merged as they are read
+ * back */
+
+/* how many bytes all of lines [first, first + n) start with */
+int
+sort_prefix (page_t *page, int first, int n)
+{
+    line_t *l = vector_get (&page->lines, first);
+    int skip = (l != NULL ? LINE_LEN (l) : 0), i, j;
+    char *s = (l != NULL ? LINE_TEXT (l) : NULL);
+
+    for (i = first + 1; i < first + n && skip > 0; ++i)
+        {
+            l = vector_get (&page->lines, i);
+            skip = MIN (skip, LINE_LEN (l));
+            for (j = 0; j < skip && LINE_TEXT (l)[j] == s[j]; ++j)
+                ;
+            skip = j;
+        }
+    return skip;
+}
+
+/* the 8 bytes of a line from skip on, the first the highest */
+uint64_t
+sort_key (line_t *l, int skip)
+{
+    uint8_t *s = (uint8_t *)LINE_TEXT (l);
+    int len = LINE_LEN (l), i;
+    uint64_t key = 0;
+
+    for (i = skip; i < skip + 8; ++i)
+        key = key << 8 | (i < len ? s[i] : 0);
+    return key;
+}
+
+/* orders lines by text, then by where they were */
+int
+sort_cmp (sortjob_t *job, sortitem_t *x, sortitem_t *y)
+{
+    int c, n, at = job->skip + 8;
+
+    if (x->key != y->key)
+        c = (x->key < y->key ? -1 : 1);
+    else if ((n = MIN (x->len, y->len) - at) <= 0
+             || (c = memcmp (x->s + at, y->s + at, n)) == 0)
+        c = x->len - y->len;
+
+    if (c == 0)
+        return x->row - y->row;
+    return job->reverse ? -c : c;
+}
+
+/* merges sorted a and b into out */
+void
+sort_merge (sortjob_t *job, sortitem_t *a, int na, sortitem_t *b, int nb,
+            sortitem_t *out)
+{
+    sortitem_t *ea = a + na, *eb = b + nb;
+
+    while (a < ea && b < eb)
+        *out++ = (sort_cmp (job, b, a) < 0 ? *b++ : *a++);
+    memcpy (out, a, (ea - a) * sizeof (sortitem_t));
+    memcpy (out + (ea - a), b, (eb - b) * sizeof (sortitem_t));
+}
+
+/* sorts n items in place, with as many spare */
+void
+sort_run (sortjob_t *job, sortitem_t *items, sortitem_t *spare, int n)
+{
+    sortitem_t *from = items, *to = spare, *swap, x;
+    int i, j, w;
+
+    for (i = 0; i < n; i += SORT_SMALL)
+        for (j = i + 1; j < MIN (i + SORT_SMALL, n); ++j)
+            {
+                x = items[j];
+                for (w = j; w > i && sort_cmp (job, &x, &items[w - 1]) < 0;
+                     --w)
+                    items[w] = items[w - 1];
+                items[w] = x;
+            }
+
+    for (w = SORT_SMALL; w < n; w *= 2)
+        {
+            for (i = 0; i < n; i += 2 * w)
+                sort_merge (job, from + i, MIN (w, n - i), from + i + w,
+                            MAX (MIN (w, n - i - w), 0), to + i);
+            swap = from, from = to, to = swap;
+        }
+    if (from != items)
+        memcpy (items, from, n * sizeof (sortitem_t));
+}
+
+/* how many of the first k items of merging a and b come from a */
+int
+sort_rank (sortjob_t *job, sortitem_t *a, int na, sortitem_t *b, int nb,
+           int k)
+{
+    int lo = MAX (0, k - nb), hi = MIN (k, na), i;
+
+    while (lo < hi)
+        {
+            i = (lo + hi) / 2;
+            if (sort_cmp (job, &a[i], &b[k - i - 1]) < 0)
+                lo = i + 1;
+            else
+                hi = i;
+        }
+    return lo;
+}
+
+void
+sort_fill_shard (void *data, int shard)
+{
+    sortjob_t *job = data;
+    int i = (long)job->n * shard / job->shards;
+    int end = (long)job->n * (shard + 1) / job->shards;
+    sortitem_t *x;
+    line_t *l;
+
+    for (; i < end; ++i)
+        {
+            x = &job->from[i];
+            l = vector_get (&job->page->lines, job->first + i);
+            x->key = sort_key (l, job->skip);
+            x->s = LINE_TEXT (l), x->len = LINE_LEN (l);
+            x->row = job->first + i;
+        }
+}
+
+void
+sort_run_shard (void *data, int shard)
+{
+    sortjob_t *job = data;
+    int at = shard * job->width;
+
+    sort_run (job, job->from + at, job->to + at,
+              MIN (job->width, job->n - at));
+}
+
+/* merges a piece of a pair of runs of the current round */
+void
+sort_merge_shard (void *data, int shard)
+{
+    sortjob_t *job = data;
+    int at = shard / job->pieces * 2 * job->width, q = shard % job->pieces;
+    int na = MIN (job->width, job->n - at);
+    int nb = MAX (MIN (job->width, job->n - at - na), 0);
+    sortitem_t *a = job->from + at, *b = a + na;
+    int k0 = (long)(na + nb) * q / job->pieces;
+    int k1 = (long)(na + nb) * (q + 1) / job->pieces;
+    int i0 = sort_rank (job, a, na, b, nb, k0);
+    int i1 = sort_rank (job, a, na, b, nb, k1);
+
+    sort_merge (job, a + i0, i1 - i0, b + k0 - i0, (k1 - i1) - (k0 - i0),
+                job->to + at + k0);
+}
+
+/* the items of lines [first, first + n), sorted on every core, keyed
+ * from skip on. returns them to be freed, or NULL */
+sortitem_t *
+sort_items (page_t *page, int first, int n, int skip, bool reverse)
+{
+    sortjob_t job;
+    sortitem_t *swap;
+    int pairs, threads = pool_size ();
+
+    job.page = page, job.first = first, job.n = n, job.reverse = reverse;
+    job.skip = skip;
+    job.from = malloc (MAX (n, 1) * sizeof (sortitem_t));
+    job.to = malloc (MAX (n, 1) * sizeof (sortitem_t));
+    if (job.from == NULL || job.to == NULL)
+        {
+            free (job.from), free (job.to);
+            return NULL;
+        }
+
+    job.shards = MAX (1, MIN (threads * 4, n / SORT_SHARD_LINES));
+    pool_run (sort_fill_shard, &job, job.shards);
+
+    job.width = (n + job.shards - 1) / job.shards;
+    pool_run (sort_run_shard, &job, job.shards);
+
+    for (; job.width < n; job.width *= 2)
+        {
+            pairs = (n + 2 * job.width - 1) / (2 * job.width);
+            job.pieces = MAX (1, 2 * threads / pairs);
+            pool_run (sort_merge_shard, &job, pairs * job.pieces);
+            swap = job.from, job.from = job.to, job.to = swap;
+        }
+
+    free (job.to);
+    return job.from;
+}
+
+/* the sorted rows of lines [first, first + n) into rows. a range whose
+ * items are over budget is sorted a budget at a time into runs on disk,
+ * which are then merged. returns -1 if it could not be done */
+int
+sort_rows (page_t *page, int first, int n, bool reverse, int *rows)
+{
+    int budget = SORT_BUDGET / sizeof (sortitem_t), nruns, i, j, best;
+    int skip = sort_prefix (page, first, n);
+    sortitem_t *items, *heads;
+    sortrun_t *runs;
+    sortjob_t job;
+    FILE *f;
+
+    if (n <= budget)
+        {
+            items = sort_items (page, first, n, skip, reverse);
+            if (items == NULL)
+                return -1;
+            for (i = 0; i < n; ++i)
+                rows[i] = items[i].row;
+            free (items);
+            return 0;
+        }
+
+    nruns = (n + budget - 1) / budget;
+    runs = malloc (nruns * sizeof (sortrun_t));
+    heads = malloc (nruns * SORT_READ * sizeof (sortitem_t));
+    if (runs == NULL || heads == NULL)
+        {
+            free (runs), free (heads);
+            return -1;
+        }
+    for (i = 0; i < nruns; ++i)
+        {
+            runs[i].left = MIN (budget, n - i * budget);
+            runs[i].f = f = tmpfile ();
+            items = sort_items (page, first + i * budget, runs[i].left,
+                                skip, reverse);
+            if (f == NULL || items == NULL
+                || fwrite (items, sizeof (sortitem_t), runs[i].left, f)
+                       != runs[i].left)
+                {
+                    nruns = i + 1;
+                    free (items);
+                    goto fail;
+                }
+            free (items);
+            rewind (f);
+            runs[i].at = runs[i].len = 0;
+        }
+
+    /* the smallest of the runs' next items goes out each time */
+    job.page = page, job.skip = skip, job.reverse = reverse;
+    for (j = 0; j < n; ++j)
+        {
+            for (best = -1, i = 0; i < nruns; ++i)
+                {
+                    if (runs[i].at == runs[i].len && runs[i].left > 0)
+                        {
+                            runs[i].len = fread (heads + i * SORT_READ,
+                                                 sizeof (sortitem_t),
+                                                 MIN (SORT_READ, runs[i].left),
+                                                 runs[i].f);
+                            if (runs[i].len <= 0)
+                                goto fail;
+                            runs[i].left -= runs[i].len;
+                            runs[i].at = 0;
+                        }
+                    if (runs[i].at < runs[i].len
+                        && (best < 0
+                            || sort_cmp (&job,
+                                         &heads[i * SORT_READ + runs[i].at],
+                                         &heads[best * SORT_READ
+                                                + runs[best].at])
+                                   < 0))
+                        best = i;
+                }
+            rows[j] = heads[best * SORT_READ + runs[best].at++].row;
+        }
+
+    for (i = 0; i < nruns; ++i)
+        fclose (runs[i].f);
+    free (runs), free (heads);
+    return 0;
+
+fail:
+    for (i = 0; i < nruns; ++i)
+        if (runs[i].f != NULL)
+            fclose (runs[i].f);
+    free (runs), free (heads);
+    return -1;
+}
+
+/* marks the lines of a shard that are not the same as the one before */
+void
+sort_uniq_shard (void *data, int shard)
+{
+    sortjob_t *job = data;
+    int i = (long)job->n * shard / job->shards;
+    int end = (long)job->n * (shard + 1) / job->shards;
+    line_t *a, *b;
+
+    for (; i < end; ++i)
+        {
+            a = vector_get (&job->page->lines, job->first + i);
+            b = vector_get (&job->page->lines, job->first + i - 1);
+            job->keep[i] = (i == 0 || LINE_LEN (a) != LINE_LEN (b)
+                            || memcmp (LINE_TEXT (a), LINE_TEXT (b),
+                                       LINE_LEN (a))
+                                   != 0);
+        }
+}
+
+/* marks the lines of a shard that the regex matches, or that it does not
+ * when reverse is set */
+void
+sort_filter_shard (void *data, int shard)
+{
+    sortjob_t *job = data;
+    int i = (long)job->n * shard / job->shards;
+    int end = (long)job->n * (shard + 1) / job->shards, len;
+    bool match;
+    line_t *l;
+    dfa_t d;
+
+    dfa_init (&d, &rite.re);
+    for (; i < end; ++i)
+        {
+            l = vector_get (&job->page->lines, job->first + i);
+            match = dfa_match (&d, LINE_TEXT (l), LINE_LEN (l), 0, &len) >= 0;
+            job->keep[i] = (match != job->reverse);
+        }
+    dfa_deinit (&d);
+}
+
+/* the rows of lines [first, first + n) that a shard function keeps. returns
+ * how many */
+int
+sort_keep (page_t *page, int first, int n, bool reverse,
+           void (*func) (void *data, int shard), int *rows)
+{
+    sortjob_t job;
+    int i, m = 0;
+
+    job.page = page, job.first = first, job.n = n, job.reverse = reverse;
+    if ((job.keep = malloc (MAX (n, 1))) == NULL)
+        return -1;
+    job.shards = MAX (1, MIN (pool_size () * 4, n / SORT_SHARD_LINES));
+    pool_run (func, &job, job.shards);
+
+    for (i = 0; i < n; ++i)
+        if (job.keep[i])
+            rows[m++] = first + i;
+    free (job.keep);
+    return m;
+}
+
+/* replaces lines [first, first + n) with the m lines at rows, as one
+ * undoable change. the new lines share the text of the old */
+void
+sort_apply (page_t *page, int first, int n, int *rows, int m)
+{
+    line_t *lines = malloc (MAX (m, 1) * sizeof (line_t)), *l;
+    int i;
+
+    if (lines == NULL)
+        return;
+
+    for (i = 0; i < m; ++i)
+        {
+            l = vector_get (&page->lines, rows[i]);
+            line_init (&lines[i]);
+            if (LINE_TEXT (l) == NULL)
+                continue;
+            lines[i].text = l->text;
+            share_ref (l);
+            lines[i].shared = true;
+        }
+    page_splice (page, first, n, lines, m);
+    free (lines);
+}
+
+/* the lines a command acts on: those of the selection, a last line it
+ * only reaches the start of left out, or else the whole page */
+void
+sort_range (int *first, int *n)
+{
+    int r0, c0, r1, c1;
+
+    if (!select_range (&r0, &c0, &r1, &c1))
+        {
+            *first = 0, *n = rite.page->lines.len;
+            return;
+        }
+
+    if (c1 == 0 && r1 > r0)
+        r1--;
+    *first = r0, *n = r1 - r0 + 1;
+}
+
+/* sort [-r], uniq, keep regex or drop regex, over the lines in range */
+void
+sort_command (char *str)
+{
+    int first, n, m, *rows, i;
+    char *arg = strchr (str, ' ');
+    page_t *page = rite.page;
+
+    sort_range (&first, &n);
+    if (n <= 0 || (rows = malloc (n * sizeof (int))) == NULL)
+        {
+            status ("no lines");
+            return;
+        }
+
+    while (arg != NULL && *arg == ' ')
+        arg++;
+    if (strcmp (str, "sort") == 0 || strcmp (str, "sort -r") == 0)
+        m = (sort_rows (page, first, n, str[4] != '\0', rows) ? -1 : n);
+    else if (strcmp (str, "uniq") == 0)
+        m = sort_keep (page, first, n, false, sort_uniq_shard, rows);
+    else if ((strncmp (str, "keep ", 5) == 0 || strncmp (str, "drop ", 5) == 0)
+             && arg != NULL && *arg != '\0')
+        {
+            if (re_compile (&rite.re, arg))
+                {
+                    status (rite.re.error);
+                    free (rows);
+                    return;
+                }
+            m = sort_keep (page, first, n, str[0] == 'd', sort_filter_shard,
+                           rows);
+        }
+    else
+        {
+            status ("sort [-r], uniq, keep regex or drop regex");
+            free (rows);
+            return;
+        }
+
+    for (i = 0; i < m && rows[i] == first + i; ++i)
+        ;
+    if (m < 0)
+        status ("out of memory");
+    else if (i == n && m == n)
+        status ("no change");
+    else
+        {
+            multi_clear ();
+            rite.selecting = false;
+            sort_apply (page, first, n, rows, m);
+            rite.row = first, rite.col = 0, rite.want = -1;
+            move_row (rite.row);
+            sprintf (rite.status, "%i of %i lines", m, n);
+        }
+    free (rows);
+}
@@ -0,0 +1,229 @@
+#include "rite.h"
+
+#include <string.h>
+
+#define STATS_BLOCK 0x100
+
+#define BLOCK(st, i) ((statblock_t *)vector_get (&(st)->blocks, (i)))
+#define TREE(st, i) ((statblock_t *)vector_get (&(st)->tree, (i)))
+
+/* the counts in the header. the totals are running counts, which every
+ * edit adjusts by what it takes out and puts in, and the words are counted
+ * by the pass that indexes them for completion.
+ *
+ * the cursor's byte offset is the bytes of the lines above it. the lines
+ * are kept in blocks of about STATS_BLOCK, each knowing how many lines and
+ * bytes it has, under a fenwick tree that sums any run of blocks from the
+ * first in log time. an edit within blocks adds along one path of the
+ * tree, and only a block splitting or running out of lines, which takes
+ * hundreds of lines coming or going, builds it again. so a keystroke and a
+ * frame cost the same on a huge page as on a small one */
+
+void
+stats_clear (page_t *page)
+{
+    stats_t *st = &page->stats;
+
+    vector_deinit (&st->blocks);
+    vector_deinit (&st->tree);
+    vector_init (&st->blocks, sizeof (statblock_t), 0x10);
+    vector_init (&st->tree, sizeof (statblock_t), 0x10);
+    st->bytes = st->words = 0;
+    st->dirty = false;
+}
+
+/* builds the tree again after blocks came or went */
+void
+stats_build (stats_t *st)
+{
+    int i, j, n = st->blocks.len;
+    statblock_t *t;
+
+    if (!st->dirty)
+        return;
+
+    if ((st->tree.len = n) > 0)
+        {
+            vector_resize (&st->tree);
+            memcpy (st->tree.data, st->blocks.data, n * sizeof (statblock_t));
+        }
+    for (i = 1; i <= n; ++i)
+        if ((j = i + (i & -i)) <= n)
+            {
+                t = TREE (st, j - 1);
+                t->lines += TREE (st, i - 1)->lines;
+                t->bytes += TREE (st, i - 1)->bytes;
+            }
+    st->dirty = false;
+}
+
+/* adds to the lines and bytes of a block */
+void
+stats_add (stats_t *st, int block, int lines, long bytes)
+{
+    statblock_t *b = BLOCK (st, block);
+    int i;
+
+    b->lines += lines, b->bytes += bytes;
+    if (st->dirty)
+        return;
+
+    for (i = block + 1; i <= st->tree.len; i += i & -i)
+        {
+            b = TREE (st, i - 1);
+            b->lines += lines, b->bytes += bytes;
+        }
+}
+
+/* the lines and bytes of the blocks before block */
+statblock_t
+stats_before (stats_t *st, int block)
+{
+    statblock_t sum, *t;
+    int i;
+
+    stats_build (st);
+    sum.lines = 0, sum.bytes = 0;
+    for (i = block; i > 0; i -= i & -i)
+        {
+            t = TREE (st, i - 1);
+            sum.lines += t->lines, sum.bytes += t->bytes;
+        }
+    return sum;
+}
+
+/* the block holding row, and the row's place in it. the row after the
+ * last is at the end of the last block */
+int
+stats_find (stats_t *st, int row, int *i)
+{
+    int n = st->blocks.len, block = 0, step;
+    statblock_t *t;
+
+    stats_build (st);
+    for (step = 1; step * 2 <= n; step *= 2)
+        ;
+    for (; n > 0 && step > 0; step /= 2)
+        if (block + step <= n
+            && (t = TREE (st, block + step - 1))->lines <= row)
+            {
+                block += step;
+                row -= t->lines;
+            }
+
+    if (block == n && n > 0)
+        row += BLOCK (st, --block)->lines;
+    *i = row;
+    return block;
+}
+
+long
+stats_line (page_t *page, int row)
+{
+    return LINE_LEN ((line_t *)vector_get (&page->lines, row)) + 1;
+}
+
+/* lines [row, row + n) of a page are about to go: their bytes are taken
+ * off, block by block */
+void
+stats_take (page_t *page, int row, int n)
+{
+    stats_t *st = &page->stats;
+    int block, i, end = row + n;
+    long bytes;
+
+    if (n <= 0)
+        return;
+
+    block = stats_find (st, row, &i);
+    while (row < end)
+        {
+            for (bytes = 0; row < end && i < BLOCK (st, block)->lines;
+                 ++row, ++i)
+                bytes += stats_line (page, row);
+            stats_add (st, block++, 0, -bytes);
+            st->bytes -= bytes;
+            i = 0;
+        }
+}
+
+/* cuts a block grown too big into blocks of STATS_BLOCK lines, the first
+ * of them starting at row */
+void
+stats_split (page_t *page, int block, int row)
+{
+    stats_t *st = &page->stats;
+    int lines = BLOCK (st, block)->lines, k, m, j;
+    statblock_t *b;
+
+    k = (lines - 1) / STATS_BLOCK + 1;
+    vector_splice (&st->blocks, block + 1, 0, k - 1);
+    for (m = 0; m < k; ++m)
+        {
+            b = BLOCK (st, block + m);
+            b->lines = MIN (STATS_BLOCK, lines - m * STATS_BLOCK);
+            for (b->bytes = 0, j = 0; j < b->lines; ++j)
+                b->bytes += stats_line (page, row++);
+        }
+    st->dirty = true;
+}
+
+/* lines [row, row + nold) of a page became nnew lines */
+void
+stats_edit (page_t *page, int row, int nold, int nnew)
+{
+    stats_t *st = &page->stats;
+    int block, i, take, k;
+    long bytes = 0;
+
+    /* the bytes of the old lines are gone already, so only their places
+     * are taken out */
+    block = stats_find (st, row, &i);
+    for (k = nold; k > 0; k -= take, i = 0)
+        {
+            take = MIN (k, BLOCK (st, block)->lines - i);
+            stats_add (st, block, -take, 0);
+            if (BLOCK (st, block)->lines == 0)
+                {
+                    vector_remove (&st->blocks, block);
+                    st->dirty = true;
+                }
+            else
+                block++;
+        }
+
+    if (nnew <= 0)
+        return;
+
+    if (st->blocks.len == 0)
+        {
+            memset (vector_append (&st->blocks), 0, sizeof (statblock_t));
+            st->dirty = true;
+        }
+    block = stats_find (st, row, &i);
+    for (k = row; k < row + nnew; ++k)
+        bytes += stats_line (page, k);
+    stats_add (st, block, nnew, bytes);
+    st->bytes += bytes;
+
+    if (BLOCK (st, block)->lines > 2 * STATS_BLOCK)
+        stats_split (page, block, row - i);
+}
+
+/* the byte offset of (row, col) in the file the page would be written as */
+long
+stats_offset (page_t *page, int row, int col)
+{
+    stats_t *st = &page->stats;
+    statblock_t before;
+    int block, i;
+
+    if (st->blocks.len == 0)
+        return 0;
+
+    block = stats_find (st, row, &i);
+    before = stats_before (st, block);
+    for (row -= i; i > 0; --i)
+        before.bytes += stats_line (page, row++);
+    return before.bytes + col;
+}
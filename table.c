@@ -0,0 +1,105 @@
+#include "rite.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define ITEM(t, i) ((char *)(t)->slots.data + (i) * (t)->slots.itemsize)
+#define EMPTY(p) (*(void **)(p) == NULL)
+
+/* hash tables with open addressing. items are kept in the slots
+ * themselves, of whatever size, and the first member of an item is a
+ * pointer that is NULL in an empty slot. a key is looked for from its
+ * hash on to the next empty slot, so the table is kept at most half full,
+ * and taking an item out moves back the ones after it that probed past
+ * it, which leaves no marks behind to slow the lookups after.
+ *
+ * a table knows how to hash an item, and to tell whether one is that of
+ * a key; what a key is is up to the table. whoever fills an empty slot
+ * counts the item in n */
+
+void
+table_init (table_t *t, int itemsize, int least,
+            unsigned long (*hash) (void *item),
+            bool (*same) (void *item, void *key))
+{
+    vector_init (&t->slots, itemsize, 0x10);
+    t->n = 0, t->least = least;
+    t->hash = hash, t->same = same;
+}
+
+void
+table_deinit (table_t *t)
+{
+    vector_deinit (&t->slots);
+    vector_init (&t->slots, t->slots.itemsize, 0x10);
+    t->n = 0;
+}
+
+/* the slot of key, or the empty one it would go in. NULL if the table has
+ * no slots yet */
+void *
+table_slot (table_t *t, unsigned long hash, void *key)
+{
+    unsigned long mask = t->slots.len - 1, i;
+    char *p;
+
+    if (t->slots.len == 0)
+        return NULL;
+    for (i = hash & mask; !EMPTY (p = ITEM (t, i)) && !t->same (p, key);
+         i = (i + 1) & mask)
+        ;
+    return p;
+}
+
+/* makes room for one more item, so a slot to add it in is to be looked
+ * for after */
+void
+table_room (table_t *t)
+{
+    vector_t old = t->slots;
+    unsigned long mask, k;
+    char *p;
+    int i;
+
+    if (2 * (t->n + 1) <= t->slots.len)
+        return;
+
+    vector_init (&t->slots, old.itemsize, 0x10);
+    t->slots.len = MAX (old.len * 2, t->least);
+    vector_resize (&t->slots);
+    memset (t->slots.data, 0, t->slots.len * t->slots.itemsize);
+
+    /* the items are all different, so each goes in the first empty slot */
+    mask = t->slots.len - 1;
+    for (i = 0; i < old.len; ++i)
+        if (!EMPTY (p = (char *)old.data + i * old.itemsize))
+            {
+                for (k = t->hash (p) & mask; !EMPTY (ITEM (t, k));
+                     k = (k + 1) & mask)
+                    ;
+                memcpy (ITEM (t, k), p, old.itemsize);
+            }
+    vector_deinit (&old);
+}
+
+/* takes the item in slot at out */
+void
+table_remove (table_t *t, void *at)
+{
+    unsigned long mask = t->slots.len - 1, i, j, k;
+    int size = t->slots.itemsize;
+
+    i = j = ((char *)at - ITEM (t, 0)) / size;
+    *(void **)ITEM (t, i) = NULL;
+    for (j = (j + 1) & mask; !EMPTY (ITEM (t, j)); j = (j + 1) & mask)
+        {
+            k = t->hash (ITEM (t, j)) & mask;
+            if (i <= j ? (k <= i || k > j) : (k <= i && k > j))
+                {
+                    memcpy (ITEM (t, i), ITEM (t, j), size);
+                    *(void **)ITEM (t, j) = NULL;
+                    i = j;
+                }
+        }
+    t->n--;
+}
@@ -11,10 +11,14 @@
  *
  * */
 
+#define _DEFAULT_SOURCE
+
 #include "rite.h"
 
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdio.h>
 #include <string.h>
@@ -30,6 +34,11 @@
 
 #define QUIT MAKE_CTRL ('q')
 
+#define TERM_MAX_FDS 16
+#define TERM_INPUT 0x400
+#define TERM_READ 16
+#define TERM_MOUSE_WAIT 50
+
 #define ESC "\x1b"
 #define CSI ESC "["
 
@@ -38,8 +47,17 @@ void term_sig (int sig);
 
 bool term_resized;
 int term_rows, term_cols;
+int term_timeout = -1;
+int term_fd = STDIN_FILENO;
 struct termios oldtermios, termios;
 
+struct pollfd term_fds[TERM_MAX_FDS];
+int term_nfds;
+
+/* bytes read from the terminal but not handled yet */
+char term_input[TERM_INPUT];
+int term_ninput;
+
 char *
 term_keyname (enum RITE_KEY key)
 {
@@ -58,6 +76,8 @@ term_eventname (enum RITE_EVENT evt)
         "KEY",
         "MOUSE",
         "RESIZED",
+        "FD",
+        "TEXT",
     };
     return eventnames[evt];
 }
@@ -91,8 +111,7 @@ char *st[] = {
 char **keymap;
 
 char modprefix[] = CSI "1;";
-char mouseprefix[] = CSI "M";
-char mouseformat[] = "%c%c%c";
+char mouseprefix[] = CSI "<";
 
 void
 term_altbuf (bool on)
@@ -115,6 +134,19 @@ term_cursor_reset ()
     printf (CSI "H");
 }
 
+void
+term_clear_line ()
+{
+    printf (CSI "K");
+}
+
+/* moves to a row and column, counted from 0 */
+void
+term_goto (int row, int col)
+{
+    printf (CSI "%i;%iH", row + 1, col + 1);
+}
+
 void
 term_cursor_move (int x, int y)
 {
@@ -172,13 +204,15 @@ term_cursor_show (bool on)
         printf (CSI "?25l");
 }
 
+/* presses, releases and drags with a button held (1002), reported as
+ * decimal numbers (1006) so no column is too wide to say */
 void
 term_mouse (bool on)
 {
     if (on)
-        printf (CSI "?9h");
+        printf (CSI "?1002h" CSI "?1006h");
     else
-        printf (CSI "?9l");
+        printf (CSI "?1006l" CSI "?1002l");
     fflush (stdout);
 }
 
@@ -238,6 +272,40 @@ term_sig (int sig)
         }
 }
 
+int
+term_watch (int fd, bool on)
+{
+    int i;
+    for (i = 1; i < term_nfds; ++i)
+        if (term_fds[i].fd == fd)
+            break;
+
+    if (on)
+        {
+            if (i < term_nfds)
+                return 0;
+            if (term_nfds == TERM_MAX_FDS)
+                return -1;
+            term_fds[term_nfds].fd = fd;
+            term_fds[term_nfds].events = POLLIN;
+            term_nfds++;
+        }
+    else if (i < term_nfds)
+        term_fds[i] = term_fds[--term_nfds];
+
+    return 0;
+}
+
+/* a watched fd is woken when it can be written to, not read from */
+void
+term_watch_out (int fd)
+{
+    int i;
+    for (i = 1; i < term_nfds; ++i)
+        if (term_fds[i].fd == fd)
+            term_fds[i].events = POLLOUT;
+}
+
 int
 term_init ()
 {
@@ -246,21 +314,30 @@ term_init ()
     term_rows = w.ws_row, term_cols = w.ws_col;
 
     signal (SIGWINCH, term_sig);
+    signal (SIGPIPE, SIG_IGN);
+
+    /* stdin may be carrying a file, so read keys from the terminal itself */
+    if (!isatty (STDIN_FILENO) && (term_fd = open ("/dev/tty", O_RDWR)) < 0)
+        return -1;
 
-    tcgetattr (0, &oldtermios);
+    tcgetattr (term_fd, &oldtermios);
     termios = oldtermios;
     termios.c_iflag
         &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL | IXON);
     termios.c_cflag &= ~(CSIZE | PARENB);
     termios.c_cflag |= CS8;
     termios.c_lflag &= ~(ECHO | ECHONL | ICANON | ISIG | IEXTEN);
-    tcsetattr (0, TCSANOW, &termios);
+    tcsetattr (term_fd, TCSANOW, &termios);
 
     term_altbuf (true);
 
     term_normal ();
     term_mouse (true);
 
+    term_fds[0].fd = term_fd;
+    term_fds[0].events = POLLIN;
+    term_nfds = 1;
+
     keymap = st;
     return 0;
 }
@@ -269,29 +346,217 @@ void
 term_deinit ()
 {
     term_mouse (false);
-    tcsetattr (0, TCSANOW, &oldtermios);
+    tcsetattr (term_fd, TCSANOW, &oldtermios);
+    if (term_fd != STDIN_FILENO)
+        close (term_fd);
     fflush (stdout);
     term_altbuf (false);
 }
 
+/* reads more of what the terminal sent, waiting up to wait ms for it */
 int
-term_poll (event_t *evt)
+term_fill (int wait)
 {
-    static char str[16];
-    static int i, len;
+    struct pollfd p;
+    int n = TERM_INPUT - term_ninput;
 
-    memset (evt, 0, sizeof (event_t));
+    p.fd = term_fd, p.events = POLLIN;
+    if (n <= 0 || poll (&p, 1, wait) <= 0
+        || (n = read (term_fd, term_input + term_ninput, n)) <= 0)
+        return 0;
+    term_ninput += n;
+    return n;
+}
+
+void
+term_take (int n)
+{
+    term_ninput -= n;
+    memmove (term_input, term_input + n, term_ninput);
+}
+
+/* parses a report, CSI < b ; x ; y, ending in M, or m for a release. returns
+ * its length, 0 if s is not one, or -1 if s is only the start of one */
+int
+term_mouse_parse (char *s, int len, event_t *evt)
+{
+    int v[3], i = strlen (mouseprefix), k = 0;
+
+    if (strncmp (s, mouseprefix, MIN (len, i)) != 0)
+        return 0;
+
+    for (v[0] = v[1] = v[2] = 0; i < len; ++i)
+        if (isdigit ((uint8_t)s[i]))
+            v[k] = MIN (v[k] * 10 + CHAR2DIGIT (s[i]), 0xffff);
+        else if (s[i] == ';' && k < 2)
+            k++;
+        else if ((s[i] == 'M' || s[i] == 'm') && k == 2)
+            {
+                /* a release names its button, and 3 says release */
+                evt->type = RITE_EVENT_MOUSE;
+                evt->u.m.b = (s[i] == 'm' ? (v[0] & ~3) | 3 : v[0]);
+                evt->u.m.x = v[1], evt->u.m.y = v[2];
+                evt->u.m.n = 1;
+                return i + 1;
+            }
+        else
+            return 0;
+
+    return -1;
+}
+
+/* takes a mouse report off the input, with the motion or wheel reports of
+ * the same button right behind it folded in: a drag only needs its last
+ * position, and a wheel burst scrolls by all its steps at once */
+bool
+term_mouse_read (event_t *evt)
+{
+    event_t next;
+    int n;
+
+    while ((n = term_mouse_parse (term_input, term_ninput, evt)) < 0
+           && term_ninput >= strlen (mouseprefix)
+           && term_fill (TERM_MOUSE_WAIT))
+        ;
+    if (n <= 0)
+        return false;
+    term_take (n);
+
+    while (evt->u.m.b & (32 | 64))
+        {
+            while ((n = term_mouse_parse (term_input, term_ninput, &next)) < 0
+                   && term_fill (0))
+                ;
+            if (n <= 0 || next.u.m.b != evt->u.m.b)
+                break;
+            term_take (n);
+            next.u.m.n += evt->u.m.n;
+            *evt = next;
+        }
+    return true;
+}
+
+/* waits for input, or for anything else to report in evt. returns true if
+ * there is input */
+bool
+term_wait (event_t *evt)
+{
+    int i, len;
 
-    if ((len = read (STDIN_FILENO, &str, 16)) <= 0)
+    if (poll (term_fds, term_nfds, term_timeout) <= 0)
         {
             if (term_resized)
                 {
                     term_resized = false;
                     evt->type = RITE_EVENT_RESIZED;
                 }
+            return false;
+        }
+
+    if (!(term_fds[0].revents & POLLIN))
+        {
+            for (i = 1; i < term_nfds; ++i)
+                if (term_fds[i].revents)
+                    {
+                        evt->type = RITE_EVENT_FD;
+                        evt->u.fd = term_fds[i].fd;
+                        break;
+                    }
+            return false;
+        }
+
+    if ((len = read (term_fd, term_input, TERM_READ)) <= 0)
+        {
+            if (term_resized)
+                {
+                    term_resized = false;
+                    evt->type = RITE_EVENT_RESIZED;
+                }
+            return false;
+        }
+
+    term_ninput = len;
+    return true;
+}
+
+/* the length of the text at the start of the input: printable bytes that
+ * are whole characters, up to a read's worth. a character cut off at the
+ * end of the input waits a little for the rest of it */
+int
+term_text ()
+{
+    int n, k;
+
+    for (;;)
+        {
+            for (n = 0; n < MIN (term_ninput, TERM_READ); ++n)
+                if (IS_CTRL (term_input[n]) || term_input[n] == 0x7f)
+                    break;
+            if ((k = utf8_check (term_input, n)) < 0)
+                return n;
+            if (k > 0 || n < term_ninput || !utf8_cut (term_input, n)
+                || term_fill (TERM_MOUSE_WAIT) <= 0)
+                return k;
+        }
+}
+
+/* the length of the key at the start of the input: a byte, an escape
+ * with the byte after it for alt, or a whole escape sequence up to its
+ * final byte, which waits a little for the rest if it is cut off */
+int
+term_key ()
+{
+    int i;
+
+    if (term_input[0] != ESC[0] || term_ninput == 1)
+        return 1;
+    if (term_input[1] == 'O')
+        return MIN (3, term_ninput);
+    if (term_input[1] != '[')
+        return 2;
+
+    for (i = 2; i < TERM_READ; ++i)
+        {
+            if (i == term_ninput && term_fill (TERM_MOUSE_WAIT) <= 0)
+                return i;
+            if (term_input[i] >= 0x40 && term_input[i] <= 0x7e)
+                return i + 1;
+            if (term_input[i] < 0x20 || term_input[i] > 0x3f)
+                return i;
+        }
+    return i;
+}
+
+int
+term_poll (event_t *evt)
+{
+    static char str[TERM_READ];
+    static int i, len;
+
+    memset (evt, 0, sizeof (event_t));
+
+    if (term_ninput == 0 && !term_wait (evt))
+        return 1;
+
+    if (term_mouse_read (evt))
+        return 1;
+
+    /* a character outside ascii, or a paste of several, comes as text */
+    if ((len = term_text ()) > 1
+        || (len == 1 && (uint8_t)term_input[0] >= 0x80))
+        {
+            evt->type = RITE_EVENT_TEXT;
+            evt->u.t.len = len;
+            memcpy (evt->u.t.str, term_input, len);
+            term_take (len);
             return 1;
         }
 
+    /* the rest waits for the polls after */
+    len = term_key ();
+    memcpy (str, term_input, len);
+    term_take (len);
+
     /* for (i = 0; i < len; ++i) */
     /*     printf ("[%i]\n", str[i]); */
 
@@ -333,22 +598,6 @@ term_poll (event_t *evt)
             }
             break;
         default:
-            if (strncmp (str, mouseprefix, strlen (mouseprefix)) == 0)
-                {
-                    uint8_t b = 0, x = 0, y = 0;
-                    if ((sscanf (&str[strlen (mouseprefix)], mouseformat, &b,
-                                 &x, &y))
-                        == 3)
-                        {
-                            evt->type = RITE_EVENT_MOUSE;
-                            evt->u.m.b = b - 32;
-                            evt->u.m.x = y - 32;
-                            evt->u.m.x = y - 32;
-                            return 1;
-                        }
-                    break;
-                }
-
             if (strncmp (str, modprefix, strlen (modprefix)) == 0)
                 {
                     RITE_MOD_SET (evt->mods,
@@ -374,3 +623,13 @@ term_poll (event_t *evt)
 
     return 1;
 }
+
+/* whether there is input waiting, without reading it */
+bool
+term_pending ()
+{
+    struct pollfd p;
+
+    p.fd = term_fd, p.events = POLLIN;
+    return term_ninput > 0 || poll (&p, 1, 0) > 0;
+}
@@ -0,0 +1,251 @@
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define WINDOW 0x400
+
+/* a client for rite's control socket (rite -s path), to drive it from the
+ * shell and to measure it:
+ *
+ *   ritectl path open file
+ *   ritectl path jump row col
+ *   ritectl path read row n
+ *   ritectl path stat
+ *   ritectl path edit row nold text     (text - reads it from stdin)
+ *   ritectl path bench n
+ *
+ * bench sends n edits of one line each and then n reads of one line, a
+ * window of them ahead of the replies, and prints how many a second went
+ * through */
+
+int fd;
+
+void
+put32 (char *p, unsigned long n)
+{
+    p[0] = n >> 24, p[1] = n >> 16, p[2] = n >> 8, p[3] = n;
+}
+
+unsigned long
+get32 (char *s)
+{
+    unsigned char *p = (unsigned char *)s;
+    return (unsigned long)p[0] << 24 | (unsigned long)p[1] << 16
+           | (unsigned long)p[2] << 8 | p[3];
+}
+
+void
+send_all (char *buf, long len)
+{
+    long n;
+
+    for (; len > 0; buf += n, len -= n)
+        if ((n = write (fd, buf, len)) <= 0)
+            {
+                perror ("write");
+                exit (1);
+            }
+}
+
+void
+recv_all (char *buf, long len)
+{
+    long n;
+
+    for (; len > 0; buf += n, len -= n)
+        if ((n = read (fd, buf, len)) <= 0)
+            {
+                fprintf (stderr, "connection closed\n");
+                exit (1);
+            }
+}
+
+/* frames a message of an op and len bytes of arguments */
+void
+request (char op, char *args, long len)
+{
+    char head[5];
+
+    put32 (head, len + 1);
+    head[4] = op;
+    send_all (head, 5);
+    send_all (args, len);
+}
+
+/* takes a reply, returning its payload and length, or exits on failure */
+char *
+reply (long *len)
+{
+    char head[4], *buf;
+
+    recv_all (head, 4);
+    *len = get32 (head);
+    buf = malloc (*len + 1);
+    recv_all (buf, *len);
+    buf[*len] = '\0';
+    if (*len == 0 || buf[0] != 0)
+        {
+            fprintf (stderr, "rite: %s\n", *len > 0 ? buf + 1 : "?");
+            exit (1);
+        }
+    *len -= 1;
+    memmove (buf, buf + 1, *len + 1);
+    return buf;
+}
+
+char *
+slurp (FILE *f, long *len)
+{
+    long size = 0x1000, n;
+    char *buf = malloc (size);
+
+    for (*len = 0; (n = fread (buf + *len, 1, size - *len, f)) > 0;)
+        if ((*len += n) == size)
+            buf = realloc (buf, size *= 2);
+    return buf;
+}
+
+double
+now ()
+{
+    struct timeval t;
+    gettimeofday (&t, NULL);
+    return t.tv_sec + t.tv_usec / 1e6;
+}
+
+/* n messages made by make, a window of them in flight at once, each
+ * half window going out in one write */
+double
+pipeline (long n, long (*make) (char *buf, long i))
+{
+    char *buf = malloc (WINDOW / 2 * 0x100);
+    double t = now ();
+    long i, sent = 0, got = 0, len, at;
+
+    while (got < n)
+        {
+            while (sent < n && sent - got < WINDOW)
+                {
+                    for (at = 0; sent < n && at < WINDOW / 2 * 0x100 - 0x100
+                                 && sent - got < WINDOW;
+                         ++sent)
+                        {
+                            len = make (buf + at + 4, sent);
+                            put32 (buf + at, len);
+                            at += len + 4;
+                        }
+                    send_all (buf, at);
+                }
+            for (i = 0; i < WINDOW / 2 && got < sent; ++i, ++got)
+                free (reply (&len));
+        }
+    free (buf);
+    return n / (now () - t);
+}
+
+long
+make_edit (char *buf, long i)
+{
+    int len = sprintf (buf + 17, "edit %li\n", i);
+
+    buf[0] = 'e';
+    put32 (buf + 1, 1);
+    put32 (buf + 5, i % 1000);
+    put32 (buf + 9, 1);
+    put32 (buf + 13, len);
+    return 17 + len;
+}
+
+long
+make_read (char *buf, long i)
+{
+    buf[0] = 'r';
+    put32 (buf + 1, i % 1000);
+    put32 (buf + 5, 1);
+    return 9;
+}
+
+int
+main (int argc, char *argv[])
+{
+    struct sockaddr_un addr;
+    char args[16], *text, *out;
+    long len, n;
+
+    if (argc < 3 || strlen (argv[1]) >= sizeof (addr.sun_path))
+        {
+            fprintf (stderr, "usage: ritectl socket command [args]\n");
+            return 1;
+        }
+
+    memset (&addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+    strcpy (addr.sun_path, argv[1]);
+    if ((fd = socket (AF_UNIX, SOCK_STREAM, 0)) < 0
+        || connect (fd, (struct sockaddr *)&addr, sizeof (addr)) < 0)
+        {
+            perror (argv[1]);
+            return 1;
+        }
+
+    if (strcmp (argv[2], "open") == 0 && argc == 4)
+        {
+            request ('o', argv[3], strlen (argv[3]));
+            out = reply (&len);
+            printf ("page %lu\n", get32 (out));
+        }
+    else if (strcmp (argv[2], "jump") == 0 && argc == 5)
+        {
+            put32 (args, atol (argv[3])), put32 (args + 4, atol (argv[4]));
+            request ('j', args, 8);
+            reply (&len);
+        }
+    else if (strcmp (argv[2], "read") == 0 && argc == 5)
+        {
+            put32 (args, atol (argv[3])), put32 (args + 4, atol (argv[4]));
+            request ('r', args, 8);
+            out = reply (&len);
+            fwrite (out, 1, len, stdout);
+        }
+    else if (strcmp (argv[2], "stat") == 0 && argc == 3)
+        {
+            request ('s', NULL, 0);
+            out = reply (&len);
+            printf ("page %lu, %lu lines, at %lu:%lu\n", get32 (out),
+                    get32 (out + 4), get32 (out + 8), get32 (out + 12));
+        }
+    else if (strcmp (argv[2], "edit") == 0 && argc == 6)
+        {
+            if (strcmp (argv[5], "-") == 0)
+                text = slurp (stdin, &n);
+            else
+                text = argv[5], n = strlen (text);
+            out = malloc (16 + n);
+            put32 (out, 1), put32 (out + 4, atol (argv[3]));
+            put32 (out + 8, atol (argv[4])), put32 (out + 12, n);
+            memcpy (out + 16, text, n);
+            request ('e', out, 16 + n);
+            out = reply (&len);
+            printf ("%lu lines\n", get32 (out));
+        }
+    else if (strcmp (argv[2], "bench") == 0 && argc == 4)
+        {
+            n = atol (argv[3]);
+            printf ("edits: %.0f/s\n", pipeline (n, make_edit));
+            printf ("reads: %.0f/s\n", pipeline (n, make_read));
+        }
+    else
+        {
+            fprintf (stderr, "ritectl: bad command\n");
+            return 1;
+        }
+
+    close (fd);
+    return 0;
+}
@@ -0,0 +1,215 @@
+#include "rite.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define UNDO_MAX 0x100
+
+/* every change is recorded as hunks: nnew lines starting at row replaced
+ * old lines. undoing a record puts the old lines back, newest hunk first.
+ * edits made between undo_begin and undo_end form a single record */
+
+undo_t *
+undo_record (page_t *page)
+{
+    undo_t *u;
+
+    if (page->undo_depth > 0 && page->undo.len > 0)
+        return vector_tail (&page->undo);
+
+    if (page->undo.len == UNDO_MAX)
+        {
+            u = vector_head (&page->undo);
+            undo_free (u);
+            vector_remove (&page->undo, 0);
+        }
+
+    if ((u = vector_append (&page->undo)) == NULL)
+        return NULL;
+
+    vector_init (&u->hunks, sizeof (hunk_t), 0x4);
+    u->row = rite.row, u->col = rite.col;
+    u->open = u->typing = false;
+    return u;
+}
+
+void
+undo_free (undo_t *u)
+{
+    int i, j;
+    for (i = 0; i < u->hunks.len; ++i)
+        {
+            hunk_t *h = vector_get (&u->hunks, i);
+            for (j = 0; j < h->old.len; ++j)
+                line_deinit (vector_get (&h->old, j));
+            vector_deinit (&h->old);
+        }
+    vector_deinit (&u->hunks);
+}
+
+void
+undo_clear (page_t *page)
+{
+    int i;
+    for (i = 0; i < page->undo.len; ++i)
+        undo_free (vector_get (&page->undo, i));
+    page->undo.len = 0;
+    vector_resize (&page->undo);
+}
+
+void
+undo_begin (page_t *page)
+{
+    undo_t *u;
+
+    if (page->undo_depth == 0 && (u = undo_record (page)) != NULL)
+        u->open = true;
+    page->undo_depth++;
+}
+
+void
+undo_end (page_t *page)
+{
+    undo_t *u;
+
+    if (page->undo_depth == 0 || --page->undo_depth > 0)
+        return;
+
+    if ((u = vector_tail (&page->undo)) != NULL)
+        {
+            u->open = false;
+            if (u->hunks.len == 0)
+                {
+                    undo_free (u);
+                    page->undo.len--;
+                    vector_resize (&page->undo);
+                }
+        }
+}
+
+hunk_t *
+undo_hunk (page_t *page, int row, int nold, int nnew)
+{
+    undo_t *u = undo_record (page);
+    hunk_t *h;
+
+    if (u == NULL || (h = vector_append (&u->hunks)) == NULL)
+        return NULL;
+
+    h->row = row, h->nnew = nnew;
+    vector_init (&h->old, sizeof (line_t), MAX (nold, 1));
+    h->old.len = nold;
+    vector_resize (&h->old);
+    return h;
+}
+
+/* copies lines [row, row + nold) before they are edited in place into nnew
+ * lines, first giving them text of their own if it is shared. a run of
+ * single line edits on one row, typed one after another, shares one
+ * record */
+void
+undo_save (page_t *page, int row, int nold, int nnew)
+{
+    undo_t *u = (page->undo.len > 0 ? vector_tail (&page->undo) : NULL);
+    hunk_t *h;
+    int i;
+
+    page_editing (page, row, nold);
+    for (i = 0; i < nold; ++i)
+        share_own (vector_get (&page->lines, row + i));
+
+    if (u != NULL && u->typing && u->hunks.len == 1 && nold == 1
+        && nnew == 1)
+        {
+            h = vector_head (&u->hunks);
+            if (h->row == row && h->old.len == 1 && h->nnew == 1)
+                return;
+        }
+
+    if ((h = undo_hunk (page, row, nold, nnew)) == NULL)
+        return;
+    if (page->undo_depth == 0)
+        ((undo_t *)vector_tail (&page->undo))->typing = true;
+
+    for (i = 0; i < nold; ++i)
+        line_copy (vector_get (&h->old, i), vector_get (&page->lines, row + i));
+}
+
+/* the typing after this goes in a record of its own */
+void
+undo_seal (page_t *page)
+{
+    undo_t *u;
+
+    if (page != NULL && (u = vector_tail (&page->undo)) != NULL)
+        u->typing = false;
+}
+
+/* replaces lines [row, row + nold) with nnew ready made lines, handing the
+ * old ones to the undo record rather than copying them */
+void
+page_splice (page_t *page, int row, int nold, line_t *lines, int nnew)
+{
+    hunk_t *h;
+    line_t *at;
+
+    page_editing (page, row, nold);
+    h = undo_hunk (page, row, nold, nnew);
+    if (h != NULL && nold > 0)
+        memcpy (vector_head (&h->old), vector_get (&page->lines, row),
+                nold * sizeof (line_t));
+    else if (h == NULL)
+        {
+            int i;
+            for (i = 0; i < nold; ++i)
+                line_deinit (vector_get (&page->lines, row + i));
+        }
+
+    if ((at = vector_splice (&page->lines, row, nold, nnew)) != NULL)
+        memcpy (at, lines, nnew * sizeof (line_t));
+
+    page->dirty = true;
+    page_edited (page, row, nold, nnew);
+}
+
+int
+undo (page_t *page)
+{
+    undo_t *u;
+    int i, j;
+
+    if (page->undo.len == 0 || page->undo_depth > 0)
+        return -1;
+
+    u = vector_tail (&page->undo);
+    for (i = u->hunks.len - 1; i >= 0; --i)
+        {
+            hunk_t *h = vector_get (&u->hunks, i);
+            line_t *at;
+
+            page_editing (page, h->row, h->nnew);
+            for (j = 0; j < h->nnew; ++j)
+                line_deinit (vector_get (&page->lines, h->row + j));
+
+            if ((at = vector_splice (&page->lines, h->row, h->nnew,
+                                     h->old.len))
+                != NULL)
+                memcpy (at, vector_head (&h->old),
+                        h->old.len * sizeof (line_t));
+            page_edited (page, h->row, h->nnew, h->old.len);
+            h->old.len = 0;
+        }
+
+    if (rite.page == page)
+        {
+            rite.col = u->col;
+            move_row (u->row);
+        }
+
+    undo_free (u);
+    page->undo.len--;
+    vector_resize (&page->undo);
+    undo_seal (page);
+    page->dirty = true;
+    return 0;
+}
@@ -0,0 +1,278 @@
+#include "rite.h"
+
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* codepoint ranges, sorted, for the display width of a codepoint. marks
+ * that combine with the character before them take no column, and east
+ * asian wide and fullwidth characters take two */
+
+uint32_t utf8_zero[][2] = {
+    { 0x0300, 0x036f },   { 0x0483, 0x0489 },   { 0x0591, 0x05bd },
+    { 0x05bf, 0x05bf },   { 0x05c1, 0x05c2 },   { 0x05c4, 0x05c5 },
+    { 0x05c7, 0x05c7 },   { 0x0610, 0x061a },   { 0x064b, 0x065f },
+    { 0x0670, 0x0670 },   { 0x06d6, 0x06dc },   { 0x06df, 0x06e4 },
+    { 0x06e7, 0x06e8 },   { 0x06ea, 0x06ed },   { 0x0711, 0x0711 },
+    { 0x0730, 0x074a },   { 0x07a6, 0x07b0 },   { 0x07eb, 0x07f3 },
+    { 0x0816, 0x082d },   { 0x0859, 0x085b },   { 0x08d3, 0x0903 },
+    { 0x093a, 0x093c },   { 0x093e, 0x094f },   { 0x0951, 0x0957 },
+    { 0x0962, 0x0963 },   { 0x0981, 0x0983 },   { 0x09bc, 0x09bc },
+    { 0x09be, 0x09cd },   { 0x09d7, 0x09d7 },   { 0x09e2, 0x09e3 },
+    { 0x0a01, 0x0a03 },   { 0x0a3c, 0x0a51 },   { 0x0a70, 0x0a71 },
+    { 0x0a75, 0x0a75 },   { 0x0a81, 0x0a83 },   { 0x0abc, 0x0abc },
+    { 0x0abe, 0x0acd },   { 0x0b01, 0x0b03 },   { 0x0b3c, 0x0b3c },
+    { 0x0b3e, 0x0b57 },   { 0x0b82, 0x0b82 },   { 0x0bbe, 0x0bcd },
+    { 0x0bd7, 0x0bd7 },   { 0x0c00, 0x0c04 },   { 0x0c3e, 0x0c56 },
+    { 0x0c81, 0x0c83 },   { 0x0cbc, 0x0cbc },   { 0x0cbe, 0x0cd6 },
+    { 0x0d00, 0x0d03 },   { 0x0d3b, 0x0d3c },   { 0x0d3e, 0x0d4d },
+    { 0x0d57, 0x0d57 },   { 0x0d81, 0x0d83 },   { 0x0dca, 0x0df3 },
+    { 0x0e31, 0x0e31 },   { 0x0e34, 0x0e3a },   { 0x0e47, 0x0e4e },
+    { 0x0eb1, 0x0eb1 },   { 0x0eb4, 0x0ebc },   { 0x0ec8, 0x0ecd },
+    { 0x0f18, 0x0f19 },   { 0x0f35, 0x0f39 },   { 0x0f3e, 0x0f3f },
+    { 0x0f71, 0x0f84 },   { 0x0f86, 0x0f87 },   { 0x0f8d, 0x0fbc },
+    { 0x102b, 0x103e },   { 0x1056, 0x1059 },   { 0x1160, 0x11ff },
+    { 0x135d, 0x135f },   { 0x1712, 0x1714 },   { 0x17b4, 0x17d3 },
+    { 0x180b, 0x180d },   { 0x1a17, 0x1a1b },   { 0x1ab0, 0x1aff },
+    { 0x1b00, 0x1b04 },   { 0x1b34, 0x1b44 },   { 0x1dc0, 0x1dff },
+    { 0x200b, 0x200f },   { 0x202a, 0x202e },   { 0x2060, 0x2064 },
+    { 0x20d0, 0x20f0 },   { 0x2cef, 0x2cf1 },   { 0x2de0, 0x2dff },
+    { 0x302a, 0x302f },   { 0x3099, 0x309a },   { 0xa66f, 0xa672 },
+    { 0xa674, 0xa67d },   { 0xa69e, 0xa69f },   { 0xa6f0, 0xa6f1 },
+    { 0xa802, 0xa802 },   { 0xa806, 0xa806 },   { 0xa80b, 0xa80b },
+    { 0xa823, 0xa827 },   { 0xa8c4, 0xa8c5 },   { 0xa8e0, 0xa8f1 },
+    { 0xfb1e, 0xfb1e },   { 0xfe00, 0xfe0f },   { 0xfe20, 0xfe2f },
+    { 0xfeff, 0xfeff },   { 0x1f3fb, 0x1f3ff }, { 0xe0000, 0xe0fff },
+};
+
+uint32_t utf8_wide[][2] = {
+    { 0x1100, 0x115f },   { 0x231a, 0x231b },   { 0x2329, 0x232a },
+    { 0x23e9, 0x23ec },   { 0x23f0, 0x23f0 },   { 0x23f3, 0x23f3 },
+    { 0x25fd, 0x25fe },   { 0x2614, 0x2615 },   { 0x2648, 0x2653 },
+    { 0x267f, 0x267f },   { 0x2693, 0x2693 },   { 0x26a1, 0x26a1 },
+    { 0x26aa, 0x26ab },   { 0x26bd, 0x26be },   { 0x26c4, 0x26c5 },
+    { 0x26ce, 0x26ce },   { 0x26d4, 0x26d4 },   { 0x26ea, 0x26ea },
+    { 0x26f2, 0x26f3 },   { 0x26f5, 0x26f5 },   { 0x26fa, 0x26fa },
+    { 0x26fd, 0x26fd },   { 0x2705, 0x2705 },   { 0x270a, 0x270b },
+    { 0x2728, 0x2728 },   { 0x274c, 0x274c },   { 0x274e, 0x274e },
+    { 0x2753, 0x2755 },   { 0x2757, 0x2757 },   { 0x2795, 0x2797 },
+    { 0x27b0, 0x27b0 },   { 0x27bf, 0x27bf },   { 0x2b1b, 0x2b1c },
+    { 0x2b50, 0x2b50 },   { 0x2b55, 0x2b55 },   { 0x2e80, 0x303e },
+    { 0x3041, 0x3247 },   { 0x3250, 0x4dbf },   { 0x4e00, 0xa4cf },
+    { 0xa960, 0xa97f },   { 0xac00, 0xd7a3 },   { 0xf900, 0xfaff },
+    { 0xfe10, 0xfe19 },   { 0xfe30, 0xfe6f },   { 0xff00, 0xff60 },
+    { 0xffe0, 0xffe6 },   { 0x16fe0, 0x16fe4 }, { 0x17000, 0x18cff },
+    { 0x1b000, 0x1b2ff }, { 0x1f004, 0x1f004 }, { 0x1f0cf, 0x1f0cf },
+    { 0x1f18e, 0x1f18e }, { 0x1f191, 0x1f19a }, { 0x1f200, 0x1f251 },
+    { 0x1f300, 0x1f320 }, { 0x1f32d, 0x1f335 }, { 0x1f337, 0x1f37c },
+    { 0x1f37e, 0x1f393 }, { 0x1f3a0, 0x1f3ca }, { 0x1f3cf, 0x1f3d3 },
+    { 0x1f3e0, 0x1f3f0 }, { 0x1f3f4, 0x1f3f4 }, { 0x1f3f8, 0x1f43e },
+    { 0x1f440, 0x1f440 }, { 0x1f442, 0x1f4fc }, { 0x1f4ff, 0x1f53d },
+    { 0x1f54b, 0x1f54e }, { 0x1f550, 0x1f567 }, { 0x1f57a, 0x1f57a },
+    { 0x1f595, 0x1f596 }, { 0x1f5a4, 0x1f5a4 }, { 0x1f5fb, 0x1f64f },
+    { 0x1f680, 0x1f6c5 }, { 0x1f6cc, 0x1f6cc }, { 0x1f6d0, 0x1f6d2 },
+    { 0x1f6d5, 0x1f6d7 }, { 0x1f6eb, 0x1f6ec }, { 0x1f6f4, 0x1f6fc },
+    { 0x1f7e0, 0x1f7eb }, { 0x1f90c, 0x1f93a }, { 0x1f93c, 0x1f945 },
+    { 0x1f947, 0x1f9ff }, { 0x1fa70, 0x1faff }, { 0x20000, 0x2fffd },
+    { 0x30000, 0x3fffd },
+};
+
+bool
+utf8_range (uint32_t (*table)[2], int n, uint32_t c)
+{
+    int lo = 0, hi = n - 1, mid;
+
+    if (c < table[0][0] || c > table[n - 1][1])
+        return false;
+
+    while (lo <= hi)
+        {
+            mid = (lo + hi) / 2;
+            if (c > table[mid][1])
+                lo = mid + 1;
+            else if (c < table[mid][0])
+                hi = mid - 1;
+            else
+                return true;
+        }
+
+    return false;
+}
+
+/* decodes the sequence at s into *c, returning its length, or 0 if it is
+ * malformed, overlong, a surrogate or cut short by n */
+int
+utf8_decode (char *s, int n, uint32_t *c)
+{
+    uint8_t *p = (uint8_t *)s;
+    int len, i;
+
+    if (n <= 0)
+        return 0;
+
+    if (p[0] < 0x80)
+        {
+            *c = p[0];
+            return 1;
+        }
+    else if (p[0] < 0xc2)
+        return 0;
+    else if (p[0] < 0xe0)
+        len = 2, *c = p[0] & 0x1f;
+    else if (p[0] < 0xf0)
+        len = 3, *c = p[0] & 0x0f;
+    else if (p[0] < 0xf5)
+        len = 4, *c = p[0] & 0x07;
+    else
+        return 0;
+
+    if (len > n)
+        return 0;
+
+    for (i = 1; i < len; ++i)
+        {
+            if ((p[i] & 0xc0) != 0x80)
+                return 0;
+            *c = (*c << 6) | (p[i] & 0x3f);
+        }
+
+    if ((len == 3 && (*c < 0x800 || (*c >= 0xd800 && *c <= 0xdfff)))
+        || (len == 4 && (*c < 0x10000 || *c > 0x10ffff)))
+        return 0;
+
+    return len;
+}
+
+int
+utf8_encode (uint32_t c, char *s)
+{
+    uint8_t *p = (uint8_t *)s;
+
+    if (c < 0x80)
+        return p[0] = c, 1;
+    if (c < 0x800)
+        return p[0] = 0xc0 | (c >> 6), p[1] = 0x80 | (c & 0x3f), 2;
+    if (c < 0x10000)
+        {
+            p[0] = 0xe0 | (c >> 12);
+            p[1] = 0x80 | ((c >> 6) & 0x3f), p[2] = 0x80 | (c & 0x3f);
+            return 3;
+        }
+    p[0] = 0xf0 | (c >> 18), p[1] = 0x80 | ((c >> 12) & 0x3f);
+    p[2] = 0x80 | ((c >> 6) & 0x3f), p[3] = 0x80 | (c & 0x3f);
+    return 4;
+}
+
+int
+utf8_width (uint32_t c)
+{
+    if (c < 0x300)
+        return 1;
+    if (utf8_range (utf8_zero, sizeof (utf8_zero) / sizeof (utf8_zero[0]), c))
+        return 0;
+    if (c >= 0x1100
+        && utf8_range (utf8_wide, sizeof (utf8_wide) / sizeof (utf8_wide[0]),
+                       c))
+        return 2;
+    return 1;
+}
+
+/* length of the leading run of ascii bytes in s */
+int
+utf8_ascii (char *s, int n)
+{
+    char *p = s, *end = s + n;
+
+#ifdef __SSE2__
+    for (; p + 16 <= end; p += 16)
+        {
+            int mask = _mm_movemask_epi8 (_mm_loadu_si128 ((__m128i *)p));
+            if (mask)
+                return p + __builtin_ctz (mask) - s;
+        }
+#endif
+
+    while (p < end && (uint8_t)*p < 0x80)
+        p++;
+    return p - s;
+}
+
+/* whether the n bytes at s are the start of a sequence cut off before its
+ * end, as a read may leave them */
+bool
+utf8_cut (char *s, int n)
+{
+    uint8_t *p = (uint8_t *)s;
+    int len, i;
+
+    if (n <= 0 || p[0] < 0xc2 || p[0] >= 0xf5)
+        return false;
+    len = p[0] < 0xe0 ? 2 : p[0] < 0xf0 ? 3 : 4;
+    for (i = 1; i < n; ++i)
+        if ((p[i] & 0xc0) != 0x80)
+            return false;
+    return n < len;
+}
+
+/* offset of the first malformed byte in s, or -1 if it is all valid. runs
+ * of ascii, by far the common case, are skipped 16 bytes at a time */
+int
+utf8_check (char *s, int n)
+{
+    uint32_t c;
+    int i = 0, k;
+
+    while ((i += utf8_ascii (s + i, n - i)) < n)
+        {
+            if ((k = utf8_decode (s + i, n - i, &c)) == 0)
+                return i;
+            i += k;
+        }
+
+    return -1;
+}
+
+/* length of the grapheme cluster at s, and its width in *width. a base
+ * character takes any combining marks, variation selectors and zero width
+ * joined characters after it, and regional indicators go in pairs */
+int
+utf8_cluster (char *s, int n, int *width)
+{
+    uint32_t c, next;
+    int len, k;
+
+    if ((len = utf8_decode (s, n, &c)) == 0)
+        {
+            *width = 1;
+            return 1;
+        }
+
+    *width = utf8_width (c);
+
+    if (c >= 0x1f1e6 && c <= 0x1f1ff
+        && (k = utf8_decode (s + len, n - len, &next)) > 0 && next >= 0x1f1e6
+        && next <= 0x1f1ff)
+        len += k;
+
+    while (len < n && (uint8_t)s[len] >= 0x80
+           && (k = utf8_decode (s + len, n - len, &next)) > 0)
+        {
+            if (next == 0x200d)
+                {
+                    len += k;
+                    if ((k = utf8_decode (s + len, n - len, &next)) > 0)
+                        len += k;
+                }
+            else if (utf8_width (next) == 0)
+                len += k;
+            else
+                break;
+        }
+
+    /* a lone mark at the start of a line still needs a cell to sit in */
+    if (*width == 0)
+        *width = 1;
+
+    return len;
+}
@@ -0,0 +1,391 @@
+#include "rite.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define VIEW(i) (*(view_t **)vector_get (&rite.views, (i)))
+
+/* split windows. the screen between the header and the status line is cut
+ * into views by a tree of splits, each view showing a page from its own
+ * cursor and viewport, with its own wrap at its own width. views of one
+ * page share its lines, so an edit in one shows in all of them.
+ *
+ * the focused view's cursor and viewport live in rite while it has focus,
+ * like everything else that edits, and are saved into it to be drawn. the
+ * focused view is drawn every time, and the others only when an edit
+ * reaches the lines they show: rite.views is kept in screen order */
+
+view_t *
+view_new (page_t *page)
+{
+    view_t *v = malloc (sizeof (view_t));
+
+    memset (v, 0, sizeof (view_t));
+    v->page = page;
+    v->dirty = true;
+    wrap_reset (v);
+    return v;
+}
+
+void
+view_free (view_t *v)
+{
+    v->wrap.on = false;
+    wrap_reset (v);
+    vector_deinit (&v->wrap.blocks);
+    vector_deinit (&v->wrap.lines);
+    vector_deinit (&v->wrap.rows);
+    free (v);
+}
+
+/* copies the cursor and viewport of the focused view out of rite */
+void
+view_save ()
+{
+    if (rite.view == NULL)
+        return;
+
+    rite.view->page = rite.page;
+    rite.view->at.row = rite.row, rite.view->at.col = rite.col;
+    rite.view->at.scroll = rite.scroll;
+    rite.view->at.subscroll = rite.subscroll;
+    rite.view->at.hscroll = rite.hscroll;
+}
+
+void
+view_load ()
+{
+    rite.page = rite.view->page;
+    rite.row = rite.view->at.row, rite.col = rite.view->at.col;
+    rite.scroll = rite.view->at.scroll;
+    rite.subscroll = rite.view->at.subscroll;
+    rite.hscroll = rite.view->at.hscroll;
+}
+
+void
+views_init (page_t *page)
+{
+    vector_init (&rite.views, sizeof (view_t *), 0x4);
+    rite.splits = malloc (sizeof (split_t));
+    memset (rite.splits, 0, sizeof (split_t));
+    rite.splits->view = rite.view = view_new (page);
+    *(view_t **)vector_append (&rite.views) = rite.view;
+    rite.repaint = true;
+}
+
+void
+views_free_split (split_t *s)
+{
+    if (s == NULL)
+        return;
+
+    views_free_split (s->half[0]);
+    views_free_split (s->half[1]);
+    if (s->view != NULL)
+        view_free (s->view);
+    free (s);
+}
+
+void
+views_free ()
+{
+    views_free_split (rite.splits);
+    vector_deinit (&rite.views);
+    rite.splits = NULL;
+    rite.view = NULL;
+}
+
+/* gives a split the rectangle at (y, x), halving it between its halves
+ * with a row or column left for the line between them */
+void
+views_place (split_t *s, int y, int x, int rows, int cols)
+{
+    view_t *v = s->view;
+    int a;
+
+    s->y = y, s->x = x, s->rows = rows, s->cols = cols;
+    if (v != NULL)
+        {
+            v->y = y, v->x = x, v->rows = rows, v->cols = cols;
+            v->dirty = true;
+            return;
+        }
+
+    if (s->vertical)
+        {
+            a = (cols - 1) / 2;
+            views_place (s->half[0], y, x, rows, a);
+            views_place (s->half[1], y, x + a + 1, rows, cols - a - 1);
+        }
+    else
+        {
+            a = (rows - 1) / 2;
+            views_place (s->half[0], y, x, a, cols);
+            views_place (s->half[1], y + a + 1, x, rows - a - 1, cols);
+        }
+}
+
+void
+views_layout ()
+{
+    views_place (rite.splits, 1, 0, MAX (PAGE_ROWS, 0), term_cols);
+}
+
+split_t *
+views_leaf (split_t *s, view_t *v)
+{
+    split_t *found;
+
+    if (s == NULL || s->view == v)
+        return s;
+    if ((found = views_leaf (s->half[0], v)) != NULL)
+        return found;
+    return views_leaf (s->half[1], v);
+}
+
+int
+views_index (view_t *v)
+{
+    int i;
+
+    for (i = 0; i < rite.views.len; ++i)
+        if (VIEW (i) == v)
+            return i;
+    return -1;
+}
+
+/* moves the focus to another view, taking its cursor and page */
+void
+views_focus (view_t *v)
+{
+    page_t *page = rite.page;
+
+    if (v == rite.view)
+        return;
+
+    view_save ();
+    multi_clear ();
+    rite.view->dirty = true;
+    rite.view = v;
+    view_load ();
+    v->dirty = true;
+    rite.want = -1;
+    if (rite.page != page)
+        hits_reset ();
+    move_row (rite.row);
+}
+
+/* cuts the focused view in two, side by side or one above the other.
+ * the new half shows the same page from the same place, and takes focus */
+void
+views_split (bool vertical)
+{
+    split_t *s = views_leaf (rite.splits, rite.view), *a, *b;
+    view_t *v;
+
+    view_save ();
+    v = view_new (rite.page);
+    v->at = rite.view->at;
+    v->wrap.on = rite.view->wrap.on;
+    wrap_reset (v);
+
+    a = malloc (sizeof (split_t)), b = malloc (sizeof (split_t));
+    memset (a, 0, sizeof (split_t)), memset (b, 0, sizeof (split_t));
+    a->view = s->view, b->view = v;
+    a->parent = b->parent = s;
+    s->view = NULL;
+    s->vertical = vertical;
+    s->half[0] = a, s->half[1] = b;
+
+    vector_splice (&rite.views, views_index (rite.view) + 1, 0, 1);
+    *(view_t **)vector_get (&rite.views, views_index (rite.view) + 1) = v;
+
+    rite.repaint = true;
+    views_focus (v);
+}
+
+/* closes the focused view, giving its room to the other half of its split */
+void
+views_close ()
+{
+    split_t *s = views_leaf (rite.splits, rite.view), *parent, *other, *grand;
+    split_t *took;
+    view_t *v = rite.view;
+    int i;
+
+    if (s->parent == NULL)
+        {
+            status ("only one view");
+            return;
+        }
+
+    parent = s->parent;
+    other = parent->half[parent->half[0] == s ? 1 : 0];
+    grand = parent->parent;
+    *parent = *other;
+    parent->parent = grand;
+    for (i = 0; i < 2; ++i)
+        if (parent->half[i] != NULL)
+            parent->half[i]->parent = parent;
+    free (other);
+
+    /* focus the view that took the room, the first of them if it was
+     * split itself */
+    for (took = parent; took->view == NULL; took = took->half[0])
+        ;
+    views_focus (took->view);
+    vector_remove (&rite.views, views_index (v));
+    free (s);
+    view_free (v);
+    rite.repaint = true;
+}
+
+/* moves the focus n views on, in screen order */
+void
+views_step (int n)
+{
+    int len = rite.views.len, i = views_index (rite.view);
+
+    if (len > 1)
+        views_focus (VIEW (((i + n) % len + len) % len));
+}
+
+bool
+views_shows (page_t *page)
+{
+    int i;
+
+    for (i = 0; i < rite.views.len; ++i)
+        if (VIEW (i)->page == page)
+            return true;
+    return false;
+}
+
+void
+views_reset (page_t *page)
+{
+    int i;
+
+    for (i = 0; i < rite.views.len; ++i)
+        if (VIEW (i)->page == page)
+            wrap_reset (VIEW (i));
+}
+
+/* marks the views of a page that show a line from row on for redrawing,
+ * returning true if there are any */
+bool
+views_touch (page_t *page, int row)
+{
+    bool any = false;
+    view_t *v;
+    int i;
+
+    for (i = 0; i < rite.views.len; ++i)
+        if ((v = VIEW (i))->page == page
+            && row < fold_down (page, v->at.scroll, v->rows))
+            any = v->dirty = true;
+    return any;
+}
+
+/* the view at screen cell (y, x), and the line and byte drawn there. a
+ * cell past the end of a line or of a wrapped row gives the last byte */
+view_t *
+views_locate (int y, int x, int *row, int *col)
+{
+    int i, sub, from, next, w;
+    char buf[GUTTER_MAX];
+    view_t *v;
+    line_t *l;
+
+    for (i = 0; i < rite.views.len; ++i)
+        if ((v = VIEW (i))->page != NULL && y >= v->y && y < v->y + v->rows
+            && x >= v->x && x < v->x + v->cols)
+            break;
+    if (i == rite.views.len || v->page->lines.len == 0)
+        return NULL;
+
+    y -= v->y, x -= v->x;
+    if (v->wrap.on)
+        *row = wrap_at (v, wrap_before (v, v->at.scroll) + v->at.subscroll + y,
+                        &sub);
+    else
+        *row = fold_down (v->page, v->at.scroll, y), sub = 0;
+    *row = fold_top (v->page, MIN (*row, v->page->lines.len - 1));
+
+    l = vector_get (&v->page->lines, *row);
+    x = MAX (x - gutter (l, buf), 0);
+    if (!v->wrap.on)
+        {
+            *col = layout_byte (l, v->at.hscroll + x);
+            return v;
+        }
+
+    w = wrap_width (v, l);
+    for (from = 0; sub > 0 && (next = wrap_next (l, from, w)) >= 0; --sub)
+        from = next;
+    *col = layout_byte (l, layout_col (l, from) + x);
+    if ((next = wrap_next (l, from, w)) >= 0 && *col >= next)
+        *col = layout_prev (l, next);
+    return v;
+}
+
+/* lines [row, row + nold) of a page became nnew lines, and lines up to end
+ * may look different. the other views of the page keep showing the same
+ * lines, and are redrawn only if one of those changed */
+void
+views_edit (page_t *page, int row, int nold, int nnew, int end)
+{
+    int i, d = nnew - nold;
+    view_t *v;
+
+    for (i = 0; i < rite.views.len; ++i)
+        {
+            if ((v = VIEW (i))->page != page)
+                continue;
+
+            wrap_edit (v, row, nold, nnew);
+            if (v == rite.view)
+                continue;
+
+            if (v->at.row >= row + nold)
+                v->at.row += d;
+            else if (v->at.row >= row + nnew)
+                v->at.row = MAX (row + nnew - 1, 0);
+            if (v->at.scroll >= row + nold)
+                v->at.scroll += d;
+
+            if (row < fold_down (page, v->at.scroll, v->rows)
+                && MAX (row + MAX (nold, nnew), end) > v->at.scroll)
+                v->dirty = true;
+        }
+}
+
+bool
+views_done ()
+{
+    int i;
+
+    for (i = 0; i < rite.views.len; ++i)
+        if (!wrap_done (VIEW (i)) || !hl_done (VIEW (i)->page)
+            || !diff_done (VIEW (i)->page) || !match_done (VIEW (i)->page))
+            return false;
+    return true;
+}
+
+/* the background work of every view: wrap, highlighting, comparing with
+ * the file and measuring brackets */
+bool
+views_idle ()
+{
+    bool changed = false;
+    int i;
+
+    for (i = 0; i < rite.views.len; ++i)
+        {
+            wrap_scan (VIEW (i));
+            changed |= hl_scan (VIEW (i)->page);
+            changed |= diff_scan (VIEW (i)->page);
+            changed |= match_scan (VIEW (i)->page);
+        }
+    return changed;
+}
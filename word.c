@@ -0,0 +1,194 @@
+#include "rite.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* word motion. every byte has a class: words are letters, digits, '_'
+ * and anything past ascii, space is blanks, and the rest is punctuation.
+ * a word is a run of one class other than space. runs are measured 16
+ * bytes at a time, so a jump costs the same however long the words are */
+
+uint8_t word_class[256];
+
+void
+word_init ()
+{
+    int c;
+
+    for (c = 0; c < 256; ++c)
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+            || (c >= '0' && c <= '9') || c == '_' || c >= 0x80)
+            word_class[c] = WORD_WORD;
+        else if (c == ' ' || (c >= '\t' && c <= '\r'))
+            word_class[c] = WORD_SPACE;
+        else
+            word_class[c] = WORD_PUNCT;
+}
+
+#ifdef __SSE2__
+/* a bit per byte of p, set where the byte is of class cls */
+int
+word_mask (char *p, int cls)
+{
+    __m128i v = _mm_loadu_si128 ((__m128i *)p), lower, alpha, digit, other;
+    __m128i word, space;
+
+    /* the compares are signed, so bytes past ascii are the negative ones */
+    lower = _mm_or_si128 (v, _mm_set1_epi8 (0x20));
+    alpha = _mm_and_si128 (_mm_cmpgt_epi8 (lower, _mm_set1_epi8 ('a' - 1)),
+                           _mm_cmplt_epi8 (lower, _mm_set1_epi8 ('z' + 1)));
+    digit = _mm_and_si128 (_mm_cmpgt_epi8 (v, _mm_set1_epi8 ('0' - 1)),
+                           _mm_cmplt_epi8 (v, _mm_set1_epi8 ('9' + 1)));
+    other = _mm_or_si128 (_mm_cmpeq_epi8 (v, _mm_set1_epi8 ('_')),
+                          _mm_cmplt_epi8 (v, _mm_setzero_si128 ()));
+    word = _mm_or_si128 (_mm_or_si128 (alpha, digit), other);
+    space = _mm_or_si128 (
+        _mm_cmpeq_epi8 (v, _mm_set1_epi8 (' ')),
+        _mm_and_si128 (_mm_cmpgt_epi8 (v, _mm_set1_epi8 ('\t' - 1)),
+                       _mm_cmplt_epi8 (v, _mm_set1_epi8 ('\r' + 1))));
+
+    if (cls == WORD_WORD)
+        return _mm_movemask_epi8 (word);
+    if (cls == WORD_SPACE)
+        return _mm_movemask_epi8 (space);
+    return _mm_movemask_epi8 (_mm_or_si128 (word, space)) ^ 0xffff;
+}
+#endif
+
+/* length of the run of class cls at the start of s */
+int
+word_run (char *s, int n, int cls)
+{
+    char *p = s, *end = s + n;
+
+#ifdef __SSE2__
+    for (; p + 16 <= end; p += 16)
+        {
+            int mask = word_mask (p, cls) ^ 0xffff;
+            if (mask)
+                return p + __builtin_ctz (mask) - s;
+        }
+#endif
+
+    while (p < end && word_class[(uint8_t)*p] == cls)
+        p++;
+    return p - s;
+}
+
+/* length of the run of class cls ending at s + n */
+int
+word_run_back (char *s, int n, int cls)
+{
+    char *p = s + n;
+
+#ifdef __SSE2__
+    for (; p - s >= 16; p -= 16)
+        {
+            int mask = word_mask (p - 16, cls) ^ 0xffff;
+            if (mask)
+                return s + n - (p - 16 + 31 - __builtin_clz (mask) + 1);
+        }
+#endif
+
+    while (p > s && word_class[(uint8_t)p[-1]] == cls)
+        p--;
+    return s + n - p;
+}
+
+/* the start of the next word, going on to the next line at the end of
+ * one. an empty line counts as a word. returns false at the end */
+bool
+word_next (int *row, int *col)
+{
+    line_t *l = vector_get (&rite.page->lines, *row);
+    char *s = LINE_TEXT (l);
+    int i = *col, len = LINE_LEN (l);
+
+    if (i < len)
+        {
+            if (word_class[(uint8_t)s[i]] != WORD_SPACE)
+                i += word_run (s + i, len - i, word_class[(uint8_t)s[i]]);
+            i += word_run (s + i, len - i, WORD_SPACE);
+        }
+
+    while (i == len)
+        {
+            if (*row + 1 >= rite.page->lines.len)
+                {
+                    bool moved = (*col != i);
+                    *col = i;
+                    return moved;
+                }
+
+            l = vector_get (&rite.page->lines, ++*row);
+            s = LINE_TEXT (l), len = LINE_LEN (l);
+            i = word_run (s, len, WORD_SPACE);
+            if (len == 0)
+                break;
+        }
+
+    *col = i;
+    return true;
+}
+
+/* the start of the word before, going back over line ends like
+ * word_next. returns false at the start */
+bool
+word_prev (int *row, int *col)
+{
+    line_t *l = vector_get (&rite.page->lines, *row);
+    char *s = LINE_TEXT (l);
+    int i = *col;
+
+    i -= word_run_back (s, i, WORD_SPACE);
+    while (i == 0)
+        {
+            if (*row == 0)
+                {
+                    bool moved = (*col != 0);
+                    *col = 0;
+                    return moved;
+                }
+
+            l = vector_get (&rite.page->lines, --*row);
+            s = LINE_TEXT (l), i = LINE_LEN (l);
+            if (i == 0)
+                break;
+            i -= word_run_back (s, i, WORD_SPACE);
+        }
+
+    if (i > 0)
+        i -= word_run_back (s, i, word_class[(uint8_t)s[i - 1]]);
+
+    *col = i;
+    return true;
+}
+
+void
+jump_forward (int n)
+{
+    int row = rite.row, col = rite.col;
+
+    if (vector_get (&rite.page->lines, row) == NULL)
+        return;
+
+    while (n-- > 0 && word_next (&row, &col))
+        ;
+    move_row (row);
+    move_col (col);
+}
+
+void
+jump_back (int n)
+{
+    int row = rite.row, col = rite.col;
+
+    if (vector_get (&rite.page->lines, row) == NULL)
+        return;
+
+    while (n-- > 0 && word_prev (&row, &col))
+        ;
+    move_row (row);
+    move_col (col);
+}
@@ -0,0 +1,452 @@
+#include "rite.h"
+
+#include <string.h>
+
+#define WRAP_BLOCK 0x100
+#define WRAP_SLICE 0x8000
+
+#define BLOCK(i) ((wrapblock_t *)vector_get (&v->wrap.blocks, (i)))
+#define COUNT(b, i) ((int *)vector_get (&(b)->counts, (i)))
+
+/* soft wrap. each line takes as many screen rows as it needs at the width
+ * left next to its gutter, breaking before any character that would not
+ * fit whole, and always leaving room for the cursor after the last one.
+ *
+ * the row count of every line is kept in blocks, with a lazily rebuilt
+ * prefix of lines and rows per block, so finding the line at screen row n
+ * is a binary search plus a walk through one block. edits only measure
+ * the lines they touch. lines from scan onwards have not been measured at
+ * the current width yet: idle measures them in slices, so turning wrap on
+ * or resizing a huge page never stalls, and the lines on screen are
+ * measured as they are drawn. every view wraps at its own width, so each
+ * keeps its own counts */
+
+void
+wrap_reset (view_t *v)
+{
+    int i;
+
+    for (i = 0; i < v->wrap.blocks.len; ++i)
+        vector_deinit (&BLOCK (i)->counts);
+    vector_deinit (&v->wrap.blocks);
+    vector_deinit (&v->wrap.lines);
+    vector_deinit (&v->wrap.rows);
+    vector_init (&v->wrap.blocks, sizeof (wrapblock_t), 0x10);
+    vector_init (&v->wrap.lines, sizeof (int), 0x10);
+    vector_init (&v->wrap.rows, sizeof (int), 0x10);
+    v->wrap.scan = 0;
+    v->wrap.cols = v->cols;
+    v->wrap.dirty = true;
+
+    if (v->wrap.on && v->page != NULL)
+        wrap_insert (v, 0, v->page->lines.len);
+}
+
+void
+wrap_toggle ()
+{
+    view_t *v = rite.view;
+
+    v->wrap.on = !v->wrap.on;
+    rite.hscroll = 0;
+    wrap_reset (v);
+    status (v->wrap.on ? "wrap on" : "wrap off");
+}
+
+/* a resize keeps the old counts as a guess until they are measured again */
+void
+wrap_resize (view_t *v)
+{
+    if (v->wrap.cols != v->cols)
+        {
+            v->wrap.cols = v->cols;
+            v->wrap.scan = 0;
+        }
+}
+
+bool
+wrap_done (view_t *v)
+{
+    return !v->wrap.on || v->page == NULL
+           || v->wrap.scan >= v->page->lines.len;
+}
+
+int
+wrap_width (view_t *v, line_t *l)
+{
+    char buf[GUTTER_MAX];
+    return MAX (v->cols - gutter (l, buf), 1);
+}
+
+/* the byte the screen row after the one starting at from starts at, or -1
+ * if the rest of the line fits on this one */
+int
+wrap_next (line_t *l, int from, int w)
+{
+    layout_t *lo = layout_get (l);
+    cell_t *c, *end;
+    int len = LINE_LEN (l), x = 0, i = from, next, cw;
+
+    if (lo->cells.len == 0)
+        return len - from < w ? -1 : from + w;
+
+    c = layout_cell (lo, from, false);
+    end = (cell_t *)vector_head (&lo->cells) + lo->cells.len;
+
+    for (; i < len; ++c)
+        {
+            next = (c + 1 < end ? c[1].byte : len);
+            if (c->len == 0)
+                {
+                    /* a run of ascii, one column a byte */
+                    if (x + next - i >= w)
+                        return i + w - x;
+                    x += next - i;
+                }
+            else
+                {
+                    cw = (c + 1 < end ? c[1].col : lo->cols) - c->col;
+                    if (x + cw > w && x > 0)
+                        return i;
+                    x += cw;
+                }
+            i = next;
+        }
+
+    return x < w ? -1 : len;
+}
+
+int
+wrap_rows (view_t *v, line_t *l)
+{
+    int w = wrap_width (v, l), n = 1, from = 0;
+
+    if (layout_get (l)->cells.len == 0)
+        return LINE_LEN (l) / w + 1;
+
+    while ((from = wrap_next (l, from, w)) >= 0)
+        n++;
+    return n;
+}
+
+/* the screen row of a line byte is on, and its column in *x */
+int
+wrap_find (view_t *v, line_t *l, int byte, int *x)
+{
+    int w = wrap_width (v, l), from = 0, next, n = 0;
+
+    while ((next = wrap_next (l, from, w)) >= 0 && next <= byte)
+        from = next, n++;
+
+    *x = layout_col (l, byte) - layout_col (l, from);
+    return n;
+}
+
+void
+wrap_prefix (view_t *v)
+{
+    int i, lines = 0, rows = 0;
+
+    if (!v->wrap.dirty)
+        return;
+
+    v->wrap.lines.len = v->wrap.rows.len = v->wrap.blocks.len;
+    vector_resize (&v->wrap.lines);
+    vector_resize (&v->wrap.rows);
+    for (i = 0; i < v->wrap.blocks.len; ++i)
+        {
+            *(int *)vector_get (&v->wrap.lines, i) = lines;
+            *(int *)vector_get (&v->wrap.rows, i) = rows;
+            lines += BLOCK (i)->counts.len;
+            rows += BLOCK (i)->rows;
+        }
+    v->wrap.dirty = false;
+}
+
+/* the block holding a line, and the line's offset in it */
+int
+wrap_block (view_t *v, int row, int *i)
+{
+    int *lines, lo = 0, hi = v->wrap.blocks.len, mid;
+
+    wrap_prefix (v);
+    lines = vector_head (&v->wrap.lines);
+    while (hi - lo > 1)
+        {
+            mid = (lo + hi) / 2;
+            if (lines[mid] <= row)
+                lo = mid;
+            else
+                hi = mid;
+        }
+
+    *i = (lines == NULL ? 0 : row - lines[lo]);
+    return lo;
+}
+
+/* opens n unmeasured lines, of one row each, at row */
+void
+wrap_insert (view_t *v, int row, int n)
+{
+    wrapblock_t *b;
+    int block, i, j, *at;
+
+    if (n <= 0)
+        return;
+
+    if (v->wrap.blocks.len == 0)
+        {
+            b = vector_append (&v->wrap.blocks);
+            b->rows = 0;
+            vector_init (&b->counts, sizeof (int), WRAP_BLOCK);
+        }
+
+    block = wrap_block (v, row, &i);
+    b = BLOCK (block);
+    at = vector_splice (&b->counts, i, 0, n);
+    for (j = 0; j < n; ++j)
+        at[j] = 1;
+    b->rows += n;
+
+    /* cut what grew too big into blocks of WRAP_BLOCK, so a walk through
+     * one block stays short */
+    if (b->counts.len > 2 * WRAP_BLOCK)
+        {
+            vector_t all = b->counts;
+            int *counts = all.data, k = (all.len - 1) / WRAP_BLOCK + 1, m;
+
+            vector_splice (&v->wrap.blocks, block + 1, 0, k - 1);
+            for (m = 0; m < k; ++m)
+                {
+                    int from = m * WRAP_BLOCK;
+                    int take = MIN (WRAP_BLOCK, all.len - from);
+
+                    b = BLOCK (block + m);
+                    vector_init (&b->counts, sizeof (int), WRAP_BLOCK);
+                    b->counts.len = take;
+                    vector_resize (&b->counts);
+                    memcpy (vector_head (&b->counts), counts + from,
+                            take * sizeof (int));
+                    for (b->rows = 0, j = 0; j < take; ++j)
+                        b->rows += counts[from + j];
+                }
+            vector_deinit (&all);
+        }
+
+    v->wrap.dirty = true;
+}
+
+void
+wrap_remove (view_t *v, int row, int n)
+{
+    wrapblock_t *b;
+    int block, i, j, take;
+
+    if (n <= 0 || v->wrap.blocks.len == 0)
+        return;
+
+    block = wrap_block (v, row, &i);
+    while (n > 0 && block < v->wrap.blocks.len)
+        {
+            b = BLOCK (block);
+            take = MIN (n, b->counts.len - i);
+            for (j = 0; j < take; ++j)
+                b->rows -= *COUNT (b, i + j);
+            vector_splice (&b->counts, i, take, 0);
+            n -= take;
+            if (b->counts.len == 0)
+                {
+                    vector_deinit (&b->counts);
+                    vector_remove (&v->wrap.blocks, block);
+                }
+            else
+                block++;
+            i = 0;
+        }
+
+    v->wrap.dirty = true;
+}
+
+/* screen rows taken by a line, none if it is folded away */
+int
+wrap_count (view_t *v, int row)
+{
+    if (fold_at (v->page, row) != NULL)
+        return 0;
+    return wrap_rows (v, vector_get (&v->page->lines, row));
+}
+
+/* lines [row, row + n) were folded away, or shown again to be measured */
+void
+wrap_fold (view_t *v, int row, int n, bool hide)
+{
+    wrapblock_t *b;
+    int block, i, *count;
+
+    n = MIN (n, v->page->lines.len - row);
+    if (!v->wrap.on || n <= 0 || v->wrap.blocks.len == 0)
+        return;
+
+    block = wrap_block (v, row, &i);
+    for (; n > 0 && block < v->wrap.blocks.len; ++block, i = 0)
+        for (b = BLOCK (block); n > 0 && i < b->counts.len; ++i, --n)
+            {
+                count = COUNT (b, i);
+                b->rows += !hide - *count;
+                *count = !hide;
+            }
+
+    if (!hide)
+        v->wrap.scan = MIN (v->wrap.scan, row);
+    v->wrap.dirty = true;
+}
+
+/* measures a line again, if it has not been at the current width */
+void
+wrap_fix (view_t *v, int row, bool force)
+{
+    wrapblock_t *b;
+    int i, *count, n;
+
+    if (!v->wrap.on || (row < v->wrap.scan && !force)
+        || row >= v->page->lines.len)
+        return;
+
+    b = BLOCK (wrap_block (v, row, &i));
+    count = COUNT (b, i);
+    n = wrap_count (v, row);
+    if (n != *count)
+        {
+            b->rows += n - *count;
+            *count = n;
+            v->wrap.dirty = true;
+        }
+}
+
+/* lines [row, row + nold) became nnew lines */
+void
+wrap_edit (view_t *v, int row, int nold, int nnew)
+{
+    int i;
+
+    if (!v->wrap.on)
+        return;
+
+    wrap_remove (v, row, nold);
+    wrap_insert (v, row, nnew);
+
+    if (row + nold <= v->wrap.scan && row < v->wrap.scan)
+        {
+            v->wrap.scan += nnew - nold;
+            for (i = row; i < row + nnew; ++i)
+                wrap_fix (v, i, true);
+        }
+    else if (row < v->wrap.scan)
+        v->wrap.scan = row;
+}
+
+/* measures the next slice of lines, walking the blocks in step rather
+ * than looking each line up. nothing on screen changes, as drawn lines
+ * are measured anyway, so this never asks for a redraw */
+bool
+wrap_scan (view_t *v)
+{
+    wrapblock_t *b;
+    int block, i, n, *count;
+
+    if (wrap_done (v))
+        return false;
+
+    block = wrap_block (v, v->wrap.scan, &i);
+    for (n = 0; n < WRAP_SLICE && v->wrap.scan < v->page->lines.len;
+         ++n, ++i)
+        {
+            b = BLOCK (block);
+            if (i == b->counts.len)
+                b = BLOCK (++block), i = 0;
+
+            count = COUNT (b, i);
+            b->rows -= *count;
+            *count = wrap_count (v, v->wrap.scan++);
+            b->rows += *count;
+        }
+
+    v->wrap.dirty = true;
+    return false;
+}
+
+/* screen rows taken by the lines before row */
+int
+wrap_before (view_t *v, int row)
+{
+    int block, i, j, n;
+    wrapblock_t *b;
+
+    if (v->wrap.blocks.len == 0)
+        return 0;
+
+    block = wrap_block (v, row, &i);
+    b = BLOCK (block);
+    n = *(int *)vector_get (&v->wrap.rows, block);
+    for (j = 0; j < MIN (i, b->counts.len); ++j)
+        n += *COUNT (b, j);
+    return n;
+}
+
+/* the line at screen row n, and in *sub, which of its rows that is */
+int
+wrap_at (view_t *v, int n, int *sub)
+{
+    int *rows, lo = 0, hi = v->wrap.blocks.len, mid, i, row;
+    wrapblock_t *b;
+
+    *sub = 0;
+    if (hi == 0)
+        return 0;
+
+    wrap_prefix (v);
+    rows = vector_head (&v->wrap.rows);
+    while (hi - lo > 1)
+        {
+            mid = (lo + hi) / 2;
+            if (rows[mid] <= n)
+                lo = mid;
+            else
+                hi = mid;
+        }
+
+    b = BLOCK (lo);
+    n -= rows[lo];
+    row = *(int *)vector_get (&v->wrap.lines, lo);
+    for (i = 0; i < b->counts.len - 1 && n >= *COUNT (b, i); ++i)
+        n -= *COUNT (b, i);
+
+    *sub = MAX (MIN (n, *COUNT (b, i) - 1), 0);
+    return row + i;
+}
+
+/* scrolls so the cursor's screen row is one of the rows of the view */
+void
+wrap_scroll (view_t *v)
+{
+    line_t *l = vector_get (&v->page->lines, v->at.row);
+    int i, x, cursor, top, rows = MAX (v->rows, 1);
+
+    if (l == NULL)
+        return;
+
+    wrap_resize (v);
+    for (i = MAX (v->at.row - rows, 0); i <= v->at.row; ++i)
+        wrap_fix (v, i, false);
+
+    v->at.scroll = MIN (v->at.scroll, v->page->lines.len - 1);
+    cursor = wrap_before (v, v->at.row) + wrap_find (v, l, v->at.col, &x);
+    top = wrap_before (v, v->at.scroll) + v->at.subscroll;
+
+    if (cursor < top)
+        top = cursor;
+    else if (cursor >= top + rows)
+        top = cursor - rows + 1;
+
+    v->at.scroll = wrap_at (v, top, &v->at.subscroll);
+}